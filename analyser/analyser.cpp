@@ -1,5 +1,6 @@
 #include "analyser.h"
 
+
 #include <climits>
 
 namespace miniplc0 {
@@ -12,24 +13,24 @@ Analyser::Analyse() {
     return std::make_pair(_instructions, std::optional<CompilationError>());
 }
 
-bool expect(const std::optional<Token>& t, const TokenType& tt) {
-  return (t.has_value() && t.value().GetType() == tt);
-}
-
-bool seq(bool a, void (Analyser::*b)(void), Analyser* c) {
-  (c->*b)();
-  return a;
+std::pair<ir::Program, std::optional<CompilationError>>
+Analyser::AnalyseToIR() {
+  _ir = std::make_unique<ir::Program>();
+  auto err = analyseProgram();
+  if (!err.has_value()) err = _ir_error;
+  if (err.has_value()) return std::make_pair(ir::Program(), err);
+  return std::make_pair(std::move(*_ir), std::optional<CompilationError>());
 }
 
 std::optional<CompilationError> Analyser::analyseProgram() {
-  if (!(expect(nextToken(), TokenType::BEGIN)))
+  if (!(expectToken(TokenType::BEGIN)))
     return std::make_optional<CompilationError>(_current_pos,
                                                 ErrorCode::ErrNoBegin);
 
   auto err = analyseMain();
   if (err.has_value()) return err;
 
-  if (!(expect(nextToken(), TokenType::END)))
+  if (!(expectToken(TokenType::END)))
     return std::make_optional<CompilationError>(_current_pos,
                                                 ErrorCode::ErrNoEnd);
   return {};
@@ -49,120 +50,151 @@ std::optional<CompilationError> Analyser::analyseMain() {
 }
 
 std::optional<CompilationError> Analyser::analyseConstantDeclaration() {
-  while (true) {
-    if (!(expect(nextToken(), TokenType::CONST)
-              ? true
-              : seq(false, &Analyser::unreadToken, this))) {
-      return {};
-    }
-
-    if (!(seq(expect(nextToken(), TokenType::IDENTIFIER),
-              &Analyser::unreadToken, this)))
-      return std::make_optional<CompilationError>(_current_pos,
-                                                  ErrorCode::ErrNeedIdentifier);
-
-    auto next = nextToken();
-    if (isDeclared(next.value().GetValueString()))
-      return std::make_optional<CompilationError>(
-          _current_pos, ErrorCode::ErrDuplicateDeclaration);
-    addConstant(next.value());
+  while (tryExpectToken(TokenType::CONST)) {
+    auto err = analyseConstant();
+    if (err.has_value()) return err;
+  }
+  return {};
+}
 
-    if (!(expect(nextToken(), TokenType::EQUAL_SIGN)))
-      return std::make_optional<CompilationError>(
-          _current_pos, ErrorCode::ErrConstantNeedValue);
+std::optional<CompilationError> Analyser::analyseVariableDeclaration() {
+  while (tryExpectToken(TokenType::VAR)) {
+    auto err = analyseVariable();
+    if (err.has_value()) return err;
+  }
+  return {};
+}
 
-    int32_t val;
-    auto err = analyseConstantExpression(val);
+std::optional<CompilationError> Analyser::analyseStatementSequence() {
+  while (peekStatement()) {
+    auto err = analyseStatement();
     if (err.has_value()) return err;
+  }
+  return {};
+}
 
-    if (!(expect(nextToken(), TokenType::SEMICOLON)))
-      return std::make_optional<CompilationError>(_current_pos,
-                                                  ErrorCode::ErrNoSemicolon);
+std::pair<std::vector<Instruction>, std::optional<CompilationError>>
+Analyser::AnalysePart(Part& part) {
+  auto err = analysePart(part);
+  if (err.has_value())
+    return std::make_pair(std::vector<Instruction>(), err);
+  return std::make_pair(std::move(_instructions),
+                        std::optional<CompilationError>());
+}
 
-    _instructions.emplace_back(Operation::LIT, val);
+// Falls through the parts in the order analyseProgram() tries them.
+std::optional<CompilationError> Analyser::analysePart(Part& part) {
+  switch (part) {
+    case Part::BEGIN:
+      if (!(expectToken(TokenType::BEGIN)))
+        return std::make_optional<CompilationError>(_current_pos,
+                                                    ErrorCode::ErrNoBegin);
+      return {};
+    case Part::CONSTANT:
+      if (tryExpectToken(TokenType::CONST)) return analyseConstant();
+      part = Part::VARIABLE;
+      [[fallthrough]];
+    case Part::VARIABLE:
+      if (tryExpectToken(TokenType::VAR)) return analyseVariable();
+      part = Part::STATEMENT;
+      [[fallthrough]];
+    case Part::STATEMENT:
+      if (peekStatement()) return analyseStatement();
+      part = Part::END;
+      [[fallthrough]];
+    case Part::END:
+      if (!(expectToken(TokenType::END)))
+        return std::make_optional<CompilationError>(_current_pos,
+                                                    ErrorCode::ErrNoEnd);
+      return {};
   }
+  DieAndPrint("unknown part");
   return {};
 }
 
-std::optional<CompilationError> Analyser::analyseVariableDeclaration() {
-  while (1) {
-    if (!(expect(nextToken(), TokenType::VAR)
-              ? true
-              : seq(false, &Analyser::unreadToken, this)))
-      return {};
+std::optional<CompilationError> Analyser::analyseConstant() {
+  if (!(peekExpectToken(TokenType::IDENTIFIER)))
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNeedIdentifier);
 
-    if (!(seq(expect(nextToken(), TokenType::IDENTIFIER),
-              &Analyser::unreadToken, this)))
-      return std::make_optional<CompilationError>(_current_pos,
-                                                  ErrorCode::ErrNeedIdentifier);
+  auto ident = nextToken()->GetSymbol().value();
+  if (_symbols->Find(ident).kind != SymbolTable::UNDECLARED)
+    return std::make_optional<CompilationError>(
+        _current_pos, ErrorCode::ErrDuplicateDeclaration);
 
-    auto next = nextToken().value();
-    if (isDeclared(next.GetValueString()))
-      return {
-          CompilationError(_current_pos, ErrorCode::ErrDuplicateDeclaration)};
+  if (!(expectToken(TokenType::EQUAL_SIGN)))
+    return std::make_optional<CompilationError>(
+        _current_pos, ErrorCode::ErrConstantNeedValue);
 
-    if (!(expect(nextToken(), TokenType::EQUAL_SIGN)
-              ? true
-              : seq(false, &Analyser::unreadToken, this))) {
-      addUninitializedVariable(next);
+  int32_t val;
+  auto err = analyseConstantExpression(val);
+  if (err.has_value()) return err;
 
-      _instructions.emplace_back(Operation::LIT, 0);
+  if (!(expectToken(TokenType::SEMICOLON)))
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNoSemicolon);
 
-    } else {
-      auto err = analyseExpression();
-      if (err.has_value()) return err;
+  _symbols->Declare(ident, SymbolTable::CONSTANT);
+  emitLiteral(val);
+  emitDeclare();
+  return {};
+}
 
-      addVariable(next);
-    }
+std::optional<CompilationError> Analyser::analyseVariable() {
+  if (!(peekExpectToken(TokenType::IDENTIFIER)))
+    return std::make_optional<CompilationError>(_current_pos,
+                                                ErrorCode::ErrNeedIdentifier);
 
-    if (!(expect(nextToken(), TokenType::SEMICOLON))) {
-      return {CompilationError(_current_pos, ErrorCode::ErrNoSemicolon)};
-    }
+  auto ident = nextToken()->GetSymbol().value();
+  if (_symbols->Find(ident).kind != SymbolTable::UNDECLARED)
+    return {CompilationError(_current_pos, ErrorCode::ErrDuplicateDeclaration)};
+
+  if (!tryExpectToken(TokenType::EQUAL_SIGN)) {
+    _symbols->Declare(ident, SymbolTable::UNINITIALIZED_VARIABLE);
+
+    emitLiteral(0);
+    emitDeclare();
+
+  } else {
+    auto err = analyseExpression();
+    if (err.has_value()) return err;
+
+    _symbols->Declare(ident, SymbolTable::VARIABLE);
+    emitDeclare();
+  }
+
+  if (!(expectToken(TokenType::SEMICOLON))) {
+    return {CompilationError(_current_pos, ErrorCode::ErrNoSemicolon)};
   }
   return {};
 }
 
-std::optional<CompilationError> Analyser::analyseStatementSequence() {
-  while (true) {
-    if ((expect(nextToken(), TokenType::SEMICOLON)
-             ? true
-             : seq(false, &Analyser::unreadToken, this))) {
-    } else if ((seq(expect(nextToken(), TokenType::IDENTIFIER),
-                    &Analyser::unreadToken, this))) {
-      auto e = analyseAssignmentStatement();
-      if (e.has_value()) return e;
-    } else if ((seq(expect(nextToken(), TokenType::PRINT),
-                    &Analyser::unreadToken, this))) {
-      auto e = analyseOutputStatement();
-      if (e.has_value()) return e;
-    } else {
-      return {};
-    }
-  }
+bool Analyser::peekStatement() {
+  return peekExpectToken(TokenType::SEMICOLON) ||
+         peekExpectToken(TokenType::IDENTIFIER) ||
+         peekExpectToken(TokenType::PRINT);
+}
+
+std::optional<CompilationError> Analyser::analyseStatement() {
+  if (tryExpectToken(TokenType::SEMICOLON)) return {};
+  if (peekExpectToken(TokenType::IDENTIFIER))
+    return analyseAssignmentStatement();
+  return analyseOutputStatement();
 }
 
 std::optional<CompilationError> Analyser::analyseConstantExpression(
     int32_t& out) {
   bool neg = false;
-  if ((expect(nextToken(), TokenType::PLUS_SIGN)
-           ? true
-           : seq(false, &Analyser::unreadToken, this)))
+  if (tryExpectToken(TokenType::PLUS_SIGN))
     neg = false;
-  else if ((expect(nextToken(), TokenType::MINUS_SIGN)
-                ? true
-                : seq(false, &Analyser::unreadToken, this)))
+  else if (tryExpectToken(TokenType::MINUS_SIGN))
     neg = true;
-  if (!(seq(expect(nextToken(), TokenType::UNSIGNED_INTEGER),
-            &Analyser::unreadToken, this)))
+  if (!(peekExpectToken(TokenType::UNSIGNED_INTEGER)))
     return {CompilationError(_current_pos, ErrorCode::ErrIncompleteExpression)};
-  auto n = nextToken();
-
-  int32_t k;
-  try {
-    k = std::any_cast<int32_t>(n.value().GetValue());
-  } catch (std::bad_any_cast&) {
+  auto v = nextToken()->GetIntegerValue();
+  if (!v.has_value())
     return {CompilationError(_current_pos, ErrorCode::ErrIncompleteExpression)};
-  }
+  int32_t k = v.value();
   if (neg) k = -k;
   out = k;
   return {};
@@ -174,13 +206,9 @@ std::optional<CompilationError> Analyser::analyseExpression() {
 
   while (true) {
     bool plus;
-    if ((expect(nextToken(), TokenType::PLUS_SIGN)
-             ? true
-             : seq(false, &Analyser::unreadToken, this))) {
+    if (tryExpectToken(TokenType::PLUS_SIGN)) {
       plus = true;
-    } else if ((expect(nextToken(), TokenType::MINUS_SIGN)
-                    ? true
-                    : seq(false, &Analyser::unreadToken, this))) {
+    } else if (tryExpectToken(TokenType::MINUS_SIGN)) {
       plus = false;
     } else {
       return {};
@@ -189,60 +217,55 @@ std::optional<CompilationError> Analyser::analyseExpression() {
     err = analyseItem();
     if (err.has_value()) return err;
 
-    if (plus)
-      _instructions.emplace_back(Operation::ADD, 0);
-    else
-      _instructions.emplace_back(Operation::SUB, 0);
+    emitArithmetic(plus ? Operation::ADD : Operation::SUB);
   }
   return {};
 }
 
 std::optional<CompilationError> Analyser::analyseAssignmentStatement() {
-  auto next = nextToken();
-
-  auto ident = next.value().GetValueString();
-  if (!isDeclared(ident))
+  auto ident = nextToken()->GetSymbol().value();
+  auto symbol = _symbols->Find(ident);
+  if (symbol.kind == SymbolTable::UNDECLARED)
     return {CompilationError(_current_pos, ErrorCode::ErrNotDeclared)};
-  if (isConstant(ident))
+  if (symbol.kind == SymbolTable::CONSTANT)
     return {CompilationError(_current_pos, ErrorCode::ErrAssignToConstant)};
 
-  if (!(expect(nextToken(), TokenType::EQUAL_SIGN)))
+  if (!(expectToken(TokenType::EQUAL_SIGN)))
     return {CompilationError(_current_pos, ErrorCode::ErrIncompleteExpression)};
 
   auto err = analyseExpression();
   if (err.has_value()) return err;
 
-  if (!isInitializedVariable(ident)) makeInitialized(next.value());
-  if (!(expect(nextToken(), TokenType::SEMICOLON)))
+  if (symbol.kind == SymbolTable::UNINITIALIZED_VARIABLE)
+    _symbols->MakeInitialized(ident);
+  if (!(expectToken(TokenType::SEMICOLON)))
     return {CompilationError(_current_pos, ErrorCode::ErrNoSemicolon)};
 
-  _instructions.emplace_back(Operation::STO, getIndex(ident));
+  emitStore(symbol.index);
 
   return {};
 }
 
 std::optional<CompilationError> Analyser::analyseOutputStatement() {
-  auto next = nextToken();
+  // print
+  nextToken();
 
-  next = nextToken();
-  if (!next.has_value() || next.value().GetType() != TokenType::LEFT_BRACKET)
+  if (!expectToken(TokenType::LEFT_BRACKET))
     return std::make_optional<CompilationError>(_current_pos,
                                                 ErrorCode::ErrInvalidPrint);
 
   auto err = analyseExpression();
   if (err.has_value()) return err;
 
-  next = nextToken();
-  if (!next.has_value() || next.value().GetType() != TokenType::RIGHT_BRACKET)
+  if (!expectToken(TokenType::RIGHT_BRACKET))
     return std::make_optional<CompilationError>(_current_pos,
                                                 ErrorCode::ErrInvalidPrint);
 
-  next = nextToken();
-  if (!next.has_value() || next.value().GetType() != TokenType::SEMICOLON)
+  if (!expectToken(TokenType::SEMICOLON))
     return std::make_optional<CompilationError>(_current_pos,
                                                 ErrorCode::ErrNoSemicolon);
 
-  _instructions.emplace_back(Operation::WRT, 0);
+  emitPrint();
   return {};
 }
 
@@ -252,13 +275,9 @@ std::optional<CompilationError> Analyser::analyseItem() {
 
   while (true) {
     bool mult;
-    if ((expect(nextToken(), TokenType::MULTIPLICATION_SIGN)
-             ? true
-             : seq(false, &Analyser::unreadToken, this))) {
+    if (tryExpectToken(TokenType::MULTIPLICATION_SIGN)) {
       mult = true;
-    } else if ((expect(nextToken(), TokenType::DIVISION_SIGN)
-                    ? true
-                    : seq(false, &Analyser::unreadToken, this))) {
+    } else if (tryExpectToken(TokenType::DIVISION_SIGN)) {
       mult = false;
     } else {
       return {};
@@ -267,122 +286,138 @@ std::optional<CompilationError> Analyser::analyseItem() {
     err = analyseFactor();
     if (err.has_value()) return err;
 
-    if (mult)
-      _instructions.emplace_back(Operation::MUL, 0);
-    else
-      _instructions.emplace_back(Operation::DIV, 0);
+    emitArithmetic(mult ? Operation::MUL : Operation::DIV);
   }
   return {};
 }
 
 std::optional<CompilationError> Analyser::analyseFactor() {
-  auto next = nextToken();
   auto prefix = 1;
-  if (!next.has_value())
+  if (peekToken() == nullptr)
     return std::make_optional<CompilationError>(
         _current_pos, ErrorCode::ErrIncompleteExpression);
-  if (next.value().GetType() == TokenType::PLUS_SIGN)
+  if (tryExpectToken(TokenType::PLUS_SIGN))
     prefix = 1;
-  else if (next.value().GetType() == TokenType::MINUS_SIGN) {
+  else if (tryExpectToken(TokenType::MINUS_SIGN)) {
     prefix = -1;
-    _instructions.emplace_back(Operation::LIT, 0);
-  } else
-    unreadToken();
-
-  if ((seq(expect(nextToken(), TokenType::IDENTIFIER), &Analyser::unreadToken,
-           this))) {
-    auto next = nextToken().value();
-    auto ident = next.GetValueString();
-    if (!isDeclared(ident))
+    emitLiteral(0);
+  }
+
+  if ((peekExpectToken(TokenType::IDENTIFIER))) {
+    auto symbol = _symbols->Find(nextToken()->GetSymbol().value());
+    if (symbol.kind == SymbolTable::UNDECLARED)
       return {CompilationError(_current_pos, ErrorCode::ErrNotDeclared)};
-    if (!isInitializedVariable(ident) && !isConstant(ident))
+    if (symbol.kind == SymbolTable::UNINITIALIZED_VARIABLE)
       return {CompilationError(_current_pos, ErrorCode::ErrNotInitialized)};
 
-    _instructions.emplace_back(Operation::LOD, getIndex(ident));
+    emitLoad(symbol.index);
 
-  } else if ((seq(expect(nextToken(), TokenType::UNSIGNED_INTEGER),
-                  &Analyser::unreadToken, this))) {
-    auto next = nextToken().value();
+  } else if ((peekExpectToken(TokenType::UNSIGNED_INTEGER))) {
+    int32_t val = nextToken()->GetIntegerValue().value();
+    emitLiteral(val);
 
-    int32_t val = std::any_cast<int32_t>(next.GetValue());
-    _instructions.emplace_back(Operation::LIT, val);
-
-  } else if ((expect(nextToken(), TokenType::LEFT_BRACKET)
-                  ? true
-                  : seq(false, &Analyser::unreadToken, this))) {
-    analyseExpression();
-    if (!(expect(nextToken(), TokenType::RIGHT_BRACKET)))
+  } else if (tryExpectToken(TokenType::LEFT_BRACKET)) {
+    // Direct emission has always carried on past an error inside brackets,
+    // leaving out whatever the expression failed to push. A tree cannot be
+    // built without those operands, so the IR path reports the error.
+    auto err = analyseExpression();
+    if (err.has_value() && _ir && !_ir_error.has_value()) _ir_error = err;
+    if (!(expectToken(TokenType::RIGHT_BRACKET)))
       return {
           CompilationError(_current_pos, ErrorCode::ErrIncompleteExpression)};
   } else {
     return {CompilationError(_current_pos, ErrorCode::ErrIncompleteExpression)};
   }
 
-  if (prefix == -1) _instructions.emplace_back(Operation::SUB, 0);
+  if (prefix == -1) emitArithmetic(Operation::SUB);
   return {};
 }
 
-std::optional<Token> Analyser::nextToken() {
-  if (_offset == _tokens.size()) return {};
-
-  _current_pos = _tokens[_offset].GetEndPos();
-  return _tokens[_offset++];
+void Analyser::emitLiteral(int32_t value) {
+  if (_ir)
+    _ir_stack.push_back(_ir->Literal(value));
+  else
+    _instructions.emplace_back(Operation::LIT, value);
 }
 
-void Analyser::unreadToken() {
-  if (_offset == 0) DieAndPrint("analyser unreads token from the begining.");
-  _current_pos = _tokens[_offset - 1].GetEndPos();
-  _offset--;
+void Analyser::emitLoad(int32_t slot) {
+  if (_ir)
+    _ir_stack.push_back(_ir->Load(slot));
+  else
+    _instructions.emplace_back(Operation::LOD, slot);
 }
 
-void Analyser::_add(const Token& tk, std::map<std::string, int32_t>& mp) {
-  if (tk.GetType() != TokenType::IDENTIFIER)
-    DieAndPrint("only identifier can be added to the table.");
-  mp[tk.GetValueString()] = _nextTokenIndex;
-  _nextTokenIndex++;
+void Analyser::emitArithmetic(Operation op) {
+  if (_ir) {
+    auto rhs = popExpr();
+    auto lhs = popExpr();
+    _ir_stack.push_back(_ir->Binary(op, lhs, rhs));
+    return;
+  }
+  _instructions.emplace_back(op, 0);
 }
 
-void Analyser::addVariable(const Token& tk) { _add(tk, _vars); }
-
-void Analyser::addConstant(const Token& tk) { _add(tk, _consts); }
+void Analyser::emitDeclare() {
+  // Directly emitted code already left the value in the new slot.
+  if (_ir) _ir->Declare(popExpr());
+}
 
-void Analyser::makeInitialized(const Token& var) {
-  makeInitialized(var.GetValueString());
+void Analyser::emitStore(int32_t slot) {
+  if (_ir)
+    _ir->Store(slot, popExpr());
+  else
+    _instructions.emplace_back(Operation::STO, slot);
 }
-void Analyser::makeInitialized(const std::string& var_name) {
-  auto var = _uninitialized_vars.find(var_name);
-  if (var == _uninitialized_vars.end())
-    DieAndPrint("Variable not found in uninitialized area. bad bad");
-  auto item = _uninitialized_vars.extract(var);
-  _vars.insert(std::move(item));
+
+void Analyser::emitPrint() {
+  if (_ir)
+    _ir->Print(popExpr());
+  else
+    _instructions.emplace_back(Operation::WRT, 0);
 }
 
-void Analyser::addUninitializedVariable(const Token& tk) {
-  _add(tk, _uninitialized_vars);
+ir::ExprId Analyser::popExpr() {
+  // Operands only go missing after an error inside brackets, which
+  // _ir_error already holds; keep building so the analysis can finish.
+  if (_ir_stack.empty()) return _ir->Literal(0);
+  auto e = _ir_stack.back();
+  _ir_stack.pop_back();
+  return e;
 }
 
-int32_t Analyser::getIndex(const std::string& s) {
-  if (_uninitialized_vars.find(s) != _uninitialized_vars.end())
-    return _uninitialized_vars[s];
-  else if (_vars.find(s) != _vars.end())
-    return _vars[s];
-  else
-    return _consts[s];
+const Token* Analyser::peekToken() {
+  if (_offset == _read) {
+    // The token goes straight from the stream into its slot.
+    auto& slot = _history[_read % HistorySize];
+    slot = _stream->Next();
+    if (!slot.has_value()) return nullptr;
+    _read++;
+  }
+
+  auto& token = _history[_offset % HistorySize].value();
+  _current_pos = token.GetEndPos();
+  return &token;
 }
 
-bool Analyser::isDeclared(const std::string& s) {
-  return isConstant(s) || isUninitializedVariable(s) ||
-         isInitializedVariable(s);
+const Token* Analyser::nextToken() {
+  auto token = peekToken();
+  if (token != nullptr) _offset++;
+  return token;
 }
 
-bool Analyser::isUninitializedVariable(const std::string& s) {
-  return _uninitialized_vars.find(s) != _uninitialized_vars.end();
+bool Analyser::expectToken(TokenType tt) {
+  auto token = nextToken();
+  return token != nullptr && token->GetType() == tt;
 }
-bool Analyser::isInitializedVariable(const std::string& s) {
-  return _vars.find(s) != _vars.end();
+
+bool Analyser::tryExpectToken(TokenType tt) {
+  if (!peekExpectToken(tt)) return false;
+  _offset++;
+  return true;
 }
 
-bool Analyser::isConstant(const std::string& s) {
-  return _consts.find(s) != _consts.end();
+bool Analyser::peekExpectToken(TokenType tt) {
+  auto token = peekToken();
+  return token != nullptr && token->GetType() == tt;
 }
 }  // namespace miniplc0
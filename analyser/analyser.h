@@ -1,120 +1,191 @@
-#pragma once
-
-#include "error/error.h"
-#include "instruction/instruction.h"
-#include "tokenizer/token.h"
-
-#include <cstddef>  // for std::size_t
-#include <cstdint>
-#include <map>
-#include <optional>
-#include <utility>
-#include <vector>
-
-namespace miniplc0 {
-
-class Analyser final {
- private:
-  using uint64_t = std::uint64_t;
-  using int64_t = std::int64_t;
-  using uint32_t = std::uint32_t;
-  using int32_t = std::int32_t;
-
- public:
-  Analyser(std::vector<Token> v)
-      : _tokens(std::move(v)),
-        _offset(0),
-        _instructions({}),
-        _current_pos(0, 0),
-        _uninitialized_vars({}),
-        _vars({}),
-        _consts({}),
-        _nextTokenIndex(0) {}
-  Analyser(Analyser&&) = delete;
-  Analyser(const Analyser&) = delete;
-  Analyser& operator=(Analyser) = delete;
-
-  // 唯一接口
-  std::pair<std::vector<Instruction>, std::optional<CompilationError>>
-  Analyse();
-
- private:
-  // 所有的递归子程序
-
-  // <程序>
-  std::optional<CompilationError> analyseProgram();
-  // <主过程>
-  std::optional<CompilationError> analyseMain();
-  // <常量声明>
-  std::optional<CompilationError> analyseConstantDeclaration();
-  // <变量声明>
-  std::optional<CompilationError> analyseVariableDeclaration();
-  // <语句序列>
-  std::optional<CompilationError> analyseStatementSequence();
-  // <常表达式>
-  // 这里的 out 是常表达式的值
-  std::optional<CompilationError> analyseConstantExpression(int32_t& out);
-  // <表达式>
-  std::optional<CompilationError> analyseExpression();
-  // <赋值语句>
-  std::optional<CompilationError> analyseAssignmentStatement();
-  // <输出语句>
-  std::optional<CompilationError> analyseOutputStatement();
-  // <项>
-  std::optional<CompilationError> analyseItem();
-  // <因子>
-  std::optional<CompilationError> analyseFactor();
-
-  // Token 缓冲区相关操作
-
-  // 返回下一个 token
-  std::optional<Token> nextToken();
-  // // 期望下一个 token 是指定的种类，不回退
-  // inline bool expectToken(const TokenType&);
-  // // 期望下一个 token 是指定的种类，如果不是的话回退
-  // inline bool tryExpectToken(const TokenType&);
-  // // 期望下一个 token 是指定的种类，总是回退
-  // inline bool peekExpectToken(const TokenType&);
-  // 回退一个 token
-  void unreadToken();
-
-  // 下面是符号表相关操作
-
-  // helper function
-  void _add(const Token&, std::map<std::string, int32_t>&);
-  // 添加变量、常量、未初始化的变量
-  void addVariable(const Token&);
-  void addConstant(const Token&);
-  void addUninitializedVariable(const Token&);
-  // 是否被声明过
-  bool isDeclared(const std::string&);
-  // 是否是未初始化的变量
-  bool isUninitializedVariable(const std::string&);
-  // 是否是已初始化的变量
-  bool isInitializedVariable(const std::string&);
-  // 把一个没有初始化过的变量移到已经初始化过的区域
-  void makeInitialized(const std::string&);
-  void makeInitialized(const miniplc0::Token&);
-  // 是否是常量
-  bool isConstant(const std::string&);
-  // 获得 {变量，常量} 在栈上的偏移
-  int32_t getIndex(const std::string&);
-
- private:
-  std::vector<Token> _tokens;
-  std::size_t _offset;
-  std::vector<Instruction> _instructions;
-  std::pair<uint64_t, uint64_t> _current_pos;
-
-  // 为了简单处理，我们直接把符号表耦合在语法分析里
-  // 变量                   示例
-  // _uninitialized_vars    int a;
-  // _vars                  int a=1;
-  // _consts                const a=1;
-  std::map<std::string, int32_t> _uninitialized_vars;
-  std::map<std::string, int32_t> _vars;
-  std::map<std::string, int32_t> _consts;
-  // 下一个 token 在栈的偏移
-  int32_t _nextTokenIndex;
-};
-}  // namespace miniplc0
+#pragma once
+
+#include "error/error.h"
+#include "analyser/symbol_table.h"
+#include "instruction/instruction.h"
+#include "ir/ir.h"
+#include "tokenizer/token.h"
+#include "tokenizer/token_stream.h"
+
+#include <array>
+#include <cstddef>  // for std::size_t
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+class Analyser final {
+ private:
+  using uint64_t = std::uint64_t;
+  using int64_t = std::int64_t;
+  using uint32_t = std::uint32_t;
+  using int32_t = std::int32_t;
+
+ public:
+  Analyser(std::vector<Token> v)
+      : _owned_stream(std::make_unique<VectorTokenStream>(std::move(v))),
+        _stream(_owned_stream.get()),
+        _history(),
+        _read(0),
+        _offset(0),
+        _instructions({}),
+        _current_pos(0, 0),
+        _owned_symbols(),
+        _symbols(&_owned_symbols),
+        _ir(),
+        _ir_stack(),
+        _ir_error() {}
+  // 一边从 stream 中拉取 token 一边分析
+  // 词法错误不会体现在 Analyse() 的结果里，需要另外检查 stream.Error()
+  Analyser(TokenStream& stream)
+      : _owned_stream(),
+        _stream(&stream),
+        _history(),
+        _read(0),
+        _offset(0),
+        _instructions({}),
+        _current_pos(0, 0),
+        _owned_symbols(),
+        _symbols(&_owned_symbols),
+        _ir(),
+        _ir_stack(),
+        _ir_error() {}
+  // 增量分析用，见 analyser/incremental.h
+  // 符号表用外面的 symbols，分析的结果会直接更新到里面；
+  // 一个 token 都还没有读到时，出错的位置是 pos
+  Analyser(TokenStream& stream, SymbolTable& symbols,
+           std::pair<uint64_t, uint64_t> pos)
+      : _owned_stream(),
+        _stream(&stream),
+        _history(),
+        _read(0),
+        _offset(0),
+        _instructions({}),
+        _current_pos(pos),
+        _owned_symbols(),
+        _symbols(&symbols),
+        _ir(),
+        _ir_stack(),
+        _ir_error() {}
+  Analyser(Analyser&&) = delete;
+  Analyser(const Analyser&) = delete;
+  Analyser& operator=(Analyser) = delete;
+
+  // 唯一接口
+  std::pair<std::vector<Instruction>, std::optional<CompilationError>>
+  Analyse();
+  // 不直接生成指令，而是生成中间表示，优化以后再用 Lower() 得到指令
+  // 和 Analyse() 一样只能调用一次
+  // Analyse() 会忽略括号里的表达式的错误，接着分析下去，生成的指令少了操作数，
+  // 比如 `print((b))` 里 b 没有声明时只生成一条 WRT；这里报告这个被忽略的
+  // 错误（`()` 是 ErrIncompleteExpression），其余的错误和 Analyse() 一样
+  std::pair<ir::Program, std::optional<CompilationError>> AnalyseToIR();
+
+  // 程序由 begin、常量声明、变量声明、语句和 end 这些部分依次组成，
+  // 其中的声明和语句每一个都是一个部分
+  enum class Part : std::uint8_t { BEGIN, CONSTANT, VARIABLE, STATEMENT, END };
+  // 只分析 stream 开头的一个部分，不支持中间表示
+  // part 传入的是这里可以出现的最靠前的一种部分，比如 CONSTANT 表示接下来
+  // 可以是常量声明、变量声明、语句或者 end；返回时是实际分析的那一种
+  // 没有错误时，依次分析每一个部分得到的指令连起来就是 Analyse() 的结果
+  std::pair<std::vector<Instruction>, std::optional<CompilationError>>
+  AnalysePart(Part& part);
+  // 已经读入的 token 的个数，不算向前看了一眼的那个
+  uint64_t Consumed() const { return _offset; }
+
+ private:
+  // 所有的递归子程序
+
+  // <程序>
+  std::optional<CompilationError> analyseProgram();
+  // <主过程>
+  std::optional<CompilationError> analyseMain();
+  // <常量声明>
+  std::optional<CompilationError> analyseConstantDeclaration();
+  // <变量声明>
+  std::optional<CompilationError> analyseVariableDeclaration();
+  // <语句序列>
+  std::optional<CompilationError> analyseStatementSequence();
+  // 一个部分，part 的含义和 AnalysePart() 一样
+  std::optional<CompilationError> analysePart(Part& part);
+  // 读入 const 以后的一个常量声明
+  std::optional<CompilationError> analyseConstant();
+  // 读入 var 以后的一个变量声明
+  std::optional<CompilationError> analyseVariable();
+  // 下一个 token 是不是语句的开头
+  bool peekStatement();
+  // <语句>
+  std::optional<CompilationError> analyseStatement();
+  // <常表达式>
+  // 这里的 out 是常表达式的值
+  std::optional<CompilationError> analyseConstantExpression(int32_t& out);
+  // <表达式>
+  std::optional<CompilationError> analyseExpression();
+  // <赋值语句>
+  std::optional<CompilationError> analyseAssignmentStatement();
+  // <输出语句>
+  std::optional<CompilationError> analyseOutputStatement();
+  // <项>
+  std::optional<CompilationError> analyseItem();
+  // <因子>
+  std::optional<CompilationError> analyseFactor();
+
+  // 生成代码
+  // 直接生成指令时，和栈式虚拟机一样按后序生成；生成中间表示时，
+  // 用 _ir_stack 把同样的顺序组装成表达式树
+
+  void emitLiteral(int32_t value);
+  void emitLoad(int32_t slot);
+  // 生成一条算术指令，能折叠的话和它的两个操作数合并成一条 LIT
+  void emitArithmetic(Operation op);
+  // 栈顶的值成为新声明的符号
+  void emitDeclare();
+  void emitStore(int32_t slot);
+  void emitPrint();
+  // 取出一个还没有组装的表达式，没有的话记录错误并返回一个占位的 0
+  ir::ExprId popExpr();
+
+  // Token 缓冲区相关操作
+  // 这些函数都不拷贝 token，返回的指针在下一次读入 token 之前有效
+
+  // 看一眼下一个 token 但不读入，没有更多 token 时返回空指针
+  const Token* peekToken();
+  // 读入下一个 token，没有更多 token 时返回空指针
+  const Token* nextToken();
+  // 期望下一个 token 是指定的种类，不回退
+  bool expectToken(TokenType);
+  // 期望下一个 token 是指定的种类，如果不是的话回退
+  bool tryExpectToken(TokenType);
+  // 期望下一个 token 是指定的种类，总是回退
+  bool peekExpectToken(TokenType);
+
+ private:
+  // 刚读入的 token 和向前看的那一个
+  static constexpr std::size_t HistorySize = 2;
+
+  std::unique_ptr<TokenStream> _owned_stream;
+  TokenStream* _stream;
+  // 第 i 个 token 保存在 _history[i % HistorySize] 里
+  std::array<std::optional<Token>, HistorySize> _history;
+  // 已经从流里拉取的 token 的个数
+  uint64_t _read;
+  // 下一个要读的 token 的序号
+  uint64_t _offset;
+  std::vector<Instruction> _instructions;
+  std::pair<uint64_t, uint64_t> _current_pos;
+
+  // 为了简单处理，我们直接把符号表耦合在语法分析里
+  // 一般用自己的 _owned_symbols，增量分析时用外面的
+  SymbolTable _owned_symbols;
+  SymbolTable* _symbols;
+
+  // 只在 AnalyseToIR() 时不为空
+  std::unique_ptr<ir::Program> _ir;
+  // 还没有组装进语句的表达式
+  std::vector<ir::ExprId> _ir_stack;
+  std::optional<CompilationError> _ir_error;
+};
+}  // namespace miniplc0
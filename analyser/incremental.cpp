@@ -0,0 +1,354 @@
+#include "analyser/incremental.h"
+
+#include "tokenizer/source.h"
+#include "tokenizer/token_stream.h"
+#include "tokenizer/tokenizer.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace miniplc0 {
+
+namespace {
+// The interner is only compacted once it holds this many strings.
+constexpr std::size_t MIN_COMPACTED = 1024;
+
+bool sameEntry(const SymbolTable::Entry& lhs, const SymbolTable::Entry& rhs) {
+  return lhs.kind == rhs.kind && lhs.index == rhs.index;
+}
+}  // namespace
+
+// Hands out the tokens from a cursor on, moved to the lines they are on.
+class IncrementalAnalyser::PartStream final : public TokenStream {
+ public:
+  PartStream(const std::vector<Line>& lines, Cursor cursor)
+      : _lines(lines), _cursor(cursor) {}
+
+  std::optional<Token> Next() override {
+    while (_cursor.line < _lines.size() &&
+           _cursor.index == _lines[_cursor.line].tokens.size()) {
+      _cursor.line++;
+      _cursor.index = 0;
+    }
+    if (_cursor.line == _lines.size()) return {};
+    return _lines[_cursor.line].tokens[_cursor.index++].MovedDown(
+        _cursor.line);
+  }
+
+ private:
+  const std::vector<Line>& _lines;
+  Cursor _cursor;
+};
+
+IncrementalAnalyser::IncrementalAnalyser(std::string_view text)
+    : _interner(std::make_unique<Interner>()),
+      _lines(1),
+      _token_count(0),
+      _error_lines(0),
+      _parts(),
+      _analysed(false),
+      _stats() {
+  Replace(text);
+}
+
+void IncrementalAnalyser::Replace(std::string_view text) {
+  Edit({0, 0}, {_lines.size(), 0}, text);
+}
+
+void IncrementalAnalyser::Edit(std::pair<uint64_t, uint64_t> start,
+                               std::pair<uint64_t, uint64_t> end,
+                               std::string_view text) {
+  auto clamp = [this](std::pair<uint64_t, uint64_t> pos) {
+    if (pos.first >= _lines.size())
+      return std::make_pair(_lines.size() - 1, _lines.back().text.size());
+    auto line = static_cast<std::size_t>(pos.first);
+    return std::make_pair(
+        line, static_cast<std::size_t>(std::min<uint64_t>(
+                  pos.second, _lines[line].text.size())));
+  };
+  auto first = clamp(start), last = clamp(end);
+  if (last < first) std::swap(first, last);
+
+  // Only the lines the edit touches are split up again and relexed.
+  auto joined = _lines[first.first].text.substr(0, first.second);
+  joined += text;
+  joined += std::string_view(_lines[last.first].text).substr(last.second);
+  std::vector<Line> lines(1);
+  for (auto c : joined) {
+    if (c == '\n')
+      lines.emplace_back();
+    else
+      lines.back().text += c;
+  }
+  replaceLines(first.first, last.first + 1, std::move(lines));
+}
+
+std::string IncrementalAnalyser::Text() const {
+  std::string text;
+  for (std::size_t i = 0; i < _lines.size(); i++) {
+    if (i != 0) text += '\n';
+    text += _lines[i].text;
+  }
+  return text;
+}
+
+std::optional<CompilationError> IncrementalAnalyser::LexicalError() const {
+  if (_error_lines == 0) return {};
+  for (std::size_t i = 0; i < _lines.size(); i++) {
+    auto& error = _lines[i].error;
+    if (!error.has_value()) continue;
+    auto pos = error.value().GetPos();
+    return CompilationError(pos.first + i, pos.second,
+                            error.value().GetCode());
+  }
+  return {};
+}
+
+std::optional<CompilationError> IncrementalAnalyser::Analyse() {
+  std::atomic<bool> never(false);
+  std::optional<CompilationError> err;
+  Analyse(never, err);
+  return err;
+}
+
+bool IncrementalAnalyser::Analyse(const std::atomic<bool>& cancel,
+                                  std::optional<CompilationError>& err) {
+  _analysed = false;
+  err = LexicalError();
+  if (err.has_value()) return true;
+
+  SymbolTable symbols;
+  std::vector<Part> parts;
+  parts.reserve(_parts.size());
+  auto phase = Analyser::Part::BEGIN;
+  Cursor cursor;
+  uint64_t pos = 0;
+  // The old part i starts at token old.
+  std::size_t i = 0;
+  uint64_t old = 0;
+
+  // An old part gives the same result as long as it is still where the
+  // parts in front of it leave off, is allowed to come after them, and the
+  // symbols it uses have not changed.
+  auto reusable = [&](const Part& part) {
+    if (part.dirty) return false;
+    if (phase == Analyser::Part::BEGIN ? part.kind != Analyser::Part::BEGIN
+                                       : part.kind < phase)
+      return false;
+    for (auto& read : part.reads)
+      if (!sameEntry(symbols.Find(read.first), read.second)) return false;
+    return true;
+  };
+
+  bool cancelled = false;
+  while (true) {
+    if (cancel.load(std::memory_order_relaxed)) {
+      cancelled = true;
+      break;
+    }
+    while (i < _parts.size() && old < pos) old += _parts[i++].tokens;
+    if (i < _parts.size() && old == pos && reusable(_parts[i])) {
+      auto& part = _parts[i];
+      if (part.effect.has_value()) {
+        auto& effect = part.effect.value();
+        if (symbols.Find(effect.first).kind == SymbolTable::UNDECLARED)
+          symbols.Declare(effect.first, effect.second.kind);
+        else
+          symbols.MakeInitialized(effect.first);
+      }
+      advance(cursor, part.tokens);
+      pos += part.tokens;
+      phase = part.kind;
+      parts.push_back(std::move(part));
+      _stats.reused_parts++;
+    } else {
+      Part part;
+      err = analysePart(cursor, pos, symbols, phase, part);
+      if (err.has_value()) break;
+      advance(cursor, part.tokens);
+      pos += part.tokens;
+      parts.push_back(std::move(part));
+    }
+    // Whatever follows end is never looked at.
+    if (phase == Analyser::Part::END) break;
+    if (phase == Analyser::Part::BEGIN) phase = Analyser::Part::CONSTANT;
+  }
+
+  // The old parts past where the analysis stopped are kept, since they may
+  // line up again after the next edit or once it is no longer cancelled.
+  while (i < _parts.size() && old < pos) old += _parts[i++].tokens;
+  auto rest = i < _parts.size() ? old : _token_count;
+  if (rest > pos) {
+    Part gap;
+    gap.tokens = rest - pos;
+    parts.push_back(std::move(gap));
+  }
+  std::move(_parts.begin() + static_cast<std::ptrdiff_t>(i), _parts.end(),
+            std::back_inserter(parts));
+  _parts = std::move(parts);
+  if (cancelled) return false;
+  _analysed = !err.has_value();
+  return true;
+}
+
+std::vector<Instruction> IncrementalAnalyser::Instructions() const {
+  std::vector<Instruction> code;
+  if (!_analysed) return code;
+  for (auto& part : _parts) {
+    code.insert(code.end(), part.code.begin(), part.code.end());
+    if (part.kind == Analyser::Part::END) break;
+  }
+  return code;
+}
+
+void IncrementalAnalyser::lex(Line& line) {
+  Tokenizer tkz(SourceBuffer(line.text));
+  auto p = tkz.AllTokens();
+  line.tokens = std::move(p.first);
+  line.error = p.second;
+  _stats.lexed_lines++;
+}
+
+void IncrementalAnalyser::replaceLines(std::size_t first, std::size_t last,
+                                       std::vector<Line> lines) {
+  Interner::Scope scope(*_interner);
+  uint64_t start = 0, removed = 0, added = 0;
+  for (std::size_t i = 0; i < first; i++) start += _lines[i].tokens.size();
+  for (std::size_t i = first; i < last; i++) {
+    removed += _lines[i].tokens.size();
+    if (_lines[i].error.has_value()) _error_lines--;
+  }
+  for (auto& line : lines) {
+    lex(line);
+    added += line.tokens.size();
+    if (line.error.has_value()) _error_lines++;
+  }
+  _lines.erase(_lines.begin() + static_cast<std::ptrdiff_t>(first),
+               _lines.begin() + static_cast<std::ptrdiff_t>(last));
+  _lines.insert(_lines.begin() + static_cast<std::ptrdiff_t>(first),
+                std::make_move_iterator(lines.begin()),
+                std::make_move_iterator(lines.end()));
+  _token_count = _token_count - removed + added;
+  _analysed = false;
+
+  // The parts [i, j) overlap the tokens that were replaced, or have the new
+  // ones inserted into their middle. They become a single dirty part.
+  std::size_t i = 0;
+  uint64_t offset = 0;
+  while (i < _parts.size() && offset + _parts[i].tokens <= start)
+    offset += _parts[i++].tokens;
+  auto j = i;
+  auto covered = offset;
+  while (j < _parts.size() && covered < start + removed)
+    covered += _parts[j++].tokens;
+  Part dirty;
+  dirty.tokens = covered - offset - removed + added;
+  if (i > 0 && _parts[i - 1].dirty) dirty.tokens += _parts[--i].tokens;
+  if (j < _parts.size() && _parts[j].dirty) dirty.tokens += _parts[j++].tokens;
+  _parts.erase(_parts.begin() + static_cast<std::ptrdiff_t>(i),
+               _parts.begin() + static_cast<std::ptrdiff_t>(j));
+  if (dirty.tokens != 0)
+    _parts.insert(_parts.begin() + static_cast<std::ptrdiff_t>(i),
+                  std::move(dirty));
+
+  // Every identifier typed along the way stays in the interner. There are
+  // never more live strings than tokens, so once the interner is twice as
+  // big most of it is garbage, and relexing is paid for by the edits that
+  // made it.
+  if (_interner->Size() > std::max<uint64_t>(MIN_COMPACTED, 2 * _token_count))
+    compact();
+}
+
+void IncrementalAnalyser::compact() {
+  auto fresh = std::make_unique<Interner>();
+  {
+    Interner::Scope scope(*fresh);
+    for (auto& line : _lines) lex(line);
+  }
+  _interner = std::move(fresh);
+  _stats.compactions++;
+  // The symbols the parts remember are numbered by the old interner.
+  _parts.clear();
+  if (_token_count != 0) {
+    Part dirty;
+    dirty.tokens = _token_count;
+    _parts.push_back(std::move(dirty));
+  }
+  _analysed = false;
+}
+
+void IncrementalAnalyser::advance(Cursor& cursor, uint64_t n) const {
+  while (true) {
+    while (cursor.line < _lines.size() &&
+           cursor.index == _lines[cursor.line].tokens.size()) {
+      cursor.line++;
+      cursor.index = 0;
+    }
+    if (n == 0 || cursor.line == _lines.size()) return;
+    auto step = std::min<uint64_t>(
+        n, _lines[cursor.line].tokens.size() - cursor.index);
+    cursor.index += static_cast<std::size_t>(step);
+    n -= step;
+  }
+}
+
+std::pair<std::uint64_t, std::uint64_t> IncrementalAnalyser::endBefore(
+    Cursor cursor) const {
+  while (cursor.index == 0) {
+    if (cursor.line == 0) return {0, 0};
+    cursor.line--;
+    cursor.index = _lines[cursor.line].tokens.size();
+  }
+  return _lines[cursor.line]
+      .tokens[cursor.index - 1]
+      .MovedDown(cursor.line)
+      .GetEndPos();
+}
+
+std::optional<CompilationError> IncrementalAnalyser::analysePart(
+    Cursor cursor, uint64_t pos, SymbolTable& symbols, Analyser::Part& phase,
+    Part& part) {
+  // A part only ever changes the symbol it declares, which is its second
+  // token, or the one it assigns to, which is its first.
+  std::vector<std::pair<Symbol, SymbolTable::Entry>> targets;
+  PartStream peek(_lines, cursor);
+  for (int k = 0; k < 2; k++) {
+    auto token = peek.Next();
+    if (!token.has_value()) break;
+    if (token.value().GetType() != TokenType::IDENTIFIER) continue;
+    auto sym = token.value().GetSymbol().value();
+    targets.emplace_back(sym, symbols.Find(sym));
+  }
+
+  // The position is only used when there is no token left to read.
+  PartStream stream(_lines, cursor);
+  Analyser analyser(stream, symbols,
+                    pos == _token_count ? endBefore(cursor)
+                                        : std::make_pair(uint64_t(0),
+                                                         uint64_t(0)));
+  auto result = analyser.AnalysePart(phase);
+  _stats.analysed_parts++;
+  if (result.second.has_value()) return result.second;
+
+  part.tokens = analyser.Consumed();
+  part.dirty = false;
+  part.kind = phase;
+  part.code = std::move(result.first);
+  PartStream tokens(_lines, cursor);
+  for (uint64_t k = 0; k < part.tokens; k++) {
+    auto token = tokens.Next().value();
+    if (token.GetType() != TokenType::IDENTIFIER) continue;
+    auto sym = token.GetSymbol().value();
+    auto entry = symbols.Find(sym);
+    for (auto& target : targets)
+      if (target.first == sym) entry = target.second;
+    part.reads.emplace_back(sym, entry);
+  }
+  for (auto& target : targets) {
+    auto entry = symbols.Find(target.first);
+    if (entry.kind != target.second.kind)
+      part.effect = std::make_pair(target.first, entry);
+  }
+  return {};
+}
+}  // namespace miniplc0
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "analyser/symbol_table.h"
+#include "error/error.h"
+#include "instruction/instruction.h"
+#include "tokenizer/interner.h"
+#include "tokenizer/token.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 可以编辑的源码，每次编辑之后只重新分析受影响的部分，给编辑器用
+//
+// 源码按行保存，每一行单独做词法分析，token 都不会跨行，所以一次编辑只需要
+// 重新分析被改动的那几行，其他行的 token 原样保留。
+// 语法分析按 Analyser::Part 把 token 分成一个个部分，记住每个部分用了多少
+// token、生成的指令、读到的符号的样子以及它声明或者初始化的符号。
+// 重新分析时，没有被改动的部分只要前面的部分留下的符号表在它用到的那些符号上
+// 没有变化，就直接沿用上一次的结果；从被改动的地方开始重新分析，直到又回到
+// 某个旧的部分的开头为止。
+// 结果和对整个源码先用 Tokenizer::AllTokens 再用 Analyser::Analyse 完全一样。
+// token 的字符串放在自己的 Interner 里，编辑时被删掉的标识符占了大半的时候
+// 就换一个新的，全部重新做词法分析，所以一直编辑下去内存也不会一直涨。
+class IncrementalAnalyser final {
+ private:
+  using uint64_t = std::uint64_t;
+
+ public:
+  // 累计做了多少工作
+  struct Stats {
+    // 做了词法分析的行
+    uint64_t lexed_lines = 0;
+    // 重新分析的部分
+    uint64_t analysed_parts = 0;
+    // 沿用了上一次结果的部分
+    uint64_t reused_parts = 0;
+    // 换新的 Interner 的次数
+    uint64_t compactions = 0;
+  };
+
+ public:
+  explicit IncrementalAnalyser(std::string_view text = {});
+  IncrementalAnalyser(const IncrementalAnalyser&) = delete;
+  IncrementalAnalyser& operator=(IncrementalAnalyser) = delete;
+
+  // 把 [start, end) 之间的内容换成 text，位置是从 0 开始的 (行, 列)，
+  // 列按字节计算；超出一行的列算作行尾，超出整个源码的位置算作末尾
+  void Edit(std::pair<uint64_t, uint64_t> start,
+            std::pair<uint64_t, uint64_t> end, std::string_view text);
+  // 换掉全部内容
+  void Replace(std::string_view text);
+
+  std::string Text() const;
+  uint64_t LineCount() const { return _lines.size(); }
+  // 第 line 行的内容，不包括换行
+  std::string_view LineText(uint64_t line) const {
+    return _lines[static_cast<std::size_t>(line)].text;
+  }
+
+  // 第一个词法错误，不需要先调用 Analyse()
+  std::optional<CompilationError> LexicalError() const;
+  // 分析当前的源码，返回第一个错误
+  // 和 compiler 一样，任何地方有词法错误时报告的都是词法错误
+  std::optional<CompilationError> Analyse();
+  // 每分析完一个部分都看一眼 cancel，它变成真时放弃这一次分析并返回 false，
+  // 已经分析好的部分下一次还会沿用；没有放弃时 err 就是 Analyse() 的结果
+  bool Analyse(const std::atomic<bool>& cancel,
+               std::optional<CompilationError>& err);
+  // 上一次 Analyse() 没有错误时整个程序的指令，否则为空
+  std::vector<Instruction> Instructions() const;
+
+  Stats GetStats() const { return _stats; }
+
+ private:
+  struct Line {
+    std::string text;
+    // 行号都是 0，用的时候再挪到这一行
+    std::vector<Token> tokens;
+    // 这一行的词法错误，行号也是 0
+    std::optional<CompilationError> error;
+  };
+
+  // 上一次语法分析的一个部分，所有的部分依次覆盖全部 token
+  struct Part {
+    uint64_t tokens = 0;
+    // 里面的 token 在分析之后被改动过，或者从来没有分析过
+    bool dirty = true;
+    Analyser::Part kind = Analyser::Part::BEGIN;
+    std::vector<Instruction> code;
+    // 用到的符号在分析之前的样子
+    std::vector<std::pair<Symbol, SymbolTable::Entry>> reads;
+    // 声明或者初始化的符号在分析之后的样子
+    std::optional<std::pair<Symbol, SymbolTable::Entry>> effect;
+  };
+
+  // 第 line 行的第 index 个 token
+  struct Cursor {
+    std::size_t line = 0;
+    std::size_t index = 0;
+  };
+  class PartStream;
+
+  void lex(Line& line);
+  // 换一个新的 Interner，所有的行重新做词法分析，所有的部分都要重新分析
+  void compact();
+  // 把 _lines 的 [first, last) 换成 lines，并重新划分受影响的部分
+  void replaceLines(std::size_t first, std::size_t last,
+                    std::vector<Line> lines);
+  // 跳过没有 token 的行，然后往后挪 n 个 token
+  void advance(Cursor& cursor, uint64_t n) const;
+  // cursor 之前的最后一个 token 的结束位置，没有的时候是 (0, 0)
+  std::pair<uint64_t, uint64_t> endBefore(Cursor cursor) const;
+  // 在 pos 处从头分析一个部分
+  std::optional<CompilationError> analysePart(Cursor cursor, uint64_t pos,
+                                              SymbolTable& symbols,
+                                              Analyser::Part& phase,
+                                              Part& part);
+
+ private:
+  // 所有的 token 里的字符串
+  std::unique_ptr<Interner> _interner;
+  std::vector<Line> _lines;
+  uint64_t _token_count;
+  // 有词法错误的行数
+  std::size_t _error_lines;
+  std::vector<Part> _parts;
+  bool _analysed;
+  Stats _stats;
+};
+}  // namespace miniplc0
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "error/error.h"
+#include "tokenizer/interner.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace miniplc0 {
+
+// 语法分析用的符号表
+//
+// 以标识符在 Interner 中的编号为下标的一个数组，每一项记录符号的种类和
+// 它在栈上的偏移，所以每次查找都只是一次数组访问。
+// 数组的长度是用到的最大的编号，所以编号要是这一次编译自己的：Compile 和
+// IncrementalAnalyser 都用自己的 Interner，只有直接用 Analyser 时才会用到
+// 整个程序共用的 Global()。
+class SymbolTable final {
+ private:
+  using int32_t = std::int32_t;
+
+ public:
+  // 符号的种类
+  // 变量                     示例
+  // UNINITIALIZED_VARIABLE   var a;
+  // VARIABLE                 var a=1;
+  // CONSTANT                 const a=1;
+  enum Kind : std::uint8_t {
+    UNDECLARED,
+    CONSTANT,
+    UNINITIALIZED_VARIABLE,
+    VARIABLE
+  };
+
+  struct Entry {
+    Kind kind;
+    // 在栈上的偏移，只有声明过的符号才有意义
+    int32_t index;
+  };
+
+ public:
+  SymbolTable() : _entries(), _next_index(0) {}
+
+  // 查找一个符号，没有声明过的符号得到 kind 为 UNDECLARED 的项
+  Entry Find(Symbol sym) const {
+    if (sym >= _entries.size()) return Entry{UNDECLARED, 0};
+    return _entries[sym];
+  }
+
+  // 声明一个符号并在栈上为它分配下一个位置，返回这个位置
+  int32_t Declare(Symbol sym, Kind kind) {
+    if (kind == UNDECLARED) DieAndPrint("declaring a symbol as undeclared");
+    if (sym >= _entries.size())
+      _entries.resize(static_cast<std::size_t>(sym) + 1,
+                      Entry{UNDECLARED, 0});
+    auto& entry = _entries[sym];
+    if (entry.kind != UNDECLARED) DieAndPrint("symbol declared twice");
+    entry = Entry{kind, _next_index};
+    return _next_index++;
+  }
+
+  // 把一个没有初始化过的变量标记为已经初始化
+  void MakeInitialized(Symbol sym) {
+    if (sym >= _entries.size() || _entries[sym].kind != UNINITIALIZED_VARIABLE)
+      DieAndPrint("Variable not found in uninitialized area. bad bad");
+    _entries[sym].kind = VARIABLE;
+  }
+
+  // 已经分配的栈上位置的个数
+  int32_t SlotCount() const { return _next_index; }
+
+ private:
+  std::vector<Entry> _entries;
+  int32_t _next_index;
+};
+}  // namespace miniplc0
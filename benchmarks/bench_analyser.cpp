@@ -0,0 +1,163 @@
+#include "analyser/analyser.h"
+#include "analyser/incremental.h"
+#include "analyser/symbol_table.h"
+#include "ir/passes.h"
+#include "tokenizer/token_stream.h"
+#include "tokenizer/tokenizer.h"
+
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmarks/programs.hpp"
+#include "catch2/catch.hpp"
+
+namespace {
+// The symbol table layout the analyser used before SymbolTable: three
+// std::map keyed by name, probed one after another.
+struct ThreeMapTable {
+  std::map<std::string, int32_t> uninitialized_vars, vars, consts;
+
+  bool isDeclared(const std::string& s) const {
+    return consts.find(s) != consts.end() ||
+           uninitialized_vars.find(s) != uninitialized_vars.end() ||
+           vars.find(s) != vars.end();
+  }
+  int32_t getIndex(const std::string& s) {
+    if (uninitialized_vars.find(s) != uninitialized_vars.end())
+      return uninitialized_vars[s];
+    else if (vars.find(s) != vars.end())
+      return vars[s];
+    else
+      return consts[s];
+  }
+};
+}  // namespace
+
+TEST_CASE("Symbol table lookups with 20k declarations") {
+  const std::size_t n = 20000;
+  std::vector<std::string> names;
+  std::vector<miniplc0::Symbol> symbols;
+  for (std::size_t i = 0; i < n; i++) {
+    names.emplace_back("name" + std::to_string(i));
+    symbols.emplace_back(
+        miniplc0::Interner::Global().Intern(names.back()).first);
+  }
+
+  ThreeMapTable maps;
+  miniplc0::SymbolTable table;
+  for (std::size_t i = 0; i < n; i++) {
+    auto kind = i % 3 == 0   ? miniplc0::SymbolTable::CONSTANT
+                : i % 3 == 1 ? miniplc0::SymbolTable::VARIABLE
+                             : miniplc0::SymbolTable::UNINITIALIZED_VARIABLE;
+    auto index = table.Declare(symbols[i], kind);
+    if (i % 3 == 0)
+      maps.consts[names[i]] = index;
+    else if (i % 3 == 1)
+      maps.vars[names[i]] = index;
+    else
+      maps.uninitialized_vars[names[i]] = index;
+  }
+
+  BENCHMARK("three std::map tables, string keys") {
+    int64_t sum = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      auto& name = names[(i * 7919) % n];
+      if (maps.isDeclared(name)) sum += maps.getIndex(name);
+    }
+    return sum;
+  };
+
+  BENCHMARK("SymbolTable, interned symbols") {
+    int64_t sum = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      auto entry = table.Find(symbols[(i * 7919) % n]);
+      if (entry.kind != miniplc0::SymbolTable::UNDECLARED) sum += entry.index;
+    }
+    return sum;
+  };
+}
+
+TEST_CASE("Analysing programs with 10k+ declarations") {
+  for (std::size_t n : {5000, 20000}) {
+    auto source = miniplc0::bench::DeclarationHeavyProgram(n);
+    std::stringstream ss(source);
+    miniplc0::Tokenizer tkz(ss);
+    auto tokens = tkz.AllTokens();
+    REQUIRE_FALSE(tokens.second.has_value());
+
+    BENCHMARK("analyse " + std::to_string(2 * n) + " declarations") {
+      miniplc0::Analyser analyser(tokens.first);
+      return analyser.Analyse();
+    };
+  }
+}
+
+TEST_CASE("Lexing and analysing in one pass") {
+  auto source = miniplc0::bench::DeclarationHeavyProgram(20000);
+
+  BENCHMARK("all tokens, then analyse") {
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    miniplc0::Analyser analyser(tkz.AllTokens().first);
+    return analyser.Analyse();
+  };
+  BENCHMARK("analyse while lexing") {
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    miniplc0::TokenizerStream stream(tkz);
+    miniplc0::Analyser analyser(stream);
+    return analyser.Analyse();
+  };
+}
+
+TEST_CASE("Analysing again after a one-statement edit") {
+  auto source = miniplc0::bench::DeclarationHeavyProgram(20000);
+  miniplc0::IncrementalAnalyser doc(source);
+  REQUIRE_FALSE(doc.Analyse().has_value());
+  // A statement about halfway through the assignments.
+  std::uint64_t line = 1 + 20000 + 20000 + 10000;
+
+  BENCHMARK("all tokens, then analyse") {
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    miniplc0::Analyser analyser(tkz.AllTokens().first);
+    return analyser.Analyse();
+  };
+  // Each run either inserts an empty statement or takes it out again.
+  bool inserted = false;
+  BENCHMARK("edit, then analyse incrementally") {
+    if (inserted)
+      doc.Edit({line, 0}, {line, 1}, "");
+    else
+      doc.Edit({line, 0}, {line, 0}, ";");
+    inserted = !inserted;
+    return doc.Analyse();
+  };
+}
+
+TEST_CASE("Compiling at each optimization level") {
+  auto source = miniplc0::bench::ArithmeticProgram(64, 20000);
+  std::stringstream ss(source);
+  miniplc0::Tokenizer tkz(ss);
+  auto tokens = tkz.AllTokens();
+  REQUIRE_FALSE(tokens.second.has_value());
+
+  BENCHMARK("-O0, direct emission") {
+    miniplc0::Analyser analyser(tokens.first);
+    return analyser.Analyse();
+  };
+  for (int level = 0; level <= 2; level++) {
+    miniplc0::Analyser analyser(tokens.first);
+    auto ir = analyser.AnalyseToIR();
+    REQUIRE_FALSE(ir.second.has_value());
+    miniplc0::ir::PassManager::ForLevel(level).Run(ir.first);
+    auto size = ir.first.Lower().size();
+    BENCHMARK("-O" + std::to_string(level) + " through IR, " +
+              std::to_string(size) + " instructions") {
+      miniplc0::Analyser analyser(tokens.first);
+      auto ir = analyser.AnalyseToIR();
+      miniplc0::ir::PassManager::ForLevel(level).Run(ir.first);
+      return ir.first.Lower();
+    };
+  }
+}
@@ -0,0 +1,58 @@
+#include "tokenizer/keywords.h"
+#include "tokenizer/tokenizer.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace {
+// How nextToken used to tell keywords from identifiers.
+miniplc0::TokenType compareChain(std::string_view s) {
+  if (s == "begin")
+    return miniplc0::TokenType::BEGIN;
+  else if (s == "end")
+    return miniplc0::TokenType::END;
+  else if (s == "var")
+    return miniplc0::TokenType::VAR;
+  else if (s == "const")
+    return miniplc0::TokenType::CONST;
+  else if (s == "print")
+    return miniplc0::TokenType::PRINT;
+  return miniplc0::TokenType::IDENTIFIER;
+}
+}  // namespace
+
+TEST_CASE("Keyword classification") {
+  // Mostly identifiers, a few of them sharing a length or a prefix with a
+  // keyword, and a keyword now and then.
+  std::vector<std::string> words;
+  const char* seeds[] = {"x",     "count", "begin", "ending", "value",
+                         "var",   "pr",    "print", "consts", "i",
+                         "total", "end",   "const", "beg",    "v1"};
+  for (int i = 0; i < 100000; i++)
+    words.emplace_back(std::string(seeds[i % 15]) +
+                       (i % 4 == 0 ? "" : std::to_string(i % 7)));
+  std::vector<std::string_view> views(words.begin(), words.end());
+
+  BENCHMARK("compare chain") {
+    int keywords = 0;
+    for (auto w : views)
+      keywords += compareChain(w) != miniplc0::TokenType::IDENTIFIER;
+    return keywords;
+  };
+  BENCHMARK("perfect hash") {
+    int keywords = 0;
+    for (auto w : views)
+      keywords += miniplc0::ClassifyWord(w) != miniplc0::TokenType::IDENTIFIER;
+    return keywords;
+  };
+
+  std::string source;
+  for (auto& w : words) source += w + " ";
+  BENCHMARK("tokenize 100k words") {
+    miniplc0::Tokenizer lexer{miniplc0::SourceBuffer(source)};
+    return lexer.AllTokens().first.size();
+  };
+}
@@ -0,0 +1,76 @@
+#include "driver/compiler.h"
+#include "driver/server.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace {
+namespace fs = std::filesystem;
+
+// The size of program the server is meant for, where starting a process
+// costs more than compiling it.
+const char* const PROGRAM =
+    "begin\n"
+    "  const limit = 100;\n"
+    "  var a = 1; var b = 2; var c;\n"
+    "  c = a * limit + b;\n"
+    "  a = (c - b) / 3;\n"
+    "  print(a); print(b); print(c);\n"
+    "end\n";
+}  // namespace
+
+TEST_CASE("Compiling small programs in-process, on a server and per process") {
+  auto path = (fs::temp_directory_path() / "miniplc0_bench.sock").string();
+  miniplc0::CompileServer server(path, 4);
+  REQUIRE_FALSE(server.Bad());
+  std::thread serving([&]() { server.Serve(); });
+
+  miniplc0::CompileOptions options;
+  options.action = miniplc0::Action::ANALYSE;
+  miniplc0::CompileClient client(path);
+  REQUIRE(client.Compile(PROGRAM, options).has_value());
+
+  BENCHMARK("in-process Compile") {
+    std::ostringstream out, err;
+    return miniplc0::Compile(miniplc0::SourceBuffer(PROGRAM), options, out,
+                             err);
+  };
+  BENCHMARK("one request on an open connection") {
+    return client.Compile(PROGRAM, options);
+  };
+  BENCHMARK("connecting, then one request") {
+    miniplc0::CompileClient once(path);
+    return once.Compile(PROGRAM, options);
+  };
+  // The load generator: every client sends its requests back to back.
+  for (int clients : {1, 4, 16}) {
+    BENCHMARK(std::to_string(clients) + " clients, 100 requests each") {
+      std::vector<std::thread> threads;
+      for (int c = 0; c < clients; c++)
+        threads.emplace_back([&]() {
+          miniplc0::CompileClient load(path);
+          for (int i = 0; i < 100; i++) load.Compile(PROGRAM, options);
+        });
+      for (auto& t : threads) t.join();
+    };
+  }
+
+  auto source = fs::temp_directory_path() / "miniplc0_bench_small.txt";
+  std::ofstream(source) << PROGRAM;
+  auto listing = fs::temp_directory_path() / "miniplc0_bench.out";
+  auto command = std::string(MINIPLC0_EXE) + " -l " + source.string() +
+                 " > " + listing.string();
+  BENCHMARK("a new process per compilation") {
+    return std::system(command.c_str());
+  };
+
+  server.Stop();
+  serving.join();
+}
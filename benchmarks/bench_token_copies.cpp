@@ -0,0 +1,63 @@
+#include "analyser/analyser.h"
+#include "tokenizer/token_stream.h"
+#include "tokenizer/tokenizer.h"
+
+#include <string>
+
+#include "benchmarks/programs.hpp"
+#include "catch2/catch.hpp"
+#include "fmt/core.h"
+
+// Built against a copy of the library with MINIPLC0_COUNT_TOKEN_COPIES, so
+// every copy of a Token bumps Token::CopyCount().
+
+namespace {
+std::size_t countTokens(const std::string& source) {
+  miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+  std::size_t n = 0;
+  while (!tkz.NextToken().second.has_value()) n++;
+  return n;
+}
+
+void report(const char* what, std::size_t tokens, std::uint64_t copies) {
+  fmt::print("{:<28} {:>9} tokens {:>10} copies {:>6.2f} per token\n", what,
+             tokens, copies, static_cast<double>(copies) / tokens);
+}
+}  // namespace
+
+TEST_CASE("Token copies per source token") {
+  auto source = miniplc0::bench::DeclarationHeavyProgram(20000);
+  auto tokens = countTokens(source);
+
+  {
+    auto before = miniplc0::Token::CopyCount();
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    auto lexed = tkz.NextToken();
+    while (!lexed.second.has_value()) lexed = tkz.NextToken();
+    report("lexing only", tokens, miniplc0::Token::CopyCount() - before);
+  }
+  {
+    auto before = miniplc0::Token::CopyCount();
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    miniplc0::Analyser analyser(tkz.AllTokens().first);
+    REQUIRE_FALSE(analyser.Analyse().second.has_value());
+    report("all tokens, then analyse", tokens,
+           miniplc0::Token::CopyCount() - before);
+  }
+  {
+    auto before = miniplc0::Token::CopyCount();
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    miniplc0::TokenizerStream stream(tkz);
+    miniplc0::Analyser analyser(stream);
+    REQUIRE_FALSE(analyser.Analyse().second.has_value());
+    report("analyse while lexing", tokens,
+           miniplc0::Token::CopyCount() - before);
+  }
+
+  BENCHMARK("analyse while lexing, counting copies") {
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    miniplc0::TokenizerStream stream(tkz);
+    miniplc0::Analyser analyser(stream);
+    return analyser.Analyse();
+  };
+}
@@ -0,0 +1,35 @@
+#include "tokenizer/scanner.h"
+#include "tokenizer/tokenizer.h"
+
+#include <string>
+
+#include "benchmarks/programs.hpp"
+#include "catch2/catch.hpp"
+
+TEST_CASE("Tokenizing with each scan engine") {
+  auto program = miniplc0::bench::DeclarationHeavyProgram(20000);
+  // Long runs are where the vector loops pay off: indented code with long
+  // names and numbers.
+  std::string wide;
+  for (int i = 0; i < 20000; i++)
+    wide += "                var aratherlongvariablename" +
+            std::to_string(i) + " = 1234567890;\n";
+  wide.insert(0, "begin\n");
+  wide += "end\n";
+
+  for (auto engine : {miniplc0::ScanEngine::SCALAR, miniplc0::ScanEngine::SSE2,
+                      miniplc0::ScanEngine::AVX2}) {
+    if (!miniplc0::Scanner::IsSupported(engine)) continue;
+    auto name = std::string(miniplc0::ScanEngineName(engine));
+    BENCHMARK("declarations, " + name) {
+      miniplc0::Tokenizer lexer{miniplc0::SourceBuffer(program)};
+      lexer.UseScanEngine(engine);
+      return lexer.AllTokens().first.size();
+    };
+    BENCHMARK("long runs, " + name) {
+      miniplc0::Tokenizer lexer{miniplc0::SourceBuffer(wide)};
+      lexer.UseScanEngine(engine);
+      return lexer.AllTokens().first.size();
+    };
+  }
+}
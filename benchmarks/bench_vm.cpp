@@ -0,0 +1,209 @@
+#include "analyser/analyser.h"
+#include "codegen/binary.h"
+#include "ir/passes.h"
+#include "tokenizer/tokenizer.h"
+#include "vm/fusion.h"
+#include "vm/jit.h"
+#include "vm/register_vm.h"
+#include "vm/vm.h"
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "benchmarks/programs.hpp"
+#include "catch2/catch.hpp"
+#include "tests/simple_vm.hpp"
+
+TEST_CASE("Running compiled programs") {
+  // 64 variables keep the stack well inside the test VM's 2048 slots.
+  auto source = miniplc0::bench::ArithmeticProgram(64, 100000);
+  miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+  miniplc0::Analyser analyser(tkz.AllTokens().first);
+  auto code = analyser.Analyse();
+  REQUIRE_FALSE(code.second.has_value());
+
+  miniplc0::VM reference(code.first);
+  auto expected = reference.Run();
+  miniplc0::VirtualMachine vm(code.first);
+  REQUIRE(vm.Run().first == expected);
+  auto fused = miniplc0::FuseInstructions(code.first);
+  miniplc0::VirtualMachine fused_vm(fused.first);
+  REQUIRE(fused_vm.Run().first == expected);
+  miniplc0::VirtualMachine switch_fused_vm(fused.first,
+                                           miniplc0::VirtualMachine::SWITCH);
+  miniplc0::RegisterMachine register_vm(code.first);
+  REQUIRE(register_vm.Run().first == expected);
+  miniplc0::JitProgram jit(code.first);
+  REQUIRE(jit.Run().first == expected);
+
+  BENCHMARK("test VM (" + std::to_string(code.first.size()) + " instructions)") {
+    miniplc0::VM vm(code.first);
+    return vm.Run();
+  };
+  BENCHMARK("switch dispatch") {
+    miniplc0::VirtualMachine vm(code.first, miniplc0::VirtualMachine::SWITCH);
+    return vm.Run();
+  };
+  BENCHMARK("threaded dispatch") {
+    miniplc0::VirtualMachine vm(code.first);
+    return vm.Run();
+  };
+  BENCHMARK("threaded dispatch, already decoded") {
+    return vm.Run();
+  };
+  BENCHMARK("fusion pass") {
+    return miniplc0::FuseInstructions(code.first);
+  };
+  BENCHMARK("fused threaded (" + std::to_string(fused.first.size()) + ")") {
+    return fused_vm.Run();
+  };
+  BENCHMARK("fused switch, already decoded") {
+    return switch_fused_vm.Run();
+  };
+  BENCHMARK("lowering to registers") {
+    return miniplc0::LowerToRegisters(code.first);
+  };
+  BENCHMARK("register machine (" + std::to_string(register_vm.Size()) +
+            "), already lowered") {
+    return register_vm.Run();
+  };
+  BENCHMARK("JIT compilation") {
+    miniplc0::JitProgram jit(code.first);
+    return jit.CodeSize();
+  };
+  BENCHMARK("native code (" + std::to_string(jit.CodeSize()) +
+            " bytes), already compiled") {
+    return jit.Run();
+  };
+}
+
+TEST_CASE("Running programs with allocated slots") {
+  auto source = miniplc0::bench::DeclarationHeavyProgram(10000);
+  auto compile = [&](bool allocate) {
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    miniplc0::Analyser analyser(tkz.AllTokens().first);
+    auto ir = analyser.AnalyseToIR();
+    REQUIRE_FALSE(ir.second.has_value());
+    if (allocate) miniplc0::ir::MakeSlotAllocation()->Run(ir.first);
+    return std::make_pair(ir.first.Lower(), ir.first.SlotCount());
+  };
+  auto plain = compile(false);
+  auto allocated = compile(true);
+  miniplc0::VirtualMachine plain_vm(plain.first);
+  miniplc0::VirtualMachine allocated_vm(allocated.first);
+  REQUIRE(plain_vm.Run() == allocated_vm.Run());
+
+  BENCHMARK("one slot per declaration (" + std::to_string(plain.second) +
+            ")") {
+    return plain_vm.Run();
+  };
+  BENCHMARK("allocated (" + std::to_string(allocated.second) + ")") {
+    return allocated_vm.Run();
+  };
+}
+
+TEST_CASE("Stack and register machines on the valid analyser corpus") {
+  std::vector<std::vector<miniplc0::Instruction>> programs;
+  for (auto& entry : std::filesystem::directory_iterator(
+           MINIPLC0_SOURCE_DIR "/docs/test_analyser/valid")) {
+    auto source = miniplc0::SourceBuffer::FromFile(entry.path().string());
+    REQUIRE(source.has_value());
+    miniplc0::Tokenizer tkz(std::move(source.value()));
+    miniplc0::Analyser analyser(tkz.AllTokens().first);
+    auto code = analyser.Analyse();
+    REQUIRE_FALSE(code.second.has_value());
+    programs.push_back(std::move(code.first));
+  }
+  REQUIRE_FALSE(programs.empty());
+
+  // Straight-line code: the number of instructions is the number of times
+  // each machine dispatches.
+  std::vector<std::unique_ptr<miniplc0::VirtualMachine>> stack, fused;
+  std::vector<std::unique_ptr<miniplc0::RegisterMachine>> registers;
+  std::size_t stack_size = 0, fused_size = 0, register_size = 0;
+  for (auto& code : programs) {
+    auto f = miniplc0::FuseInstructions(code).first;
+    stack.push_back(std::make_unique<miniplc0::VirtualMachine>(code));
+    fused.push_back(std::make_unique<miniplc0::VirtualMachine>(f));
+    registers.push_back(std::make_unique<miniplc0::RegisterMachine>(code));
+    REQUIRE(registers.back()->Run() == stack.back()->Run());
+    stack_size += code.size();
+    fused_size += f.size();
+    register_size += registers.back()->Size();
+  }
+  auto runAll = [](auto& vms) {
+    std::size_t outputs = 0;
+    for (auto& vm : vms) outputs += vm->Run().first.size();
+    return outputs;
+  };
+
+  BENCHMARK("stack machine (" + std::to_string(stack_size) + " dispatches)") {
+    return runAll(stack);
+  };
+  BENCHMARK("fused stack machine (" + std::to_string(fused_size) + ")") {
+    return runAll(fused);
+  };
+  BENCHMARK("register machine (" + std::to_string(register_size) + ")") {
+    return runAll(registers);
+  };
+}
+
+TEST_CASE("Native code and the interpreters on a program that stays cached") {
+  // Straight-line native code is only fetched once per run, so unlike the
+  // interpreters it pays for every byte of a large program each time.
+  auto source = miniplc0::bench::ArithmeticProgram(64, 2000);
+  miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+  miniplc0::Analyser analyser(tkz.AllTokens().first);
+  auto code = analyser.Analyse();
+  REQUIRE_FALSE(code.second.has_value());
+  auto fused = miniplc0::FuseInstructions(code.first);
+  miniplc0::VirtualMachine fused_vm(fused.first);
+  miniplc0::RegisterMachine register_vm(code.first);
+  miniplc0::JitProgram jit(code.first);
+  auto expected = fused_vm.Run();
+  REQUIRE(register_vm.Run() == expected);
+  REQUIRE(jit.Run() == expected);
+
+  BENCHMARK("fused threaded (" + std::to_string(fused.first.size()) + ")") {
+    return fused_vm.Run();
+  };
+  BENCHMARK("register machine (" + std::to_string(register_vm.Size()) + ")") {
+    return register_vm.Run();
+  };
+  BENCHMARK("native code (" + std::to_string(jit.CodeSize()) + " bytes)") {
+    return jit.Run();
+  };
+}
+
+TEST_CASE("Loading compiled programs instead of compiling them") {
+  auto source = miniplc0::bench::ArithmeticProgram(64, 100000);
+  auto compile = [&]() {
+    miniplc0::Tokenizer tkz{miniplc0::SourceBuffer(source)};
+    miniplc0::Analyser analyser(tkz.AllTokens().first);
+    return analyser.Analyse().first;
+  };
+  auto code = compile();
+  auto path = std::filesystem::temp_directory_path() / "miniplc0_bench.bin";
+  {
+    std::ofstream out(path, std::ios::out | std::ios::binary);
+    miniplc0::EmitBinary(code, out);
+  }
+  auto load = [&]() {
+    auto file = miniplc0::SourceBuffer::FromFile(path.string());
+    return miniplc0::DecodeBinary(file.value().View()).value();
+  };
+  REQUIRE(load() == code);
+
+  BENCHMARK("compiling the source (" + std::to_string(source.size()) +
+            " bytes)") {
+    return compile();
+  };
+  BENCHMARK("mapping and decoding the binary (" +
+            std::to_string(std::filesystem::file_size(path)) + " bytes)") {
+    return load();
+  };
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace miniplc0::bench {
+// 生成一个有 n 个常量、n 个变量声明和 n 条赋值、输出语句的程序
+// 每条语句都引用好几个前面声明过的标识符，用来给符号表和词法分析施压
+inline std::string DeclarationHeavyProgram(std::size_t n) {
+  std::string s = "begin\n";
+  for (std::size_t i = 0; i < n; i++)
+    s += "const c" + std::to_string(i) + " = " + std::to_string(i % 100) +
+         ";\n";
+  for (std::size_t i = 0; i < n; i++) {
+    s += "var v" + std::to_string(i);
+    if (i % 2 == 0)
+      s += " = c" + std::to_string(i) + " + c" + std::to_string(i / 2);
+    s += ";\n";
+  }
+  for (std::size_t i = 0; i < n; i++) {
+    auto a = std::to_string(i), b = std::to_string((i * 7) % n),
+         c = std::to_string((i * 13) % n);
+    s += "v" + a + " = c" + b + " * (c" + c + " - " + std::to_string(i % 10) +
+         ") + c" + a + ";\n";
+    if (i % 16 == 0) s += "print(v" + a + " / (c" + b + " + 1));\n";
+  }
+  s += "end\n";
+  return s;
+}
+
+// 生成一个有 vars 个变量、statements 条赋值语句的程序，每 8 条语句输出一次
+// 每条语句的结果都向 0 收缩，所以不管有多少条语句都不会溢出
+inline std::string ArithmeticProgram(std::size_t vars,
+                                     std::size_t statements) {
+  std::string s = "begin\n";
+  for (std::size_t i = 0; i < vars; i++)
+    s += "var v" + std::to_string(i) + " = " + std::to_string(i * 37 % 101) +
+         ";\n";
+  auto v = [&](std::size_t i) { return "v" + std::to_string(i % vars); };
+  for (std::size_t i = 0; i < statements; i++) {
+    s += v(i) + " = (" + v(i * 7 + 1) + " + " + v(i * 3 + 2) + " + " +
+         v(i * 5 + 3) + ") / 4 + " + std::to_string(i % 10) + " * 3 - " +
+         v(i + 4) + " / 5;\n";
+    if (i % 8 == 0) s += "print(" + v(i) + ");\n";
+  }
+  s += "end\n";
+  return s;
+}
+}  // namespace miniplc0::bench
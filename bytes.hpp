@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+
+namespace miniplc0 {
+
+namespace detail {
+// 二进制程序、编译服务器的协议和编译缓存里的整数都是小端
+// 把 u 的低 bytes 个字节接在 s 后面
+inline void PutLittle(std::string& s, std::uint32_t u, int bytes = 4) {
+  for (int i = 0; i < bytes; i++) s += static_cast<char>(u >> (8 * i));
+}
+
+// 读出 p 开始的 bytes 个字节，调用者保证它们都在
+inline std::uint32_t GetLittle(const char* p, int bytes = 4) {
+  std::uint32_t u = 0;
+  for (int i = 0; i < bytes; i++)
+    u |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i]))
+         << (8 * i);
+  return u;
+}
+
+// 整个文件的内容，打不开时返回空
+inline std::optional<std::string> ReadFile(const std::filesystem::path& path) {
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in) return {};
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+}  // namespace detail
+}  // namespace miniplc0
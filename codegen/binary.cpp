@@ -0,0 +1,187 @@
+#include "codegen/binary.h"
+
+#include "bytes.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+namespace miniplc0 {
+
+namespace {
+using int32_t = std::int32_t;
+using uint8_t = std::uint8_t;
+using uint32_t = std::uint32_t;
+
+constexpr int32_t OPERATION_COUNT = Operation::DIVSTO + 1;
+constexpr uint8_t MODE_ZERO = 0;
+constexpr uint8_t MODE_VALUE = 1;
+constexpr uint8_t MODE_CONSTANT = 2;
+constexpr int MODE_SHIFT = 5;
+
+inline uint32_t zigzag(int32_t v) {
+  auto u = static_cast<uint32_t>(v);
+  return (u << 1) ^ (v < 0 ? 0xffffffffu : 0u);
+}
+
+inline int32_t unzigzag(uint32_t u) {
+  return static_cast<int32_t>((u >> 1) ^ (0u - (u & 1)));
+}
+
+inline std::size_t varintSize(uint32_t u) {
+  std::size_t n = 1;
+  while (u >= 0x80) {
+    u >>= 7;
+    n++;
+  }
+  return n;
+}
+
+void putVarint(std::string& s, uint32_t u) {
+  while (u >= 0x80) {
+    s += static_cast<char>((u & 0x7f) | 0x80);
+    u >>= 7;
+  }
+  s += static_cast<char>(u);
+}
+
+// Reads the bytes in place and remembers whether it ever ran past the end
+// or saw something malformed, so that callers only check once.
+class Reader final {
+ public:
+  explicit Reader(std::string_view bytes)
+      : _p(reinterpret_cast<const uint8_t*>(bytes.data())),
+        _end(_p + bytes.size()),
+        _bad(false) {}
+
+  bool Bad() const { return _bad; }
+  std::size_t Left() const { return static_cast<std::size_t>(_end - _p); }
+
+  uint8_t Byte() {
+    if (_p == _end) {
+      _bad = true;
+      return 0;
+    }
+    return *_p++;
+  }
+  uint32_t Little(int bytes) {
+    if (Left() < static_cast<std::size_t>(bytes)) {
+      _p = _end;
+      _bad = true;
+      return 0;
+    }
+    auto u = detail::GetLittle(reinterpret_cast<const char*>(_p), bytes);
+    _p += bytes;
+    return u;
+  }
+  // At most five bytes, and the fifth may only hold the top four bits.
+  uint32_t Varint() {
+    uint32_t u = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      auto b = Byte();
+      if (shift == 28 && b > 0x0f) break;
+      u |= static_cast<uint32_t>(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) return u;
+    }
+    _bad = true;
+    return 0;
+  }
+
+ private:
+  const uint8_t* _p;
+  const uint8_t* _end;
+  bool _bad;
+};
+}  // namespace
+
+void EmitBinary(const std::vector<Instruction>& v, std::ostream& out) {
+  // A literal earns a place in the pool when it takes at least three bytes
+  // and shows up more than once. The most frequent ones get the smallest
+  // indexes.
+  std::map<int32_t, std::size_t> uses;
+  for (auto& it : v) {
+    auto x = it.GetX();
+    if (x != 0 && varintSize(zigzag(x)) >= 3) uses[x]++;
+  }
+  std::vector<std::pair<std::size_t, int32_t>> candidates;
+  for (auto& it : uses)
+    if (it.second >= 2) candidates.emplace_back(it.second, it.first);
+  std::stable_sort(
+      candidates.begin(), candidates.end(),
+      [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+  std::unordered_map<int32_t, uint32_t> pool;
+  std::vector<int32_t> constants;
+  for (auto& it : candidates) {
+    auto index = static_cast<uint32_t>(constants.size());
+    // Only worth it while the index is shorter than the value.
+    if (varintSize(index) >= varintSize(zigzag(it.second))) continue;
+    pool.emplace(it.second, index);
+    constants.push_back(it.second);
+  }
+
+  std::string s;
+  s.reserve(binary::HeaderSize + v.size() * 2);
+  s.append(binary::Magic.data(), binary::Magic.size());
+  detail::PutLittle(s, binary::Version, 2);
+  detail::PutLittle(s, 0, 2);
+  detail::PutLittle(s, static_cast<uint32_t>(v.size()), 4);
+  detail::PutLittle(s, static_cast<uint32_t>(constants.size()), 4);
+  for (auto c : constants) putVarint(s, zigzag(c));
+  for (auto& it : v) {
+    auto op = static_cast<uint8_t>(it.GetOperation());
+    auto x = it.GetX();
+    if (x == 0) {
+      s += static_cast<char>(op | MODE_ZERO << MODE_SHIFT);
+    } else if (auto p = pool.find(x); p != pool.end()) {
+      s += static_cast<char>(op | MODE_CONSTANT << MODE_SHIFT);
+      putVarint(s, p->second);
+    } else {
+      s += static_cast<char>(op | MODE_VALUE << MODE_SHIFT);
+      putVarint(s, zigzag(x));
+    }
+  }
+  out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+bool IsBinary(std::string_view bytes) {
+  return bytes.substr(0, binary::Magic.size()) == binary::Magic;
+}
+
+std::optional<std::vector<Instruction>> DecodeBinary(std::string_view bytes) {
+  if (bytes.size() < binary::HeaderSize || !IsBinary(bytes)) return {};
+  Reader r(bytes.substr(binary::Magic.size()));
+  auto version = r.Little(2);
+  auto flags = r.Little(2);
+  auto count = r.Little(4);
+  auto constants = r.Little(4);
+  if (version != binary::Version || flags != 0) return {};
+  // Every constant and every instruction takes at least one byte, which
+  // also keeps a corrupt header from asking for a huge allocation.
+  if (static_cast<std::uint64_t>(count) + constants > r.Left()) return {};
+
+  std::vector<int32_t> pool(constants);
+  for (auto& c : pool) c = unzigzag(r.Varint());
+  std::vector<Instruction> v;
+  v.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    auto b = r.Byte();
+    auto op = b & ((1 << MODE_SHIFT) - 1);
+    auto mode = b >> MODE_SHIFT;
+    if (op >= OPERATION_COUNT) return {};
+    int32_t x = 0;
+    if (mode == MODE_VALUE) {
+      x = unzigzag(r.Varint());
+    } else if (mode == MODE_CONSTANT) {
+      auto index = r.Varint();
+      if (index >= pool.size()) return {};
+      x = pool[index];
+    } else if (mode != MODE_ZERO) {
+      return {};
+    }
+    v.emplace_back(static_cast<Operation>(op), x);
+  }
+  if (r.Bad() || r.Left() != 0) return {};
+  return v;
+}
+}  // namespace miniplc0
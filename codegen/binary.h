@@ -0,0 +1,44 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace miniplc0 {
+
+// 指令的二进制格式
+//
+// 文件头 16 字节，整数都是小端：
+//   "MPC0"   魔数
+//   u16      版本，目前是 1
+//   u16      标志位，目前必须是 0
+//   u32      指令的条数
+//   u32      常量池里常量的个数，为 0 时没有常量池
+// 然后是常量池，每个常量是一个 zigzag 编码的 varint，
+// 最后是指令，每条指令先是一个字节 op | mode << 5：
+//   mode 0   操作数是 0，后面没有别的字节
+//   mode 1   后面是 zigzag 编码的 varint 操作数
+//   mode 2   后面是 varint 的常量池下标
+// 大部分指令只有一两个字节；出现多次的大常量放进常量池，每次只写一个下标。
+namespace binary {
+// 文件开头的魔数
+constexpr std::string_view Magic = "MPC0";
+constexpr std::uint16_t Version = 1;
+constexpr std::size_t HeaderSize = 16;
+}  // namespace binary
+
+// 把指令写成二进制格式
+void EmitBinary(const std::vector<Instruction>& v, std::ostream& out);
+
+// bytes 是否以魔数开头，也就是看起来是不是二进制格式
+bool IsBinary(std::string_view bytes);
+
+// 直接从 bytes（通常是 mmap 进来的整个文件）里解码出指令，不另外拷贝一份
+// 格式不对、被截断或者有多余的字节时返回空
+std::optional<std::vector<Instruction>> DecodeBinary(std::string_view bytes);
+}  // namespace miniplc0
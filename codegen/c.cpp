@@ -0,0 +1,150 @@
+#include "codegen/c.h"
+
+#include "vm/register_vm.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace miniplc0 {
+
+namespace {
+using int32_t = std::int32_t;
+
+// Compilers slow down badly on one huge function, so the statements are
+// split into functions of this many.
+constexpr std::size_t STATEMENTS_PER_FUNCTION = 4096;
+
+std::string literal(int32_t value) {
+  // -2147483648 would be the negation of a constant that does not fit.
+  if (value == std::numeric_limits<int32_t>::min())
+    return "(-2147483647 - 1)";
+  return std::to_string(value);
+}
+
+std::string quote(const std::string& s) {
+  std::string r = "\"";
+  for (auto ch : s) {
+    if (ch == '"' || ch == '\\') r += '\\';
+    r += ch;
+  }
+  return r + "\"";
+}
+
+const char* const PRELUDE = R"(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void trap(unsigned long long index, int code) {
+  fflush(stdout);
+  fprintf(stderr, "Runtime error: Instruction: %llu Error: %s\n", index,
+          messages[code]);
+  exit(0);
+}
+
+static inline int32_t add(int32_t a, int32_t b, unsigned long long i) {
+  int64_t v = (int64_t)a + b;
+  if (v < INT32_MIN || v > INT32_MAX) trap(i, ADD_OVERFLOW);
+  return (int32_t)v;
+}
+
+static inline int32_t sub(int32_t a, int32_t b, unsigned long long i) {
+  int64_t v = (int64_t)a - b;
+  if (v < INT32_MIN || v > INT32_MAX) trap(i, SUB_OVERFLOW);
+  return (int32_t)v;
+}
+
+static inline int32_t mul(int32_t a, int32_t b, unsigned long long i) {
+  int64_t v = (int64_t)a * b;
+  if (v < INT32_MIN || v > INT32_MAX) trap(i, MUL_OVERFLOW);
+  return (int32_t)v;
+}
+
+static inline int32_t divide(int32_t a, int32_t b, unsigned long long i) {
+  if (b == 0) trap(i, DIVIDE_BY_ZERO);
+  if (b == -1 && a == INT32_MIN) trap(i, DIV_OVERFLOW);
+  return a / b;
+}
+
+static inline void print(int32_t v) { printf("%ld\n", (long)v); }
+)";
+}  // namespace
+
+void EmitC(const std::vector<Instruction>& v, std::ostream& out,
+           const std::function<std::string(RuntimeErrorCode)>& describe) {
+  auto program = LowerToRegisters(v);
+
+  out << "/* Generated by miniplc0. */\n";
+  // The prelude refers to these before it is written out.
+  out << "static const char* const messages[] = {\n";
+  for (auto code : {ErrIllegalInstruction, ErrAddOverflow, ErrSubOverflow,
+                    ErrMulOverflow, ErrDivideByZero, ErrDivOverflow,
+                    ErrInvalidProgram})
+    out << "    " << quote(describe(code)) << ",\n";
+  out << "};\n";
+  out << "enum { ILLEGAL_INSTRUCTION = " << ErrIllegalInstruction
+      << ", ADD_OVERFLOW = " << ErrAddOverflow
+      << ", SUB_OVERFLOW = " << ErrSubOverflow
+      << ", MUL_OVERFLOW = " << ErrMulOverflow
+      << ", DIVIDE_BY_ZERO = " << ErrDivideByZero
+      << ", DIV_OVERFLOW = " << ErrDivOverflow
+      << ", INVALID_PROGRAM = " << ErrInvalidProgram << " };\n";
+  out << PRELUDE << "\n";
+
+  if (program.invalid.has_value()) {
+    auto& err = program.invalid.value();
+    out << "int main(void) {\n  trap(" << err.GetIndex()
+        << "ULL, INVALID_PROGRAM);\n  return 0;\n}\n";
+    return;
+  }
+
+  // One more than needed, since C has no empty arrays.
+  out << "static int32_t r[" << program.stack + 1 << "];\n";
+  auto operand = [&](int32_t reg) {
+    if (reg >= program.stack)
+      return literal(program.constants[reg - program.stack]);
+    return "r[" + std::to_string(reg) + "]";
+  };
+
+  std::size_t functions = 0;
+  for (std::size_t i = 0; i < program.code.size(); i++) {
+    if (i % STATEMENTS_PER_FUNCTION == 0) {
+      if (i != 0) out << "}\n";
+      out << "\nstatic void part" << functions++ << "(void) {\n";
+    }
+    auto& c = program.code[i];
+    auto origin = std::to_string(program.origins[i]) + "ULL";
+    const char* call = nullptr;
+    switch (c.op) {
+      case RegisterOperation::MOV:
+        out << "  r[" << c.dst << "] = " << operand(c.a) << ";\n";
+        continue;
+      case RegisterOperation::WRT:
+        out << "  print(" << operand(c.a) << ");\n";
+        continue;
+      case RegisterOperation::ADD:
+        call = "add";
+        break;
+      case RegisterOperation::SUB:
+        call = "sub";
+        break;
+      case RegisterOperation::MUL:
+        call = "mul";
+        break;
+      case RegisterOperation::DIV:
+        call = "divide";
+        break;
+      default:
+        out << "  trap(" << origin << ", ILLEGAL_INSTRUCTION);\n";
+        continue;
+    }
+    out << "  r[" << c.dst << "] = " << call << "(" << operand(c.a) << ", "
+        << operand(c.b) << ", " << origin << ");\n";
+  }
+  if (functions != 0) out << "}\n";
+
+  out << "\nint main(void) {\n";
+  for (std::size_t f = 0; f < functions; f++) out << "  part" << f << "();\n";
+  out << "  return 0;\n}\n";
+}
+}  // namespace miniplc0
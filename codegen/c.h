@@ -0,0 +1,22 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "vm/vm.h"
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace miniplc0 {
+
+// 把程序翻译成一个独立的 C 程序，可以直接用系统的 C 编译器编译
+//
+// 先用 LowerToRegisters 翻译成寄存器指令，每条寄存器指令变成一条 C 语句，
+// 寄存器是一个全局数组，常量直接写成字面量。运算都检查溢出和除法的错误。
+// 生成的程序的标准输出和 -r 一样；出错时在标准错误输出
+// "Runtime error: Instruction: 下标 Error: describe(错误的种类)"，
+// 下标是原来的指令的下标，然后以 0 退出，也和 -r 一样。
+void EmitC(const std::vector<Instruction>& v, std::ostream& out,
+           const std::function<std::string(RuntimeErrorCode)>& describe);
+}  // namespace miniplc0
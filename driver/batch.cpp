@@ -0,0 +1,140 @@
+#include "driver/batch.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <system_error>
+
+namespace miniplc0 {
+
+namespace {
+namespace fs = std::filesystem;
+
+const char* extension(Action action) {
+  switch (action) {
+    case Action::TOKENIZE:
+      return ".tokens";
+    case Action::ANALYSE:
+      return ".list";
+    case Action::RUN:
+      return ".out";
+    case Action::EMIT_C:
+      return ".c";
+    case Action::EMIT_BINARY:
+      return ".bin";
+  }
+  return "";
+}
+
+BatchResult runOne(const BatchJob& job, const CompileOptions& options,
+                   CompileCache* cache) {
+  BatchResult result{CompileStatus::FAILED, ""};
+  auto input = SourceBuffer::FromFile(job.input);
+  if (!input.has_value()) {
+    result.errors = "Fail to open " + job.input + " for reading.\n";
+    return result;
+  }
+  std::error_code ec;
+  auto parent = fs::path(job.output).parent_path();
+  if (!parent.empty()) fs::create_directories(parent, ec);
+  auto mode = std::ios::out | std::ios::trunc;
+  if (options.action == Action::EMIT_BINARY) mode |= std::ios::binary;
+  std::ofstream out(job.output, mode);
+  if (!out) {
+    result.errors = "Fail to open " + job.output + " for writing.\n";
+    return result;
+  }
+  std::ostringstream err;
+  if (cache != nullptr)
+    result.status = cache->Compile(std::move(input.value()), options, out, err);
+  else
+    result.status = Compile(std::move(input.value()), options, out, err);
+  result.errors = err.str();
+  return result;
+}
+}  // namespace
+
+std::string BatchOutput(const std::string& name, const std::string& output_dir,
+                        Action action) {
+  auto path = fs::path(name);
+  path.replace_extension(extension(action));
+  if (output_dir.empty()) return path.string();
+  if (path.is_absolute()) path = path.filename();
+  return (fs::path(output_dir) / path).string();
+}
+
+std::vector<BatchJob> ReadManifest(std::istream& is,
+                                   const std::string& output_dir,
+                                   Action action) {
+  std::vector<BatchJob> jobs;
+  std::string line;
+  while (std::getline(is, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty() || line[0] == '#') continue;
+    auto tab = line.find('\t');
+    if (tab == std::string::npos)
+      jobs.push_back(BatchJob{line, BatchOutput(line, output_dir, action)});
+    else
+      jobs.push_back(BatchJob{line.substr(0, tab), line.substr(tab + 1)});
+  }
+  return jobs;
+}
+
+std::optional<std::vector<BatchJob>> ListDirectory(
+    const std::string& dir, const std::string& output_dir, Action action) {
+  std::error_code ec;
+  fs::recursive_directory_iterator it(dir, ec);
+  if (ec) return {};
+  std::vector<fs::path> files;
+  for (; it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (ec) return {};
+    if (it->is_regular_file(ec) &&
+        it->path().extension() != extension(action))
+      files.push_back(it->path());
+  }
+  std::sort(files.begin(), files.end());
+  std::vector<BatchJob> jobs;
+  for (auto& file : files) {
+    auto relative = file.lexically_relative(dir);
+    auto output = output_dir.empty()
+                      ? BatchOutput(file.string(), "", action)
+                      : BatchOutput(relative.string(), output_dir, action);
+    jobs.push_back(BatchJob{file.string(), output});
+  }
+  return jobs;
+}
+
+std::vector<BatchResult> RunBatch(const std::vector<BatchJob>& jobs,
+                                  const CompileOptions& options,
+                                  ThreadPool& pool, CompileCache* cache) {
+  std::vector<BatchResult> results(jobs.size(),
+                                   BatchResult{CompileStatus::OK, ""});
+  // Settled before anything runs, so which job loses does not depend on
+  // the schedule. Any job may still be reading its input while another
+  // writes, so no output may be an input of any job.
+  std::set<fs::path> inputs;
+  for (auto& job : jobs) inputs.insert(fs::path(job.input).lexically_normal());
+  std::map<fs::path, std::size_t> writers;
+  for (std::size_t i = 0; i < jobs.size(); i++) {
+    auto output = fs::path(jobs[i].output).lexically_normal();
+    if (inputs.count(output) != 0) {
+      results[i] = BatchResult{CompileStatus::FAILED,
+                               jobs[i].output + " is also an input.\n"};
+      continue;
+    }
+    auto first = writers.emplace(output, i);
+    if (!first.second) {
+      results[i] = BatchResult{CompileStatus::FAILED,
+                               jobs[i].output + " is already written for " +
+                                   jobs[first.first->second].input + ".\n"};
+    } else {
+      pool.Submit([&, i]() { results[i] = runOne(jobs[i], options, cache); });
+    }
+  }
+  pool.Wait();
+  return results;
+}
+}  // namespace miniplc0
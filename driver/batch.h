@@ -0,0 +1,58 @@
+#pragma once
+
+#include "driver/cache.h"
+#include "driver/compiler.h"
+#include "driver/thread_pool.h"
+
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace miniplc0 {
+
+// 批量编译中的一个文件
+struct BatchJob {
+  std::string input;
+  std::string output;
+};
+
+struct BatchResult {
+  CompileStatus status;
+  // 和单独编译这个文件时写到标准错误输出的内容一样
+  std::string errors;
+};
+
+// 没有指定输出文件时，name 对应的输出文件
+// 扩展名按 action 换成 .tokens .list .out .c .bin 中的一个，
+// output_dir 为空时放在 name 旁边，否则放在 output_dir/name
+std::string BatchOutput(const std::string& name, const std::string& output_dir,
+                        Action action);
+
+// 从清单里读出要编译的文件
+// 每行一个输入文件，也可以用制表符隔开输入和输出文件；
+// 空行和以 # 开头的行被忽略。
+// 没有给出输出文件时用 BatchOutput，绝对路径只取文件名。
+std::vector<BatchJob> ReadManifest(std::istream& is,
+                                   const std::string& output_dir,
+                                   Action action);
+
+// 目录下（包括子目录里）所有的普通文件，按路径排序
+// 输出文件用 BatchOutput 按相对于 dir 的路径决定，
+// 扩展名和输出文件一样的文件被当作上一次的结果跳过。
+// 无法读取目录时返回空
+std::optional<std::vector<BatchJob>> ListDirectory(
+    const std::string& dir, const std::string& output_dir, Action action);
+
+// 用 pool 并行地编译所有文件，每个文件的结果按 jobs 的顺序返回
+//
+// 每个任务有自己的 Tokenizer 和 Analyser，结果直接写进自己的输出文件，
+// 需要时会创建输出文件所在的目录。
+// 和前面的任务输出到同一个文件，或者会覆盖掉任何一个任务的输入的任务
+// 不会执行。
+// cache 不为空时所有的任务共用这个缓存。
+std::vector<BatchResult> RunBatch(const std::vector<BatchJob>& jobs,
+                                  const CompileOptions& options,
+                                  ThreadPool& pool,
+                                  CompileCache* cache = nullptr);
+}  // namespace miniplc0
@@ -0,0 +1,259 @@
+#include "driver/cache.h"
+
+#include "bytes.hpp"
+#include "codegen/binary.h"
+#include "driver/sha256.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+namespace {
+namespace fs = std::filesystem;
+using uint32_t = std::uint32_t;
+using uint64_t = std::uint64_t;
+
+// Changes whenever the layout of the directory or of an entry does.
+constexpr std::string_view FORMAT = "miniplc0 cache 1";
+constexpr std::string_view ENTRY_MAGIC = "MPCC";
+constexpr std::size_t ENTRY_HEADER = 16;
+// A bucket over its share is trimmed to this fraction of it, so that the
+// next few stores do not have to trim again.
+constexpr uint64_t TRIM_TO_PERCENT = 90;
+const char* const STATS = "stats";
+
+// Writes next to path first and renames it over, so that a reader never
+// sees half a file.
+bool replace(const fs::path& path, const std::string& content) {
+  static std::atomic<uint64_t> counter(std::random_device{}());
+  auto temp = path;
+  temp += ".tmp" + std::to_string(counter++);
+  {
+    std::ofstream out(temp, std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!out) return false;
+    out.write(content.data(), static_cast<std::streamsize>(content.size()));
+    if (!out) {
+      out.close();
+      std::error_code ec;
+      fs::remove(temp, ec);
+      return false;
+    }
+  }
+  std::error_code ec;
+  fs::rename(temp, path, ec);
+  if (ec) fs::remove(temp, ec);
+  return !ec;
+}
+
+bool isEntry(const fs::path& path) {
+  auto name = path.filename().string();
+  return name.size() == 64 &&
+         name.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+CacheStats readStats(const fs::path& path) {
+  CacheStats stats;
+  auto content = detail::ReadFile(path);
+  if (!content.has_value()) return stats;
+  std::istringstream in(content.value());
+  in >> stats.hits >> stats.misses >> stats.stores >> stats.evictions;
+  if (!in) return CacheStats();
+  return stats;
+}
+}  // namespace
+
+CompileCache::CompileCache(std::string dir, std::string identity,
+                           uint64_t limit)
+    : _dir(std::move(dir)),
+      _identity(std::move(identity)),
+      _limit(limit),
+      _bad(false),
+      _hits(0),
+      _misses(0),
+      _stores(0),
+      _evictions(0),
+      _mutex(),
+      _sizes() {
+  std::error_code ec;
+  fs::create_directories(_dir, ec);
+  _bad = !fs::is_directory(_dir, ec);
+}
+
+CompileCache::~CompileCache() {
+  if (_bad) return;
+  auto stats = Stats();
+  if (stats.hits + stats.misses + stats.stores + stats.evictions == 0) return;
+  auto path = fs::path(_dir) / STATS;
+  auto saved = readStats(path);
+  replace(path, std::to_string(saved.hits + stats.hits) + " " +
+                    std::to_string(saved.misses + stats.misses) + " " +
+                    std::to_string(saved.stores + stats.stores) + " " +
+                    std::to_string(saved.evictions + stats.evictions) + "\n");
+}
+
+CacheStats CompileCache::Stats() const {
+  CacheStats stats;
+  stats.hits = _hits;
+  stats.misses = _misses;
+  stats.stores = _stores;
+  stats.evictions = _evictions;
+  return stats;
+}
+
+CacheStats CompileCache::Load(const std::string& dir) {
+  auto stats = readStats(fs::path(dir) / STATS);
+  std::error_code ec;
+  for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (!isEntry(it->path()) || !it->is_regular_file(ec)) continue;
+    stats.entries++;
+    stats.bytes += it->file_size(ec);
+  }
+  return stats;
+}
+
+CompileStatus CompileCache::Compile(SourceBuffer input,
+                                    const CompileOptions& options,
+                                    std::ostream& out, std::ostream& err) {
+  if (_bad || input.IsStreaming() || IsBinary(input.View()))
+    return miniplc0::Compile(std::move(input), options, out, err);
+
+  // What is cached only depends on the input and these two, and the
+  // tokens do not even depend on the level.
+  auto stored = options;
+  if (stored.action == Action::RUN) stored.action = Action::EMIT_BINARY;
+  if (stored.action == Action::TOKENIZE) stored.level = 0;
+  auto k = key(input.View(), stored);
+  auto entry = lookup(k);
+  if (entry.has_value()) {
+    _hits++;
+  } else {
+    _misses++;
+    std::ostringstream o, e;
+    auto status = miniplc0::Compile(std::move(input), stored, o, e);
+    entry = CompileReply{status, o.str(), e.str()};
+    store(k, entry.value());
+  }
+
+  auto& result = entry.value();
+  if (options.action == Action::RUN && result.status == CompileStatus::OK)
+    return miniplc0::Compile(SourceBuffer(std::move(result.out)), options, out,
+                             err);
+  out << result.out;
+  if (!result.err.empty()) {
+    out.flush();
+    err << result.err;
+  }
+  return result.status;
+}
+
+std::string CompileCache::key(std::string_view input,
+                              const CompileOptions& options) const {
+  Sha256 sha;
+  std::string header(FORMAT);
+  header += '\0';
+  detail::PutLittle(header, static_cast<uint32_t>(_identity.size()));
+  header += _identity;
+  header += static_cast<char>(options.action);
+  header += static_cast<char>(options.level);
+  sha.Update(header);
+  sha.Update(input);
+  return Sha256::Hex(sha.Final());
+}
+
+std::optional<CompileReply> CompileCache::lookup(const std::string& key) {
+  auto path = fs::path(_dir) / key.substr(0, 1) / key;
+  auto content = detail::ReadFile(path);
+  if (!content.has_value()) return {};
+  auto& s = content.value();
+  std::error_code ec;
+  if (s.size() < ENTRY_HEADER || s.compare(0, 4, ENTRY_MAGIC) != 0 ||
+      static_cast<unsigned char>(s[4]) >
+          static_cast<unsigned char>(CompileStatus::FAILED)) {
+    fs::remove(path, ec);
+    return {};
+  }
+  uint64_t out = detail::GetLittle(s.data() + 8);
+  uint64_t err = detail::GetLittle(s.data() + 12);
+  if (ENTRY_HEADER + out + err != s.size()) {
+    fs::remove(path, ec);
+    return {};
+  }
+  // The time of last use is what eviction goes by.
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  return CompileReply{static_cast<CompileStatus>(s[4]),
+                      s.substr(ENTRY_HEADER, out),
+                      s.substr(ENTRY_HEADER + out, err)};
+}
+
+void CompileCache::store(const std::string& key, const CompileReply& entry) {
+  auto bucket = fs::path(_dir) / key.substr(0, 1);
+  std::error_code ec;
+  fs::create_directories(bucket, ec);
+  std::string s(ENTRY_MAGIC);
+  s += static_cast<char>(entry.status);
+  s.append(3, '\0');
+  detail::PutLittle(s, static_cast<uint32_t>(entry.out.size()));
+  detail::PutLittle(s, static_cast<uint32_t>(entry.err.size()));
+  s += entry.out;
+  s += entry.err;
+  if (!replace(bucket / key, s)) return;
+  _stores++;
+
+  // Only the first store into a bucket, and one that seems to take it over
+  // its share, look at what is on disk. An entry that was already there is
+  // counted twice, which at worst makes the scan come a bit early.
+  auto index = static_cast<std::size_t>(std::stoul(key.substr(0, 1), nullptr,
+                                                   16));
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto& size = _sizes[index];
+  if (size.has_value() && size.value() + s.size() <= _limit / Buckets) {
+    size = size.value() + s.size();
+    return;
+  }
+  size = trim(bucket.string());
+}
+
+uint64_t CompileCache::trim(const std::string& bucket) {
+  struct Entry {
+    fs::file_time_type used;
+    uint64_t size;
+    fs::path path;
+  };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  std::error_code ec;
+  for (fs::directory_iterator it(bucket, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (!isEntry(it->path())) continue;
+    std::error_code e;
+    auto size = it->file_size(e);
+    auto used = it->last_write_time(e);
+    if (e) continue;
+    entries.push_back(Entry{used, size, it->path()});
+    total += size;
+  }
+  auto share = _limit / Buckets;
+  if (total <= share) return total;
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& lhs, const Entry& rhs) {
+              return lhs.used < rhs.used;
+            });
+  auto target = share / 100 * TRIM_TO_PERCENT;
+  for (auto& entry : entries) {
+    if (total <= target) break;
+    // Someone else may be trimming the same bucket.
+    if (fs::remove(entry.path, ec)) _evictions++;
+    total -= entry.size;
+  }
+  return total;
+}
+}  // namespace miniplc0
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "driver/compiler.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace miniplc0 {
+
+struct CacheStats {
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  std::uint64_t stores = 0;
+  std::uint64_t evictions = 0;
+  // 目录里现有的条目和它们的总字节数，只有 CompileCache::Load 会填
+  std::uint64_t entries = 0;
+  std::uint64_t bytes = 0;
+};
+
+// 按内容寻址的编译缓存，保存在磁盘上的一个目录里
+//
+// 键是输入的字节、编译器的版本和影响结果的选项一起算出的 SHA-256，
+// 值是 Compile 写出的全部内容，编译失败的结果也一样缓存。
+// -r 缓存的是 --emit bin 的结果，命中之后直接解码执行，不再做词法和语法分析。
+// 条目按键的第一个十六进制字符分进 16 个子目录，写入新条目之后，
+// 如果它所在的子目录超过了 limit / 16，就按最近一次使用的时间淘汰旧的条目。
+// 每个子目录的大小记在内存里，只在第一次往里写和估计超过份额时才扫描
+// 一遍，所以写入的开销和子目录里有多少条目无关；别的进程写进来的条目
+// 要到下一次扫描时才算进去。
+// 每个条目先写进临时文件再改名，所以多个线程和进程可以同时使用同一个目录；
+// 不过统计数字是各个进程退出时读出来加上再写回去的，同时退出时可能会少算。
+class CompileCache final {
+ private:
+  using uint64_t = std::uint64_t;
+  static constexpr std::size_t Buckets = 16;
+
+ public:
+  static constexpr uint64_t DefaultLimit = 256u << 20;
+
+  // identity 区分编译器的版本，换了版本之后以前的条目不会再命中
+  CompileCache(std::string dir, std::string identity,
+               uint64_t limit = DefaultLimit);
+  CompileCache(const CompileCache&) = delete;
+  CompileCache& operator=(CompileCache) = delete;
+  // 把统计数字加进目录里保存的统计
+  ~CompileCache();
+
+  // 无法创建缓存目录
+  bool Bad() const { return _bad; }
+
+  // 和 miniplc0::Compile 一样，只是先查缓存
+  // 流式的输入和 --emit bin 写出的二进制不经过缓存
+  CompileStatus Compile(SourceBuffer input, const CompileOptions& options,
+                        std::ostream& out, std::ostream& err);
+
+  // 这个对象到现在为止的统计
+  CacheStats Stats() const;
+  // 目录里保存的统计，以及现有的条目数和总大小
+  static CacheStats Load(const std::string& dir);
+
+ private:
+  std::string key(std::string_view input, const CompileOptions& options) const;
+  std::optional<CompileReply> lookup(const std::string& key);
+  void store(const std::string& key, const CompileReply& entry);
+  // 把一个子目录淘汰到不超过限制，返回剩下的字节数
+  uint64_t trim(const std::string& bucket);
+
+ private:
+  std::string _dir;
+  std::string _identity;
+  uint64_t _limit;
+  bool _bad;
+  std::atomic<uint64_t> _hits;
+  std::atomic<uint64_t> _misses;
+  std::atomic<uint64_t> _stores;
+  std::atomic<uint64_t> _evictions;
+  // 各个子目录大概的字节数，还没扫描过的为空
+  std::mutex _mutex;
+  std::array<std::optional<uint64_t>, Buckets> _sizes;
+};
+}  // namespace miniplc0
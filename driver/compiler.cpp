@@ -0,0 +1,167 @@
+#include "driver/compiler.h"
+
+#include "analyser/analyser.h"
+#include "codegen/binary.h"
+#include "codegen/c.h"
+#include "ir/passes.h"
+#include "tokenizer/interner.h"
+#include "tokenizer/token_stream.h"
+#include "tokenizer/tokenizer.h"
+#include "vm/fusion.h"
+#include "vm/jit.h"
+#include "vm/register_vm.h"
+#include "vm/vm.h"
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "fmt/core.h"
+#include "fmts.hpp"
+
+namespace miniplc0 {
+
+namespace {
+std::optional<std::vector<Token>> tokenize(SourceBuffer input,
+                                           std::ostream& err) {
+  Tokenizer tkz(std::move(input));
+  auto p = tkz.AllTokens();
+  if (p.second.has_value()) {
+    err << fmt::format("Tokenization error: {}\n", p.second.value());
+    return {};
+  }
+  return std::move(p.first);
+}
+
+// Tokens are printed as soon as they are lexed, so piped input does not have
+// to reach EOF before the first token shows up.
+bool tokenizeStreaming(SourceBuffer input, std::ostream& out,
+                       std::ostream& err) {
+  Tokenizer tkz(std::move(input));
+  while (true) {
+    auto p = tkz.NextToken();
+    if (p.second.has_value()) {
+      if (p.second.value().GetCode() == ErrorCode::ErrEOF) return true;
+      err << fmt::format("Tokenization error: {}\n", p.second.value());
+      return false;
+    }
+    out << fmt::format("{}\n", p.first.value());
+  }
+}
+
+// Tokens are pulled by the analyser as it goes, so they are never all held
+// in memory at once. Above -O0 the whole program is built as IR and
+// optimised before it is lowered.
+std::optional<std::vector<Instruction>> analyse(SourceBuffer input, int level,
+                                                std::ostream& err) {
+  Tokenizer tkz(std::move(input));
+  TokenizerStream stream(tkz);
+  Analyser analyser(stream);
+  std::pair<std::vector<Instruction>, std::optional<CompilationError>> p;
+  if (level == 0) {
+    p = analyser.Analyse();
+  } else {
+    auto ir = analyser.AnalyseToIR();
+    if (!ir.second.has_value()) {
+      ir::PassManager::ForLevel(level).Run(ir.first);
+      p.first = ir.first.Lower();
+    }
+    p.second = ir.second;
+  }
+  // A lexing error anywhere in the input is reported instead of a syntax
+  // error, even when the analyser has stopped before reaching it.
+  while (stream.Next().has_value()) {
+  }
+  if (stream.Error().has_value()) {
+    err << fmt::format("Tokenization error: {}\n", stream.Error().value());
+    return {};
+  }
+  if (p.second.has_value()) {
+    err << fmt::format("Syntactic analysis error: {}\n", p.second.value());
+    return {};
+  }
+  return std::move(p.first);
+}
+
+// Values printed before a runtime error are still written out.
+// Runtime errors point at the unfused instruction, the one -l shows at the
+// same -O level.
+bool run(const std::vector<Instruction>& code, const std::string& engine,
+         std::ostream& out, std::ostream& err) {
+  std::pair<std::vector<std::int32_t>, std::optional<RuntimeError>> p;
+  // Lowering to registers, which the JIT starts with as well, already does
+  // what fusion would.
+  if (engine == "register") {
+    RegisterMachine vm(code);
+    p = vm.Run();
+  } else if (engine == "jit") {
+    JitProgram jit(code);
+    p = jit.Run();
+  } else {
+    auto fused = FuseInstructions(code);
+    VirtualMachine vm(fused.first);
+    p = vm.Run();
+    if (p.second.has_value())
+      p.second = RuntimeError(fused.second[p.second.value().GetIndex()],
+                              p.second.value().GetCode());
+  }
+  for (auto& it : p.first) out << fmt::format("{}\n", it);
+  if (p.second.has_value()) {
+    out.flush();
+    err << fmt::format("Runtime error: {}\n", p.second.value());
+    return false;
+  }
+  return true;
+}
+}  // namespace
+
+CompileStatus Compile(SourceBuffer input, const CompileOptions& options,
+                      std::ostream& out, std::ostream& err) {
+  // Symbols are numbered from 0 for every input, so the symbol table is
+  // sized by this input alone, and long-running modes do not keep every
+  // identifier they have ever seen.
+  Interner interner;
+  Interner::Scope scope(interner);
+  if (options.action == Action::TOKENIZE) {
+    if (input.IsStreaming())
+      return tokenizeStreaming(std::move(input), out, err)
+                 ? CompileStatus::OK
+                 : CompileStatus::FAILED;
+    auto tokens = tokenize(std::move(input), err);
+    if (!tokens.has_value()) return CompileStatus::FAILED;
+    for (auto& it : tokens.value()) out << fmt::format("{}\n", it);
+    return CompileStatus::OK;
+  }
+
+  // Programs written by --emit bin are run straight from the mapped file
+  // instead of being compiled; the -O level they were emitted at sticks.
+  // Anything else, even if it starts with the magic, is source.
+  std::optional<std::vector<Instruction>> code;
+  if (options.action == Action::RUN && !input.IsStreaming() &&
+      IsBinary(input.View()))
+    code = DecodeBinary(input.View());
+  if (!code.has_value()) {
+    code = analyse(std::move(input), options.level, err);
+    if (!code.has_value()) return CompileStatus::FAILED;
+  }
+
+  switch (options.action) {
+    case Action::RUN:
+      return run(code.value(), options.engine, out, err)
+                 ? CompileStatus::OK
+                 : CompileStatus::FAILED;
+    case Action::EMIT_C:
+      EmitC(code.value(), out,
+            [](RuntimeErrorCode c) { return fmt::format("{}", c); });
+      break;
+    case Action::EMIT_BINARY:
+      EmitBinary(code.value(), out);
+      break;
+    default:
+      for (auto& it : code.value()) out << fmt::format("{}\n", it);
+      break;
+  }
+  return CompileStatus::OK;
+}
+}  // namespace miniplc0
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "tokenizer/source.h"
+
+#include <ostream>
+#include <string>
+
+namespace miniplc0 {
+
+// 对一个输入做的事，和命令行上的 -t -l -r --emit 对应
+enum class Action {
+  TOKENIZE,
+  ANALYSE,
+  RUN,
+  EMIT_C,
+  EMIT_BINARY,
+};
+
+struct CompileOptions {
+  Action action = Action::ANALYSE;
+  // 优化的级别，和 -O 对应
+  int level = 0;
+  // -r 用的虚拟机：stack register jit
+  std::string engine = "stack";
+};
+
+enum class CompileStatus {
+  OK,
+  // 词法、语法或者运行时的错误
+  FAILED,
+};
+
+// Compile 的结果，out 和 err 是写进两个流的内容
+struct CompileReply {
+  CompileStatus status;
+  std::string out;
+  std::string err;
+};
+
+// 处理一个输入，结果写进 out，错误信息写进 err，格式和命令行上的完全一样
+//
+// -r 的输入是 --emit bin 写出的二进制文件时不再编译，直接解码，-O 不起作用；
+// 解码不了的输入，还有其他的动作，都当作源码，所以碰巧以魔数开头的源码
+// 得到的结果和以前一样。
+// 运行时出错的时候，先把出错之前的输出写完并 flush，再写错误信息。
+// 不依赖全局的状态，多个线程可以同时处理不同的输入。
+// 标识符放在这一次调用自己的 Interner 里，返回时就释放了。
+CompileStatus Compile(SourceBuffer input, const CompileOptions& options,
+                      std::ostream& out, std::ostream& err);
+}  // namespace miniplc0
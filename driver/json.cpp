@@ -0,0 +1,392 @@
+#include "driver/json.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace miniplc0 {
+
+namespace {
+// Numbers this large and beyond are no longer exact as doubles.
+constexpr double EXACT = 9007199254740992.0;
+
+void putUtf8(std::string& out, std::uint32_t cp) {
+  if (cp < 0x80) {
+    out += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    out += static_cast<char>(0xc0 | (cp >> 6));
+    out += static_cast<char>(0x80 | (cp & 0x3f));
+  } else if (cp < 0x10000) {
+    out += static_cast<char>(0xe0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (cp & 0x3f));
+  } else {
+    out += static_cast<char>(0xf0 | (cp >> 18));
+    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+}
+
+void putString(std::string& out, const std::string& s) {
+  out += '"';
+  for (auto c : s) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+class Parser final {
+ public:
+  explicit Parser(std::string_view text) : _text(text), _pos(0) {}
+
+  std::optional<Json> Document() {
+    auto value = parseValue(0);
+    skipSpaces();
+    if (!value.has_value() || _pos != _text.size()) return {};
+    return value;
+  }
+
+ private:
+  void skipSpaces() {
+    while (_pos < _text.size() &&
+           (_text[_pos] == ' ' || _text[_pos] == '\t' || _text[_pos] == '\n' ||
+            _text[_pos] == '\r'))
+      _pos++;
+  }
+
+  bool consume(std::string_view word) {
+    if (_text.substr(_pos, word.size()) != word) return false;
+    _pos += word.size();
+    return true;
+  }
+
+  std::optional<Json> parseValue(std::size_t depth) {
+    if (depth > Json::MaxDepth) return {};
+    skipSpaces();
+    if (_pos == _text.size()) return {};
+    switch (_text[_pos]) {
+      case '{':
+        return parseObject(depth);
+      case '[':
+        return parseArray(depth);
+      case '"': {
+        auto s = parseString();
+        if (!s.has_value()) return {};
+        return Json(std::move(s.value()));
+      }
+      case 't':
+        if (consume("true")) return Json(true);
+        return {};
+      case 'f':
+        if (consume("false")) return Json(false);
+        return {};
+      case 'n':
+        if (consume("null")) return Json();
+        return {};
+      default:
+        return parseNumber();
+    }
+  }
+
+  std::optional<Json> parseObject(std::size_t depth) {
+    _pos++;
+    auto object = Json::Object();
+    skipSpaces();
+    if (consume("}")) return object;
+    while (true) {
+      skipSpaces();
+      if (_pos == _text.size() || _text[_pos] != '"') return {};
+      auto key = parseString();
+      if (!key.has_value()) return {};
+      skipSpaces();
+      if (!consume(":")) return {};
+      auto value = parseValue(depth + 1);
+      if (!value.has_value()) return {};
+      object.Set(std::move(key.value()), std::move(value.value()));
+      skipSpaces();
+      if (consume("}")) return object;
+      if (!consume(",")) return {};
+    }
+  }
+
+  std::optional<Json> parseArray(std::size_t depth) {
+    _pos++;
+    auto array = Json::Array();
+    skipSpaces();
+    if (consume("]")) return array;
+    while (true) {
+      auto value = parseValue(depth + 1);
+      if (!value.has_value()) return {};
+      array.Push(std::move(value.value()));
+      skipSpaces();
+      if (consume("]")) return array;
+      if (!consume(",")) return {};
+    }
+  }
+
+  std::optional<std::uint32_t> parseHex4() {
+    if (_text.size() - _pos < 4) return {};
+    std::uint32_t u = 0;
+    for (int i = 0; i < 4; i++) {
+      auto c = _text[_pos++];
+      u <<= 4;
+      if (c >= '0' && c <= '9')
+        u |= static_cast<std::uint32_t>(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        u |= static_cast<std::uint32_t>(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        u |= static_cast<std::uint32_t>(c - 'A' + 10);
+      else
+        return {};
+    }
+    return u;
+  }
+
+  std::optional<std::string> parseString() {
+    _pos++;
+    std::string s;
+    while (true) {
+      if (_pos == _text.size()) return {};
+      auto c = _text[_pos++];
+      if (c == '"') return s;
+      if (static_cast<unsigned char>(c) < 0x20) return {};
+      if (c != '\\') {
+        s += c;
+        continue;
+      }
+      if (_pos == _text.size()) return {};
+      switch (_text[_pos++]) {
+        case '"':
+          s += '"';
+          break;
+        case '\\':
+          s += '\\';
+          break;
+        case '/':
+          s += '/';
+          break;
+        case 'b':
+          s += '\b';
+          break;
+        case 'f':
+          s += '\f';
+          break;
+        case 'n':
+          s += '\n';
+          break;
+        case 'r':
+          s += '\r';
+          break;
+        case 't':
+          s += '\t';
+          break;
+        case 'u': {
+          auto cp = parseHex4();
+          if (!cp.has_value()) return {};
+          // A high surrogate has to be followed by a low one.
+          if (cp.value() >= 0xd800 && cp.value() < 0xdc00) {
+            if (!consume("\\u")) return {};
+            auto low = parseHex4();
+            if (!low.has_value() || low.value() < 0xdc00 ||
+                low.value() >= 0xe000)
+              return {};
+            cp = 0x10000 + ((cp.value() - 0xd800) << 10) +
+                 (low.value() - 0xdc00);
+          } else if (cp.value() >= 0xdc00 && cp.value() < 0xe000) {
+            return {};
+          }
+          putUtf8(s, cp.value());
+          break;
+        }
+        default:
+          return {};
+      }
+    }
+  }
+
+  std::optional<Json> parseNumber() {
+    auto start = _pos;
+    auto digits = [this]() {
+      auto from = _pos;
+      while (_pos < _text.size() && _text[_pos] >= '0' && _text[_pos] <= '9')
+        _pos++;
+      return _pos - from;
+    };
+    consume("-");
+    auto first = _pos;
+    auto n = digits();
+    if (n == 0 || (n > 1 && _text[first] == '0')) return {};
+    if (consume(".") && digits() == 0) return {};
+    if (_pos < _text.size() && (_text[_pos] == 'e' || _text[_pos] == 'E')) {
+      _pos++;
+      if (!consume("+")) consume("-");
+      if (digits() == 0) return {};
+    }
+    std::string number(_text.substr(start, _pos - start));
+    return Json(std::strtod(number.c_str(), nullptr));
+  }
+
+ private:
+  std::string_view _text;
+  std::size_t _pos;
+};
+}  // namespace
+
+std::optional<Json> Json::Parse(std::string_view text) {
+  return Parser(text).Document();
+}
+
+std::string Json::Dump() const {
+  std::string out;
+  dump(out);
+  return out;
+}
+
+void Json::dump(std::string& out) const {
+  switch (_type) {
+    case NUL:
+      out += "null";
+      break;
+    case BOOL:
+      out += _bool ? "true" : "false";
+      break;
+    case NUMBER: {
+      char buf[32];
+      if (std::isfinite(_number) && std::trunc(_number) == _number &&
+          std::fabs(_number) < EXACT)
+        std::snprintf(buf, sizeof(buf), "%lld",
+                      static_cast<long long>(_number));
+      else if (std::isfinite(_number))
+        std::snprintf(buf, sizeof(buf), "%.17g", _number);
+      else
+        std::snprintf(buf, sizeof(buf), "null");
+      out += buf;
+      break;
+    }
+    case STRING:
+      putString(out, _string);
+      break;
+    case ARRAY:
+      out += '[';
+      for (std::size_t i = 0; i < _array.size(); i++) {
+        if (i != 0) out += ',';
+        _array[i].dump(out);
+      }
+      out += ']';
+      break;
+    case OBJECT:
+      out += '{';
+      for (std::size_t i = 0; i < _object.size(); i++) {
+        if (i != 0) out += ',';
+        putString(out, _object[i].first);
+        out += ':';
+        _object[i].second.dump(out);
+      }
+      out += '}';
+      break;
+  }
+}
+
+std::optional<bool> Json::GetBool() const {
+  if (_type != BOOL) return {};
+  return _bool;
+}
+
+std::optional<double> Json::GetNumber() const {
+  if (_type != NUMBER) return {};
+  return _number;
+}
+
+std::optional<std::int64_t> Json::GetInteger() const {
+  if (_type != NUMBER || std::trunc(_number) != _number ||
+      std::fabs(_number) >= EXACT)
+    return {};
+  return static_cast<std::int64_t>(_number);
+}
+
+const std::string* Json::GetString() const {
+  return _type == STRING ? &_string : nullptr;
+}
+
+const std::vector<Json>* Json::GetArray() const {
+  return _type == ARRAY ? &_array : nullptr;
+}
+
+const Json* Json::Get(std::string_view key) const {
+  if (_type != OBJECT) return nullptr;
+  for (auto& member : _object)
+    if (member.first == key) return &member.second;
+  return nullptr;
+}
+
+const Json* Json::Find(std::initializer_list<std::string_view> path) const {
+  auto value = this;
+  for (auto key : path) {
+    value = value->Get(key);
+    if (value == nullptr) return nullptr;
+  }
+  return value;
+}
+
+Json& Json::Set(std::string key, Json value) {
+  if (_type != OBJECT) *this = Object();
+  for (auto& member : _object) {
+    if (member.first == key) {
+      member.second = std::move(value);
+      return *this;
+    }
+  }
+  _object.emplace_back(std::move(key), std::move(value));
+  return *this;
+}
+
+Json& Json::Push(Json value) {
+  if (_type != ARRAY) *this = Array();
+  _array.push_back(std::move(value));
+  return *this;
+}
+
+bool Json::operator==(const Json& rhs) const {
+  if (_type != rhs._type) return false;
+  switch (_type) {
+    case NUL:
+      return true;
+    case BOOL:
+      return _bool == rhs._bool;
+    case NUMBER:
+      return _number == rhs._number;
+    case STRING:
+      return _string == rhs._string;
+    case ARRAY:
+      return _array == rhs._array;
+    case OBJECT:
+      return _object == rhs._object;
+  }
+  return false;
+}
+}  // namespace miniplc0
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 语言服务器用的 JSON
+//
+// 只有 LSP 用得到的那些功能：数字都用 double 保存，对象按插入的顺序保存成
+// 一个数组，查找时逐个比较键，LSP 的消息里一个对象只有几个键，这样就够了。
+class Json final {
+ public:
+  enum Type : std::uint8_t { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  // 嵌套的数组和对象最多这么多层，再深的输入当作格式错误
+  static constexpr std::size_t MaxDepth = 256;
+
+ public:
+  Json() : _type(NUL), _bool(false), _number(0) {}
+  Json(bool b) : _type(BOOL), _bool(b), _number(0) {}
+  Json(double d) : _type(NUMBER), _bool(false), _number(d) {}
+  Json(int i) : Json(static_cast<double>(i)) {}
+  Json(std::int64_t i) : Json(static_cast<double>(i)) {}
+  Json(std::uint64_t u) : Json(static_cast<double>(u)) {}
+  Json(std::string s)
+      : _type(STRING), _bool(false), _number(0), _string(std::move(s)) {}
+  Json(const char* s) : Json(std::string(s)) {}
+  static Json Array() { return Json(ARRAY); }
+  static Json Object() { return Json(OBJECT); }
+
+  // 格式不对时返回空
+  static std::optional<Json> Parse(std::string_view text);
+  // 没有多余的空白
+  std::string Dump() const;
+
+  Type GetType() const { return _type; }
+  bool IsNull() const { return _type == NUL; }
+  // 类型不对时返回空
+  std::optional<bool> GetBool() const;
+  std::optional<double> GetNumber() const;
+  // 是整数的数字
+  std::optional<std::int64_t> GetInteger() const;
+  const std::string* GetString() const;
+  const std::vector<Json>* GetArray() const;
+
+  // 对象的成员，没有这个键或者不是对象时返回空指针
+  const Json* Get(std::string_view key) const;
+  // 沿着一串键往下找
+  const Json* Find(std::initializer_list<std::string_view> path) const;
+
+  // 设置对象的一个成员，已有的会被替换；不是对象时先变成空对象
+  Json& Set(std::string key, Json value);
+  // 在数组末尾加一项；不是数组时先变成空数组
+  Json& Push(Json value);
+
+  bool operator==(const Json& rhs) const;
+  bool operator!=(const Json& rhs) const { return !(*this == rhs); }
+
+ private:
+  explicit Json(Type type) : _type(type), _bool(false), _number(0) {}
+  void dump(std::string& out) const;
+
+ private:
+  Type _type;
+  bool _bool;
+  double _number;
+  std::string _string;
+  std::vector<Json> _array;
+  std::vector<std::pair<std::string, Json>> _object;
+};
+}  // namespace miniplc0
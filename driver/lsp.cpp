@@ -0,0 +1,425 @@
+#include "driver/lsp.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <string_view>
+
+#include "fmt/core.h"
+#include "fmts.hpp"
+
+namespace miniplc0 {
+
+namespace {
+using uint64_t = std::uint64_t;
+
+// JSON-RPC and LSP error codes.
+constexpr int PARSE_ERROR = -32700;
+constexpr int INVALID_REQUEST = -32600;
+constexpr int METHOD_NOT_FOUND = -32601;
+constexpr int SERVER_NOT_INITIALIZED = -32002;
+// TextDocumentSyncKind.Incremental
+constexpr int SYNC_INCREMENTAL = 2;
+// DiagnosticSeverity.Error
+constexpr int SEVERITY_ERROR = 1;
+
+bool isContinuation(char c) {
+  return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+}
+
+// UTF-16 code units taken by the first bytes of line. Code points outside
+// the BMP take two; bytes that are not valid UTF-8 count as one each.
+uint64_t unitsOf(std::string_view line, uint64_t bytes) {
+  bytes = std::min<uint64_t>(bytes, line.size());
+  uint64_t units = 0;
+  for (uint64_t i = 0; i < bytes; i++) {
+    if (isContinuation(line[i])) continue;
+    units += static_cast<unsigned char>(line[i]) >= 0xf0 ? 2 : 1;
+  }
+  return units;
+}
+
+// The other way round, stopping at the end of the line.
+uint64_t bytesOf(std::string_view line, uint64_t units) {
+  uint64_t i = 0;
+  while (i < line.size() && units > 0) {
+    auto wide = static_cast<unsigned char>(line[i]) >= 0xf0;
+    if (wide && units == 1) break;
+    units -= wide ? 2 : 1;
+    i++;
+    while (i < line.size() && isContinuation(line[i])) i++;
+  }
+  return i;
+}
+
+std::optional<std::pair<uint64_t, uint64_t>> positionOf(const Json* json) {
+  if (json == nullptr) return {};
+  auto line = json->Get("line"), character = json->Get("character");
+  if (line == nullptr || character == nullptr) return {};
+  auto l = line->GetInteger(), c = character->GetInteger();
+  if (!l.has_value() || !c.has_value() || l.value() < 0 || c.value() < 0)
+    return {};
+  return std::make_pair(static_cast<uint64_t>(l.value()),
+                        static_cast<uint64_t>(c.value()));
+}
+
+Json position(uint64_t line, uint64_t character) {
+  return Json::Object().Set("line", line).Set("character", character);
+}
+
+const std::string* uriOf(const Json& params) {
+  auto uri = params.Find({"textDocument", "uri"});
+  return uri == nullptr ? nullptr : uri->GetString();
+}
+}  // namespace
+
+LanguageServer::LanguageServer(std::istream& in, std::ostream& out,
+                               std::chrono::milliseconds debounce)
+    : _in(in),
+      _out(out),
+      _debounce(debounce),
+      _initialized(false),
+      _shutdown(false),
+      _utf8(false),
+      _mutex(),
+      _wake(),
+      _stopping(false),
+      _documents(),
+      _output(),
+      _worker([this]() { work(); }) {}
+
+LanguageServer::~LanguageServer() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _wake.notify_all();
+  if (_worker.joinable()) _worker.join();
+}
+
+int LanguageServer::Run() {
+  int code = 1;
+  while (true) {
+    auto body = readMessage();
+    if (!body.has_value()) break;
+    auto message = Json::Parse(body.value());
+    if (!message.has_value()) {
+      replyError(Json(), PARSE_ERROR, "The message is not valid JSON.");
+      continue;
+    }
+    auto method = message.value().Get("method");
+    if (method != nullptr && method->GetString() != nullptr &&
+        *method->GetString() == "exit") {
+      code = _shutdown ? 0 : 1;
+      break;
+    }
+    handle(message.value());
+  }
+
+  // Let the worker finish what is still pending, then stop it.
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _wake.notify_all();
+  _worker.join();
+  return code;
+}
+
+// A message is a few headers, of which only Content-Length matters, an
+// empty line and then that many bytes of JSON.
+std::optional<std::string> LanguageServer::readMessage() {
+  std::optional<uint64_t> length;
+  std::string line;
+  while (true) {
+    if (!std::getline(_in, line)) return {};
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) {
+      if (length.has_value()) break;
+      continue;
+    }
+    auto colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    auto name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), [](char c) {
+      return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    });
+    if (name != "content-length") continue;
+    auto value = line.substr(colon + 1);
+    auto first = value.find_first_not_of(' ');
+    if (first == std::string::npos) continue;
+    value = value.substr(first);
+    if (value.empty() || value.size() > 10 ||
+        value.find_first_not_of("0123456789") != std::string::npos)
+      continue;
+    length = std::stoull(value);
+  }
+  if (length.value() > MaxMessage) return {};
+  std::string body(static_cast<std::size_t>(length.value()), '\0');
+  _in.read(body.data(), static_cast<std::streamsize>(body.size()));
+  if (static_cast<uint64_t>(_in.gcount()) != length.value()) return {};
+  return body;
+}
+
+void LanguageServer::send(const Json& message) {
+  auto body = message.Dump();
+  std::lock_guard<std::mutex> lock(_output);
+  _out << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+  _out.flush();
+}
+
+void LanguageServer::reply(const Json& id, Json result) {
+  send(Json::Object()
+           .Set("jsonrpc", "2.0")
+           .Set("id", id)
+           .Set("result", std::move(result)));
+}
+
+void LanguageServer::replyError(const Json& id, int code,
+                                const std::string& message) {
+  auto error = Json::Object().Set("code", code).Set("message", message);
+  send(Json::Object()
+           .Set("jsonrpc", "2.0")
+           .Set("id", id)
+           .Set("error", std::move(error)));
+}
+
+void LanguageServer::handle(const Json& message) {
+  auto id = message.Get("id");
+  auto method = message.Get("method");
+  // Replies from the client are of no interest, since nothing is asked.
+  if (method == nullptr) return;
+  if (method->GetString() == nullptr) {
+    if (id != nullptr) replyError(*id, INVALID_REQUEST, "No method.");
+    return;
+  }
+  auto& name = *method->GetString();
+  auto params = message.Get("params");
+
+  if (name == "initialize") {
+    if (id != nullptr) reply(*id, initialize(params));
+    _initialized = true;
+    return;
+  }
+  if (!_initialized || _shutdown) {
+    // Notifications are dropped, as the protocol asks.
+    if (id != nullptr)
+      replyError(*id, _shutdown ? INVALID_REQUEST : SERVER_NOT_INITIALIZED,
+                 _shutdown ? "The server is shutting down."
+                           : "The server is not initialized.");
+    return;
+  }
+
+  if (name == "shutdown") {
+    _shutdown = true;
+    if (id != nullptr) reply(*id, Json());
+  } else if (name == "textDocument/didOpen" && params != nullptr) {
+    didOpen(*params);
+  } else if (name == "textDocument/didChange" && params != nullptr) {
+    didChange(*params);
+  } else if (name == "textDocument/didClose" && params != nullptr) {
+    didClose(*params);
+  } else if (id != nullptr) {
+    replyError(*id, METHOD_NOT_FOUND, "Unknown method " + name + ".");
+  }
+  // Other notifications, $/cancelRequest among them, are ignored.
+}
+
+Json LanguageServer::initialize(const Json* params) {
+  auto encodings = params == nullptr
+                       ? nullptr
+                       : params->Find({"capabilities", "general",
+                                       "positionEncodings"});
+  if (encodings != nullptr && encodings->GetArray() != nullptr)
+    for (auto& encoding : *encodings->GetArray())
+      if (encoding == Json("utf-8")) _utf8 = true;
+
+  auto sync = Json::Object()
+                  .Set("openClose", true)
+                  .Set("change", SYNC_INCREMENTAL);
+  auto capabilities =
+      Json::Object()
+          .Set("positionEncoding", _utf8 ? "utf-8" : "utf-16")
+          .Set("textDocumentSync", std::move(sync));
+  return Json::Object()
+      .Set("capabilities", std::move(capabilities))
+      .Set("serverInfo", Json::Object().Set("name", "miniplc0"));
+}
+
+void LanguageServer::didOpen(const Json& params) {
+  auto uri = uriOf(params);
+  auto text = params.Find({"textDocument", "text"});
+  if (uri == nullptr || text == nullptr || text->GetString() == nullptr)
+    return;
+  auto version = params.Find({"textDocument", "version"});
+
+  auto document = std::make_shared<Document>();
+  document->pending.push_back(Change{{}, *text->GetString()});
+  if (version != nullptr && version->GetInteger().has_value())
+    document->version = version->GetInteger().value();
+  // Opening is not typing, so there is nothing to wait for.
+  document->due = Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& slot = _documents[*uri];
+    if (slot != nullptr) {
+      slot->closed = true;
+      slot->cancel = true;
+    }
+    slot = std::move(document);
+  }
+  _wake.notify_all();
+}
+
+void LanguageServer::didChange(const Json& params) {
+  auto uri = uriOf(params);
+  auto changes = params.Get("contentChanges");
+  if (uri == nullptr || changes == nullptr || changes->GetArray() == nullptr)
+    return;
+  auto version = params.Find({"textDocument", "version"});
+
+  std::vector<Change> parsed;
+  for (auto& change : *changes->GetArray()) {
+    auto text = change.Get("text");
+    if (text == nullptr || text->GetString() == nullptr) continue;
+    Change c{{}, *text->GetString()};
+    auto range = change.Get("range");
+    if (range != nullptr) {
+      auto start = positionOf(range->Get("start"));
+      auto end = positionOf(range->Get("end"));
+      if (!start.has_value() || !end.has_value()) continue;
+      c.range = std::make_pair(start.value(), end.value());
+    }
+    parsed.push_back(std::move(c));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _documents.find(*uri);
+    if (it == _documents.end()) return;
+    auto& document = *it->second;
+    std::move(parsed.begin(), parsed.end(),
+              std::back_inserter(document.pending));
+    if (version != nullptr && version->GetInteger().has_value())
+      document.version = version->GetInteger().value();
+    document.due = Clock::now() + _debounce;
+    document.cancel = true;
+  }
+  _wake.notify_all();
+}
+
+void LanguageServer::didClose(const Json& params) {
+  auto uri = uriOf(params);
+  if (uri == nullptr) return;
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _documents.find(*uri);
+  if (it == _documents.end()) return;
+  it->second->closed = true;
+  it->second->cancel = true;
+  _documents.erase(it);
+  // Under the lock, so that the worker cannot publish anything after it.
+  publish(*uri, {}, Json::Array());
+}
+
+void LanguageServer::work() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    // The document whose changes are due first.
+    std::shared_ptr<Document> next;
+    std::string uri;
+    for (auto& it : _documents) {
+      if (it.second->pending.empty()) continue;
+      if (next == nullptr || it.second->due < next->due) {
+        next = it.second;
+        uri = it.first;
+      }
+    }
+    if (next == nullptr) {
+      if (_stopping) return;
+      _wake.wait(lock);
+      continue;
+    }
+    // Once stopping, what is left is done right away.
+    if (!_stopping && next->due > Clock::now()) {
+      _wake.wait_until(lock, next->due);
+      continue;
+    }
+
+    auto changes = std::move(next->pending);
+    next->pending.clear();
+    auto version = next->version;
+    next->cancel = false;
+    lock.unlock();
+
+    for (auto& change : changes) apply(next->analyser, change);
+    std::optional<CompilationError> err;
+    auto done = next->analyser.Analyse(next->cancel, err);
+    Json diagnostics = Json::Array();
+    if (err.has_value())
+      diagnostics.Push(diagnose(next->analyser, err.value()));
+
+    lock.lock();
+    // Cancelled ones have newer changes pending, and closed ones are gone.
+    if (done && !next->closed) publish(uri, version, std::move(diagnostics));
+  }
+}
+
+void LanguageServer::apply(IncrementalAnalyser& analyser,
+                           const Change& change) const {
+  if (!change.range.has_value()) {
+    analyser.Replace(change.text);
+    return;
+  }
+  auto start = change.range.value().first;
+  auto end = change.range.value().second;
+  if (!_utf8) {
+    // Past the last line is the end of the document either way.
+    if (start.first < analyser.LineCount())
+      start.second = bytesOf(analyser.LineText(start.first), start.second);
+    if (end.first < analyser.LineCount())
+      end.second = bytesOf(analyser.LineText(end.first), end.second);
+  }
+  analyser.Edit(start, end, change.text);
+}
+
+Json LanguageServer::diagnose(const IncrementalAnalyser& analyser,
+                              const CompilationError& err) const {
+  auto line = err.GetPos().first;
+  auto column = err.GetPos().second;
+  // Errors point right after the token they are about, so the character
+  // there is marked, if there is one.
+  uint64_t length = 0;
+  if (line < analyser.LineCount()) length = analyser.LineText(line).size();
+  auto last = std::min(column + 1, std::max(column, length));
+  auto start = column, end = last;
+  if (!_utf8 && line < analyser.LineCount()) {
+    start = unitsOf(analyser.LineText(line), column);
+    end = unitsOf(analyser.LineText(line), last);
+  }
+  auto range = Json::Object()
+                   .Set("start", position(line, start))
+                   .Set("end", position(line, end));
+  auto lexical = analyser.LexicalError().has_value();
+  auto message = fmt::format("{}: {}",
+                             lexical ? "Tokenization error"
+                                     : "Syntactic analysis error",
+                             err.GetCode());
+  return Json::Object()
+      .Set("range", std::move(range))
+      .Set("severity", SEVERITY_ERROR)
+      .Set("source", "miniplc0")
+      .Set("message", message);
+}
+
+void LanguageServer::publish(const std::string& uri,
+                             std::optional<std::int64_t> version,
+                             Json diagnostics) {
+  auto params = Json::Object().Set("uri", uri);
+  if (version.has_value()) params.Set("version", version.value());
+  params.Set("diagnostics", std::move(diagnostics));
+  send(Json::Object()
+           .Set("jsonrpc", "2.0")
+           .Set("method", "textDocument/publishDiagnostics")
+           .Set("params", std::move(params)));
+}
+}  // namespace miniplc0
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "analyser/incremental.h"
+#include "driver/json.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 在标准输入输出上说 Language Server Protocol 的语言服务器，只提供诊断
+//
+// 调用 Run() 的线程一个一个地读入消息并回复，打开和编辑文档时只是把改动
+// 记下来就接着读下一条；另外有一个后台线程把改动应用到文档的
+// IncrementalAnalyser 上，重新分析以后发布诊断。
+// 一个文档在 debounce 这么长的时间里没有新的改动才会被分析，分析的途中又有
+// 新的改动时，这一次分析会被放弃，已经分析好的部分留给下一次。
+// 所以读消息的循环从来不用等分析，连续输入时也不会分析过时的内容。
+// 诊断就是 -l 报告的第一个词法或者语法错误。
+class LanguageServer final {
+ private:
+  using uint64_t = std::uint64_t;
+  using Clock = std::chrono::steady_clock;
+
+ public:
+  static constexpr std::chrono::milliseconds DefaultDebounce{5};
+  // 一条消息最长这么多字节，再长的当作输入已经结束
+  static constexpr std::size_t MaxMessage = 256u << 20;
+
+  LanguageServer(std::istream& in, std::ostream& out,
+                 std::chrono::milliseconds debounce = DefaultDebounce);
+  LanguageServer(const LanguageServer&) = delete;
+  LanguageServer& operator=(LanguageServer) = delete;
+  ~LanguageServer();
+
+  // 处理消息直到收到 exit 或者输入结束，返回进程的退出码
+  // 按照 LSP 的规定，收到过 shutdown 时是 0，否则是 1
+  // 返回之前会把还没有分析的文档分析完并发布诊断
+  int Run();
+
+ private:
+  struct Change {
+    // 为空时换掉整个文档
+    std::optional<std::pair<std::pair<uint64_t, uint64_t>,
+                            std::pair<uint64_t, uint64_t>>>
+        range;
+    std::string text;
+  };
+
+  struct Document {
+    // 只有后台线程会用
+    IncrementalAnalyser analyser;
+    // 下面这些由 _mutex 保护
+    std::vector<Change> pending;
+    std::int64_t version = 0;
+    // 到这个时候才分析 pending 里的改动
+    Clock::time_point due;
+    bool closed = false;
+    // 有新的改动时设置，正在进行的分析看到以后就放弃
+    std::atomic<bool> cancel{false};
+  };
+
+  std::optional<std::string> readMessage();
+  void send(const Json& message);
+  void reply(const Json& id, Json result);
+  void replyError(const Json& id, int code, const std::string& message);
+  void handle(const Json& message);
+  Json initialize(const Json* params);
+  void didOpen(const Json& params);
+  void didChange(const Json& params);
+  void didClose(const Json& params);
+
+  // 后台线程
+  void work();
+  void apply(IncrementalAnalyser& analyser, const Change& change) const;
+  Json diagnose(const IncrementalAnalyser& analyser,
+                const CompilationError& err) const;
+  void publish(const std::string& uri, std::optional<std::int64_t> version,
+               Json diagnostics);
+
+ private:
+  std::istream& _in;
+  std::ostream& _out;
+  std::chrono::milliseconds _debounce;
+  bool _initialized;
+  bool _shutdown;
+  // 客户端支持的话位置按 UTF-8 的字节算，否则按 UTF-16 的码元算
+  bool _utf8;
+
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  bool _stopping;
+  std::map<std::string, std::shared_ptr<Document>> _documents;
+  // 两个线程都会写 _out
+  std::mutex _output;
+  std::thread _worker;
+};
+}  // namespace miniplc0
@@ -0,0 +1,380 @@
+#include "driver/server.h"
+
+#include "bytes.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace miniplc0 {
+
+namespace {
+using uint8_t = std::uint8_t;
+using uint32_t = std::uint32_t;
+
+const char* const ENGINES[] = {"stack", "register", "jit"};
+constexpr uint8_t ENGINE_COUNT = sizeof(ENGINES) / sizeof(ENGINES[0]);
+// The first read of a request's source, and what the buffers may keep
+// between requests.
+constexpr std::size_t READ_CHUNK = 64 * 1024;
+constexpr std::size_t KEPT_BUFFER = 16 * 1024 * 1024;
+// How long Serve() stops accepting after running out of descriptors or
+// memory, which only closing connections gives back.
+constexpr std::chrono::milliseconds BACKOFF{100};
+
+#if !defined(_WIN32)
+// Both return false once the other end is gone or something failed.
+bool readAll(int fd, char* p, std::size_t n) {
+  while (n > 0) {
+    auto got = read(fd, p, n);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) return false;
+    p += got;
+    n -= static_cast<std::size_t>(got);
+  }
+  return true;
+}
+
+// Like readAll, but also gives up once the deadline has passed.
+bool readBefore(int fd, char* p, std::size_t n,
+                std::chrono::steady_clock::time_point deadline) {
+  while (n > 0) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now())
+                    .count();
+    if (left <= 0) return false;
+    pollfd pfd{fd, POLLIN, 0};
+    auto ready = poll(&pfd, 1, static_cast<int>(left));
+    if (ready < 0 && errno == EINTR) continue;
+    if (ready <= 0) return false;
+    auto got = read(fd, p, n);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) return false;
+    p += got;
+    n -= static_cast<std::size_t>(got);
+  }
+  return true;
+}
+
+bool writeAll(int fd, const char* p, std::size_t n) {
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+  while (n > 0) {
+    auto sent = send(fd, p, n, flags);
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent <= 0) return false;
+    p += sent;
+    n -= static_cast<std::size_t>(sent);
+  }
+  return true;
+}
+
+bool address(const std::string& path, sockaddr_un& addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+  std::memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
+
+int connectTo(const std::string& path) {
+  sockaddr_un addr;
+  if (!address(path, addr)) return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+#endif
+}  // namespace
+
+CompileServer::CompileServer(const std::string& path, std::size_t threads,
+                             std::chrono::milliseconds timeout)
+    : _path(path),
+      _listener(-1),
+      _timeout(timeout),
+      _wake{-1, -1},
+      _stopping(false),
+      _pool(threads),
+      _mutex(),
+      _connections(),
+      _idle() {
+#if !defined(_WIN32)
+  sockaddr_un addr;
+  if (!address(path, addr)) return;
+  // A socket left behind by a server that is gone is in the way of bind,
+  // but one that still answers belongs to someone else.
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    int fd = connectTo(path);
+    if (fd >= 0) {
+      close(fd);
+      return;
+    }
+    unlink(path.c_str());
+  }
+  // Neither end blocks: a full pipe already means Serve() will wake up.
+  if (pipe(_wake) != 0) {
+    _wake[0] = _wake[1] = -1;
+    return;
+  }
+  for (auto end : _wake) fcntl(end, F_SETFL, fcntl(end, F_GETFL) | O_NONBLOCK);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return;
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 128) != 0) {
+    close(fd);
+    return;
+  }
+  _listener = fd;
+#endif
+}
+
+CompileServer::~CompileServer() {
+#if !defined(_WIN32)
+  Stop();
+  _pool.Wait();
+  for (auto fd : _connections) close(fd);
+  if (_listener >= 0) {
+    close(_listener);
+    unlink(_path.c_str());
+  }
+  for (auto end : _wake)
+    if (end >= 0) close(end);
+#endif
+}
+
+void CompileServer::Serve() {
+#if !defined(_WIN32)
+  if (Bad()) return;
+  std::vector<pollfd> fds;
+  // Only Stop() ends the loop; until then every failure is waited out.
+  auto resume = std::chrono::steady_clock::now();
+  while (!_stopping) {
+    auto now = std::chrono::steady_clock::now();
+    int wait = -1;
+    // A connection that could not be accepted is still pending, so the
+    // listener is left out of the poll for a while instead of spinning.
+    if (now < resume)
+      wait = static_cast<int>(
+          std::chrono::ceil<std::chrono::milliseconds>(resume - now).count());
+    fds.clear();
+    fds.push_back(pollfd{wait < 0 ? _listener : -1, POLLIN, 0});
+    fds.push_back(pollfd{_wake[0], POLLIN, 0});
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (auto fd : _idle) fds.push_back(pollfd{fd, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), wait) < 0) {
+      if (errno != EINTR) std::this_thread::sleep_for(BACKOFF);
+      continue;
+    }
+    if (fds[1].revents != 0) {
+      char drain[64];
+      while (read(_wake[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+
+    // A connection is only handed to the pool once a request has started
+    // to arrive, and for that one request.
+    for (std::size_t i = 2; i < fds.size(); i++) {
+      if (fds[i].revents == 0) continue;
+      auto fd = fds[i].fd;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _idle.erase(fd);
+      }
+      _pool.Submit([this, fd]() { release(fd, handle(fd)); });
+    }
+
+    if (fds[0].revents == 0) continue;
+    int fd = accept(_listener, nullptr, nullptr);
+    if (fd < 0) {
+      // EMFILE, ENFILE, ENOBUFS and ENOMEM last until something is closed.
+      if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN)
+        resume = std::chrono::steady_clock::now() + BACKOFF;
+      continue;
+    }
+    // A client that does not read its reply cannot hold a thread either.
+    timeval limit{};
+    limit.tv_sec = static_cast<time_t>(_timeout.count() / 1000);
+    limit.tv_usec = static_cast<suseconds_t>(_timeout.count() % 1000 * 1000);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Stop() may have come between accept and here.
+    if (_stopping) {
+      close(fd);
+      break;
+    }
+    _connections.insert(fd);
+    _idle.insert(fd);
+  }
+  _pool.Wait();
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto fd : _idle) {
+    _connections.erase(fd);
+    close(fd);
+  }
+  _idle.clear();
+#endif
+}
+
+void CompileServer::Stop() {
+#if !defined(_WIN32)
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_stopping.exchange(true)) return;
+  // Wakes up poll and every read that is waiting for the rest of a request.
+  if (_wake[1] >= 0) {
+    auto woken = write(_wake[1], "", 1);
+    (void)woken;
+  }
+  if (_listener >= 0) shutdown(_listener, SHUT_RDWR);
+  for (auto fd : _connections) shutdown(fd, SHUT_RDWR);
+#endif
+}
+
+bool CompileServer::handle(int fd) {
+#if !defined(_WIN32)
+  // Kept for each pool thread, so that their storage is reused.
+  thread_local std::string source;
+  thread_local std::string reply;
+  thread_local std::ostringstream out;
+  thread_local std::ostringstream err;
+  auto deadline = std::chrono::steady_clock::now() + _timeout;
+  char header[protocol::RequestHeaderSize];
+  if (!readBefore(fd, header, sizeof(header), deadline)) return false;
+  auto action = static_cast<uint8_t>(header[0]);
+  auto level = static_cast<uint8_t>(header[1]);
+  auto engine = static_cast<uint8_t>(header[2]);
+  auto size = detail::GetLittle(header + 4);
+  if (action > static_cast<uint8_t>(Action::EMIT_BINARY) || level > 2 ||
+      engine >= ENGINE_COUNT || header[3] != 0 || size > protocol::MaxSource)
+    return false;
+  // The buffer grows with what has arrived, at most doubling each time,
+  // rather than taking the length in the header on trust.
+  source.clear();
+  while (source.size() < size) {
+    auto old = source.size();
+    auto chunk = std::min<std::size_t>(
+        size - old, std::max<std::size_t>(old, READ_CHUNK));
+    source.resize(old + chunk);
+    if (!readBefore(fd, source.data() + old, chunk, deadline)) return false;
+  }
+
+  CompileOptions options;
+  options.action = static_cast<Action>(action);
+  options.level = level;
+  options.engine = ENGINES[engine];
+  out.str("");
+  err.str("");
+  // The identifiers go into an interner of the request's own, which is
+  // gone again once it is answered.
+  auto status = miniplc0::Compile(SourceBuffer(source), options, out, err);
+  // One huge request does not pin its buffer to the thread for good.
+  if (source.capacity() > KEPT_BUFFER) std::string().swap(source);
+
+  auto o = out.str();
+  auto e = err.str();
+  reply.clear();
+  reply += static_cast<char>(status);
+  reply.append(3, '\0');
+  detail::PutLittle(reply, static_cast<uint32_t>(o.size()));
+  detail::PutLittle(reply, static_cast<uint32_t>(e.size()));
+  reply += o;
+  reply += e;
+  auto sent = writeAll(fd, reply.data(), reply.size());
+  if (reply.capacity() > KEPT_BUFFER) std::string().swap(reply);
+  return sent;
+#else
+  (void)fd;
+  return false;
+#endif
+}
+
+void CompileServer::release(int fd, bool keep) {
+#if !defined(_WIN32)
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (keep && !_stopping) {
+    _idle.insert(fd);
+    // Serve() has to poll this connection again.
+    auto woken = write(_wake[1], "", 1);
+    (void)woken;
+    return;
+  }
+  _connections.erase(fd);
+  close(fd);
+#else
+  (void)fd;
+  (void)keep;
+#endif
+}
+
+CompileClient::CompileClient(const std::string& path) : _fd(-1), _buffer() {
+#if !defined(_WIN32)
+  _fd = connectTo(path);
+#else
+  (void)path;
+#endif
+}
+
+CompileClient::~CompileClient() {
+#if !defined(_WIN32)
+  if (_fd >= 0) close(_fd);
+#endif
+}
+
+std::optional<CompileReply> CompileClient::Compile(
+    std::string_view source, const CompileOptions& options) {
+#if !defined(_WIN32)
+  if (Bad() || source.size() > protocol::MaxSource) return {};
+  auto engine = ENGINE_COUNT;
+  for (uint8_t i = 0; i < ENGINE_COUNT; i++)
+    if (options.engine == ENGINES[i]) engine = i;
+  if (engine == ENGINE_COUNT) return {};
+
+  _buffer.clear();
+  _buffer += static_cast<char>(options.action);
+  _buffer += static_cast<char>(options.level);
+  _buffer += static_cast<char>(engine);
+  _buffer += '\0';
+  detail::PutLittle(_buffer, static_cast<uint32_t>(source.size()));
+  _buffer.append(source.data(), source.size());
+  if (!writeAll(_fd, _buffer.data(), _buffer.size())) return {};
+
+  char header[protocol::ReplyHeaderSize];
+  if (!readAll(_fd, header, sizeof(header))) return {};
+  auto status = static_cast<uint8_t>(header[0]);
+  if (status > static_cast<uint8_t>(CompileStatus::FAILED)) return {};
+  CompileReply reply{static_cast<CompileStatus>(status), "", ""};
+  reply.out.resize(detail::GetLittle(header + 4));
+  reply.err.resize(detail::GetLittle(header + 8));
+  if (!readAll(_fd, reply.out.data(), reply.out.size()) ||
+      !readAll(_fd, reply.err.data(), reply.err.size()))
+    return {};
+  return reply;
+#else
+  (void)source;
+  (void)options;
+  return {};
+#endif
+}
+}  // namespace miniplc0
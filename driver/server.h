@@ -0,0 +1,107 @@
+#pragma once
+
+#include "driver/compiler.h"
+#include "driver/thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+
+namespace miniplc0 {
+
+// 编译服务器和客户端之间的协议
+//
+// 一个连接上可以依次发送任意多个请求，每个请求对应一个回复，整数都是小端：
+//   请求  u8 action  u8 level  u8 engine  u8 0  u32 长度  源码
+//   回复  u8 status  u8 0  u8 0  u8 0  u32 out 的长度  u32 err 的长度  out  err
+// action status 是 Action 和 CompileStatus 的值，engine 是 stack register jit
+// 的下标。out 和 err 就是在本地 Compile 时写进两个流的内容。
+// 格式不对的请求会让服务器关掉这个连接。
+namespace protocol {
+constexpr std::size_t RequestHeaderSize = 8;
+constexpr std::size_t ReplyHeaderSize = 12;
+// 单个请求的源码最多这么长
+constexpr std::uint32_t MaxSource = 256u << 20;
+// 服务器收到一个请求的第一个字节以后，最多等这么久来收完整个请求，
+// 写回复也最多等这么久，超时就断开这个连接
+constexpr std::chrono::milliseconds RequestTimeout{10000};
+}  // namespace protocol
+
+// 常驻的编译服务器，监听一个 Unix domain socket
+//
+// Serve() 用 poll 等着所有空闲的连接，哪个连接上来了请求，就把这一个请求
+// 交给线程池处理，回复之后连接再回到空闲的连接里。线程只在处理请求时被
+// 占用，空闲或者很慢的客户端不会挡住别人；请求的源码也是收到多少才分配
+// 多少，不会按请求头里的长度先分配。
+// 进程一直活着，省掉了每次启动进程的开销，各个线程的缓冲区在请求之间
+// 复用；标识符放在每个请求自己的 Interner 里，请求处理完就释放，所以常驻的
+// 内存不会随着客户端发来的标识符增长。
+// 只支持有 Unix domain socket 的平台，其他平台上 Bad() 总是真。
+class CompileServer final {
+ public:
+  // 监听 path，path 上已有的 socket 文件如果没有人在用，会被删掉
+  // threads 为 0 时每个核一个线程
+  explicit CompileServer(
+      const std::string& path, std::size_t threads = 0,
+      std::chrono::milliseconds timeout = protocol::RequestTimeout);
+  CompileServer(const CompileServer&) = delete;
+  CompileServer& operator=(CompileServer) = delete;
+  // 删掉 socket 文件
+  ~CompileServer();
+
+  // 没能开始监听
+  bool Bad() const { return _listener < 0; }
+
+  // 接受连接并处理请求，直到 Stop()；返回之前会等所有连接处理完
+  // 文件描述符或者内存用完时暂停接受新连接一会儿，不会因此返回
+  void Serve();
+  // 让 Serve() 返回，正在处理的连接也会被断开，可以在任何线程调用
+  void Stop();
+
+ private:
+  // 处理连接上的一个请求，返回连接是否还能接着用
+  bool handle(int fd);
+  // 请求处理完以后把连接放回空闲的连接里，或者关掉
+  void release(int fd, bool keep);
+
+ private:
+  std::string _path;
+  int _listener;
+  std::chrono::milliseconds _timeout;
+  // 往 _wake[1] 写一个字节让 Serve() 从 poll 里醒过来
+  int _wake[2];
+  std::atomic<bool> _stopping;
+  ThreadPool _pool;
+  std::mutex _mutex;
+  // 所有打开的连接，Stop() 时把它们都断开
+  std::set<int> _connections;
+  // 没有请求正在处理的连接，Serve() 等着它们发来请求
+  std::set<int> _idle;
+};
+
+// 编译服务器的客户端
+class CompileClient final {
+ public:
+  explicit CompileClient(const std::string& path);
+  CompileClient(const CompileClient&) = delete;
+  CompileClient& operator=(CompileClient) = delete;
+  ~CompileClient();
+
+  // 没能连上服务器
+  bool Bad() const { return _fd < 0; }
+
+  // 让服务器处理 source，连接断开或者回复的格式不对时返回空
+  std::optional<CompileReply> Compile(std::string_view source,
+                                      const CompileOptions& options);
+
+ private:
+  int _fd;
+  std::string _buffer;
+};
+}  // namespace miniplc0
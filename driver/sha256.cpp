@@ -0,0 +1,116 @@
+#include "driver/sha256.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace miniplc0 {
+
+namespace {
+using uint32_t = std::uint32_t;
+
+constexpr uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+}  // namespace
+
+Sha256::Sha256()
+    : _state({0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f,
+              0x9b05688c, 0x1f83d9ab, 0x5be0cd19}),
+      _buffer(),
+      _buffered(0),
+      _length(0) {}
+
+void Sha256::Update(std::string_view data) {
+  auto p = reinterpret_cast<const uint8_t*>(data.data());
+  auto n = data.size();
+  _length += n;
+  if (_buffered != 0) {
+    auto take = std::min(n, _buffer.size() - _buffered);
+    std::memcpy(_buffer.data() + _buffered, p, take);
+    _buffered += take;
+    p += take;
+    n -= take;
+    if (_buffered < _buffer.size()) return;
+    block(_buffer.data());
+    _buffered = 0;
+  }
+  // Whole blocks straight from the input.
+  for (; n >= 64; p += 64, n -= 64) block(p);
+  std::memcpy(_buffer.data(), p, n);
+  _buffered = n;
+}
+
+Sha256::Digest Sha256::Final() {
+  auto bits = _length * 8;
+  uint8_t pad[72] = {0x80};
+  auto padding = (_buffered < 56 ? 56 : 120) - _buffered;
+  for (int i = 0; i < 8; i++)
+    pad[padding + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+  Update(std::string_view(reinterpret_cast<const char*>(pad), padding + 8));
+  Digest digest;
+  for (std::size_t i = 0; i < 8; i++)
+    for (std::size_t j = 0; j < 4; j++)
+      digest[i * 4 + j] = static_cast<uint8_t>(_state[i] >> (24 - 8 * j));
+  return digest;
+}
+
+std::string Sha256::Hex(const Digest& digest) {
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+  for (auto b : digest) {
+    s += digits[b >> 4];
+    s += digits[b & 0xf];
+  }
+  return s;
+}
+
+void Sha256::block(const uint8_t* p) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+    w[i] = static_cast<uint32_t>(p[4 * i]) << 24 |
+           static_cast<uint32_t>(p[4 * i + 1]) << 16 |
+           static_cast<uint32_t>(p[4 * i + 2]) << 8 | p[4 * i + 3];
+  for (int i = 16; i < 64; i++) {
+    auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  auto a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+  auto e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+  for (int i = 0; i < 64; i++) {
+    auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+    auto ch = (e & f) ^ (~e & g);
+    auto t1 = h + s1 + ch + K[i] + w[i];
+    auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+    auto maj = (a & b) ^ (a & c) ^ (b & c);
+    auto t2 = s0 + maj;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  _state[0] += a;
+  _state[1] += b;
+  _state[2] += c;
+  _state[3] += d;
+  _state[4] += e;
+  _state[5] += f;
+  _state[6] += g;
+  _state[7] += h;
+}
+}  // namespace miniplc0
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace miniplc0 {
+
+// SHA-256，给编译缓存算内容的摘要用
+class Sha256 final {
+ private:
+  using uint8_t = std::uint8_t;
+  using uint32_t = std::uint32_t;
+  using uint64_t = std::uint64_t;
+
+ public:
+  using Digest = std::array<uint8_t, 32>;
+
+  Sha256();
+
+  void Update(std::string_view data);
+  // 之后不能再 Update
+  Digest Final();
+
+  // 摘要的十六进制表示，64 个小写字符
+  static std::string Hex(const Digest& digest);
+
+ private:
+  void block(const uint8_t* p);
+
+ private:
+  std::array<uint32_t, 8> _state;
+  std::array<uint8_t, 64> _buffer;
+  std::size_t _buffered;
+  uint64_t _length;
+};
+}  // namespace miniplc0
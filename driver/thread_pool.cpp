@@ -0,0 +1,105 @@
+#include "driver/thread_pool.h"
+
+#include <utility>
+
+namespace miniplc0 {
+
+namespace {
+// Which pool the current thread works for, and its index there, so that
+// tasks submitted from a task stay on the thread that made them.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local std::size_t current_index = 0;
+}  // namespace
+
+ThreadPool::ThreadPool(std::size_t threads)
+    : _queues(),
+      _threads(),
+      _queued(0),
+      _pending(0),
+      _next(0),
+      _stop(false) {
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  for (std::size_t i = 0; i < threads; i++)
+    _queues.push_back(std::make_unique<Queue>());
+  for (std::size_t i = 0; i < threads; i++)
+    _threads.emplace_back([this, i]() { work(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (auto& t : _threads) t.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  std::size_t to;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending++;
+    if (current_pool == this)
+      to = current_index;
+    else
+      to = _next++ % _queues.size();
+  }
+  {
+    std::lock_guard<std::mutex> lock(_queues[to]->mutex);
+    _queues[to]->tasks.push_back(std::move(task));
+  }
+  {
+    // Counted only once it can be taken, so a woken thread finds it.
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queued++;
+  }
+  _wake.notify_one();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _idle.wait(lock, [this]() { return _pending == 0; });
+}
+
+bool ThreadPool::take(std::size_t me, std::function<void()>& task) {
+  for (std::size_t i = 0; i < _queues.size(); i++) {
+    auto& q = *_queues[(me + i) % _queues.size()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) continue;
+    if (i == 0) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    } else {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::work(std::size_t me) {
+  current_pool = this;
+  current_index = me;
+  while (true) {
+    std::function<void()> task;
+    if (take(me, task)) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queued--;
+      }
+      task();
+      // Destroy whatever the task holds before it counts as done.
+      task = nullptr;
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (--_pending == 0) _idle.notify_all();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    _wake.wait(lock, [this]() { return _stop || _queued > 0; });
+    if (_stop && _queued == 0) return;
+  }
+}
+}  // namespace miniplc0
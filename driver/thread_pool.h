@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace miniplc0 {
+
+// 用工作窃取调度任务的线程池
+//
+// 每个线程有自己的任务队列，从队尾取自己的任务，自己的队列空了就从别的
+// 线程的队首偷一个。任务轮流分给各个线程，在任务里提交的新任务放进当前
+// 线程自己的队列。任务的耗时差别很大时（比如编译大小不一的文件），
+// 先做完的线程会去分担别人剩下的任务。
+class ThreadPool final {
+ public:
+  // threads 为 0 时用 std::thread::hardware_concurrency() 个线程
+  explicit ThreadPool(std::size_t threads = 0);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(ThreadPool) = delete;
+  // 等所有任务做完再退出
+  ~ThreadPool();
+
+  std::size_t Size() const { return _threads.size(); }
+
+  // 任务不能抛出异常
+  void Submit(std::function<void()> task);
+  // 等到已经提交的任务，以及它们提交的任务，全都做完
+  void Wait();
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void work(std::size_t me);
+  // 先取自己队尾的任务，再按顺序偷别的队列队首的任务
+  bool take(std::size_t me, std::function<void()>& task);
+
+ private:
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::vector<std::thread> _threads;
+
+  // 下面的都由 _mutex 保护
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _idle;
+  // 还在队列里的任务
+  std::size_t _queued;
+  // 已经提交但还没做完的任务
+  std::size_t _pending;
+  // 下一个任务分给哪个线程
+  std::size_t _next;
+  bool _stop;
+};
+}  // namespace miniplc0
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+namespace miniplc0 {
+
+// 在编译时计算 lhs op rhs，op 是 ADD SUB MUL DIV 之一
+// 虚拟机执行这条运算会出错（溢出或者除以零）时返回空，这样的运算要留到运行时
+inline std::optional<std::int32_t> Evaluate(Operation op, std::int32_t lhs,
+                                            std::int32_t rhs) {
+  std::int64_t r;
+  switch (op) {
+    case Operation::ADD:
+      r = static_cast<std::int64_t>(lhs) + rhs;
+      break;
+    case Operation::SUB:
+      r = static_cast<std::int64_t>(lhs) - rhs;
+      break;
+    case Operation::MUL:
+      r = static_cast<std::int64_t>(lhs) * rhs;
+      break;
+    case Operation::DIV:
+      if (rhs == 0) return {};
+      r = static_cast<std::int64_t>(lhs) / rhs;
+      break;
+    default:
+      return {};
+  }
+  if (r < std::numeric_limits<std::int32_t>::min() ||
+      r > std::numeric_limits<std::int32_t>::max())
+    return {};
+  return static_cast<std::int32_t>(r);
+}
+}  // namespace miniplc0
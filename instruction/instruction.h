@@ -1,47 +1,75 @@
-#pragma once
-
-#include <cstdint>
-#include <utility>
-
-namespace miniplc0 {
-
-enum Operation { ILL = 0, LIT, LOD, STO, ADD, SUB, MUL, DIV, WRT };
-
-class Instruction final {
-private:
-  using int32_t = std::int32_t;
-
-public:
-  friend void swap(Instruction &lhs, Instruction &rhs);
-
-public:
-  Instruction(Operation opr, int32_t x) : _opr(opr), _x(x) {}
-
-  Instruction() : Instruction(Operation::ILL, 0) {}
-  Instruction(const Instruction &i) {
-    _opr = i._opr;
-    _x = i._x;
-  }
-  Instruction(Instruction &&i) : Instruction() { swap(*this, i); }
-  Instruction &operator=(Instruction i) {
-    swap(*this, i);
-    return *this;
-  }
-  bool operator==(const Instruction &i) const {
-    return _opr == i._opr && _x == i._x;
-  }
-
-  Operation GetOperation() const { return _opr; }
-  int32_t GetX() const { return _x; }
-
-private:
-  Operation _opr;
-  int32_t _x;
-};
-
-inline void swap(Instruction &lhs, Instruction &rhs) {
-  using std::swap;
-  swap(lhs._opr, rhs._opr);
-  swap(lhs._x, rhs._x);
-}
-} // namespace miniplc0
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+namespace miniplc0 {
+
+enum Operation {
+  ILL = 0,
+  LIT,
+  LOD,
+  STO,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  WRT,
+  // 以下是 FuseInstructions 合并出来的超级指令，分析器不会生成它们
+  // 栈顶和立即数 x 运算：LIT x; ADD
+  ADDI,
+  SUBI,
+  MULI,
+  DIVI,
+  // 栈顶和栈上 x 处的值运算：LOD x; ADD
+  LODADD,
+  LODSUB,
+  LODMUL,
+  LODDIV,
+  // 栈顶取负：LIT 0; <factor>; SUB
+  NEG,
+  // 运算的结果直接存进 x：ADD; STO x
+  ADDSTO,
+  SUBSTO,
+  MULSTO,
+  DIVSTO
+};
+
+class Instruction final {
+private:
+  using int32_t = std::int32_t;
+
+public:
+  friend void swap(Instruction &lhs, Instruction &rhs);
+
+public:
+  Instruction(Operation opr, int32_t x) : _opr(opr), _x(x) {}
+
+  Instruction() : Instruction(Operation::ILL, 0) {}
+  Instruction(const Instruction &i) {
+    _opr = i._opr;
+    _x = i._x;
+  }
+  Instruction(Instruction &&i) : Instruction() { swap(*this, i); }
+  Instruction &operator=(Instruction i) {
+    swap(*this, i);
+    return *this;
+  }
+  bool operator==(const Instruction &i) const {
+    return _opr == i._opr && _x == i._x;
+  }
+
+  Operation GetOperation() const { return _opr; }
+  int32_t GetX() const { return _x; }
+
+private:
+  Operation _opr;
+  int32_t _x;
+};
+
+inline void swap(Instruction &lhs, Instruction &rhs) {
+  using std::swap;
+  swap(lhs._opr, rhs._opr);
+  swap(lhs._x, rhs._x);
+}
+} // namespace miniplc0
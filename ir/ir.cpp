@@ -0,0 +1,42 @@
+#include "ir/ir.h"
+
+namespace miniplc0::ir {
+
+std::vector<Instruction> Program::Lower() const {
+  std::vector<Instruction> out;
+  // Every node turns into exactly one instruction.
+  out.reserve(_exprs.size() + _stmts.size());
+  for (auto& stmt : _stmts) {
+    lower(stmt.value, out);
+    switch (stmt.kind) {
+      case Stmt::DECLARE:
+        // The value is already where the new slot lives.
+        break;
+      case Stmt::STORE:
+        out.emplace_back(Operation::STO, stmt.slot);
+        break;
+      case Stmt::PRINT:
+        out.emplace_back(Operation::WRT, 0);
+        break;
+    }
+  }
+  return out;
+}
+
+void Program::lower(ExprId id, std::vector<Instruction>& out) const {
+  auto& e = _exprs[id];
+  switch (e.kind) {
+    case Expr::LITERAL:
+      out.emplace_back(Operation::LIT, e.value);
+      break;
+    case Expr::LOAD:
+      out.emplace_back(Operation::LOD, e.value);
+      break;
+    case Expr::BINARY:
+      lower(e.lhs, out);
+      lower(e.rhs, out);
+      out.emplace_back(e.op, 0);
+      break;
+  }
+}
+}  // namespace miniplc0::ir
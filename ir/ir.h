@@ -0,0 +1,101 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace miniplc0::ir {
+
+// 表达式在 Program 中的编号
+using ExprId = std::uint32_t;
+
+// 表达式树的节点
+// 所有节点都放在 Program 的一个数组里，子节点用编号引用
+struct Expr {
+  enum Kind : std::uint8_t {
+    LITERAL,  // value 是字面量的值
+    LOAD,     // value 是读取的栈上位置
+    BINARY    // op 是 ADD SUB MUL DIV 之一，lhs 和 rhs 是两个操作数
+  };
+
+  Kind kind;
+  Operation op;
+  std::int32_t value;
+  ExprId lhs;
+  ExprId rhs;
+};
+
+// 语句
+struct Stmt {
+  enum Kind : std::uint8_t {
+    DECLARE,  // 把 value 的值放在栈上新的位置 slot，也就是栈顶
+    STORE,    // 把 value 的值存进 slot
+    PRINT     // 输出 value 的值，slot 没有意义
+  };
+
+  Kind kind;
+  std::int32_t slot;
+  ExprId value;
+};
+
+// 分析器生成的中间表示
+//
+// miniplc0 的程序没有跳转，所以整个程序就是一串语句；
+// 表达式是树，各条语句的表达式之间不共享节点。
+// 取负 -x 和分析器生成的代码一样表示成 0 - x。
+class Program final {
+ private:
+  using int32_t = std::int32_t;
+
+ public:
+  Program() : _exprs(), _stmts(), _slots(0) {}
+
+  ExprId Literal(int32_t value) {
+    return add(Expr{Expr::LITERAL, Operation::ILL, value, 0, 0});
+  }
+  ExprId Load(int32_t slot) {
+    return add(Expr{Expr::LOAD, Operation::ILL, slot, 0, 0});
+  }
+  ExprId Binary(Operation op, ExprId lhs, ExprId rhs) {
+    return add(Expr{Expr::BINARY, op, 0, lhs, rhs});
+  }
+
+  // 在栈上声明一个新的位置，返回它的编号
+  int32_t Declare(ExprId value) {
+    _stmts.push_back(Stmt{Stmt::DECLARE, _slots, value});
+    return _slots++;
+  }
+  void Store(int32_t slot, ExprId value) {
+    _stmts.push_back(Stmt{Stmt::STORE, slot, value});
+  }
+  void Print(ExprId value) {
+    _stmts.push_back(Stmt{Stmt::PRINT, 0, value});
+  }
+
+  Expr& operator[](ExprId id) { return _exprs[id]; }
+  const Expr& operator[](ExprId id) const { return _exprs[id]; }
+
+  // 优化时可以直接修改语句，但要保证 DECLARE 的 slot 依次是 0, 1, 2...
+  std::vector<Stmt>& Statements() { return _stmts; }
+  const std::vector<Stmt>& Statements() const { return _stmts; }
+  // 声明过的栈上位置的个数
+  int32_t SlotCount() const { return _slots; }
+  void SetSlotCount(int32_t slots) { _slots = slots; }
+
+  // 生成指令，没有经过优化的 Program 得到的指令和分析器直接生成的完全一样
+  std::vector<Instruction> Lower() const;
+
+ private:
+  ExprId add(const Expr& e) {
+    _exprs.push_back(e);
+    return static_cast<ExprId>(_exprs.size() - 1);
+  }
+  void lower(ExprId id, std::vector<Instruction>& out) const;
+
+ private:
+  std::vector<Expr> _exprs;
+  std::vector<Stmt> _stmts;
+  int32_t _slots;
+};
+}  // namespace miniplc0::ir
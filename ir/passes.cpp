@@ -0,0 +1,422 @@
+#include "ir/passes.h"
+
+#include "instruction/evaluate.h"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+
+namespace miniplc0::ir {
+
+namespace {
+using int32_t = std::int32_t;
+using uint64_t = std::uint64_t;
+
+void renumberLoads(Program& program, ExprId id,
+                   const std::vector<int32_t>& remap) {
+  auto& e = program[id];
+  if (e.kind == Expr::LOAD) e.value = remap[e.value];
+  if (e.kind != Expr::BINARY) return;
+  renumberLoads(program, e.lhs, remap);
+  renumberLoads(program, e.rhs, remap);
+}
+
+// Calls f with the slot of every load in the tree.
+template <typename F>
+void forEachLoad(const Program& program, ExprId id, F&& f) {
+  auto& e = program[id];
+  if (e.kind == Expr::LOAD) f(e.value);
+  if (e.kind != Expr::BINARY) return;
+  forEachLoad(program, e.lhs, f);
+  forEachLoad(program, e.rhs, f);
+}
+
+// Whether the VM could trap while evaluating the tree. Only operations on
+// two literals are known not to.
+bool mayTrap(const Program& program, ExprId id) {
+  auto& e = program[id];
+  if (e.kind != Expr::BINARY) return false;
+  auto& lhs = program[e.lhs];
+  auto& rhs = program[e.rhs];
+  if (lhs.kind == Expr::LITERAL && rhs.kind == Expr::LITERAL)
+    return !Evaluate(e.op, lhs.value, rhs.value).has_value();
+  return true;
+}
+
+class ConstantFolding final : public Pass {
+ public:
+  std::string_view Name() const override { return "fold"; }
+
+  void Run(Program& program) override {
+    // Straight-line code: after each statement, every slot either holds a
+    // value known here or it does not.
+    std::vector<std::optional<int32_t>> known(program.SlotCount());
+    for (auto& stmt : program.Statements()) {
+      fold(program, stmt.value, known);
+      if (stmt.kind == Stmt::PRINT) continue;
+      auto& value = program[stmt.value];
+      if (value.kind == Expr::LITERAL)
+        known[stmt.slot] = value.value;
+      else
+        known[stmt.slot].reset();
+    }
+  }
+
+ private:
+  // Rewrites nodes in place, which is fine since no node is shared.
+  static void fold(Program& program, ExprId id,
+                   const std::vector<std::optional<int32_t>>& known) {
+    auto& e = program[id];
+    if (e.kind == Expr::LOAD) {
+      if (known[e.value].has_value()) {
+        e.kind = Expr::LITERAL;
+        e.value = known[e.value].value();
+      }
+      return;
+    }
+    if (e.kind != Expr::BINARY) return;
+    fold(program, e.lhs, known);
+    fold(program, e.rhs, known);
+    auto& lhs = program[e.lhs];
+    auto& rhs = program[e.rhs];
+    if (lhs.kind != Expr::LITERAL || rhs.kind != Expr::LITERAL) return;
+    auto r = Evaluate(e.op, lhs.value, rhs.value);
+    if (!r.has_value()) return;
+    e.kind = Expr::LITERAL;
+    e.value = r.value();
+  }
+};
+
+class CommonSubexpressionElimination final : public Pass {
+ public:
+  std::string_view Name() const override { return "cse"; }
+
+  void Run(Program& program) override {
+    // Temporaries are declared between statements, which moves every slot
+    // declared after them.
+    std::vector<int32_t> remap(program.SlotCount());
+    int32_t slots = 0;
+    std::vector<Stmt> out;
+    out.reserve(program.Statements().size());
+    for (auto stmt : program.Statements()) {
+      renumberLoads(program, stmt.value, remap);
+      if (stmt.kind == Stmt::STORE) stmt.slot = remap[stmt.slot];
+      // Each round hoists one subexpression, which can make another one
+      // the first thing the statement computes.
+      while (auto hoisted = hoist(program, stmt.value, slots)) {
+        out.push_back(Stmt{Stmt::DECLARE, slots, hoisted.value()});
+        slots++;
+      }
+      if (stmt.kind == Stmt::DECLARE) {
+        remap[stmt.slot] = slots;
+        stmt.slot = slots++;
+      }
+      out.push_back(stmt);
+    }
+    program.Statements() = std::move(out);
+    program.SetSlotCount(slots);
+  }
+
+ private:
+  // A BINARY node seen while walking a statement in evaluation order.
+  struct Seen {
+    ExprId id;
+    uint64_t hash;
+    // Operations that complete before this one starts.
+    std::size_t before;
+    std::size_t size;
+  };
+
+  // Walks the tree in evaluation order. Returns the node's hash and size,
+  // and counts the operations it completes in done.
+  static std::pair<uint64_t, std::size_t> walk(const Program& program,
+                                               ExprId id, std::size_t& done,
+                                               std::vector<Seen>& seen) {
+    auto& e = program[id];
+    uint64_t h = (static_cast<uint64_t>(e.kind) << 40) ^
+                 (static_cast<uint64_t>(e.op) << 32) ^
+                 static_cast<std::uint32_t>(e.value);
+    if (e.kind != Expr::BINARY) return {h * 0x9e3779b97f4a7c15ULL, 1};
+    std::size_t before = done;
+    auto lhs = walk(program, e.lhs, done, seen);
+    auto rhs = walk(program, e.rhs, done, seen);
+    h = (h ^ lhs.first) * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (rhs.first >> 7) ^ (rhs.first << 3)) * 0xff51afd7ed558ccdULL;
+    std::size_t size = lhs.second + rhs.second + 1;
+    seen.push_back(Seen{id, h, before, size});
+    done++;
+    return {h, size};
+  }
+
+  static bool same(const Program& program, ExprId a, ExprId b) {
+    auto& x = program[a];
+    auto& y = program[b];
+    if (x.kind != y.kind || x.op != y.op || x.value != y.value) return false;
+    if (x.kind != Expr::BINARY) return true;
+    return same(program, x.lhs, y.lhs) && same(program, x.rhs, y.rhs);
+  }
+
+  // Points every occurrence of pattern under id, except id itself, at a
+  // load of slot.
+  static void replace(Program& program, ExprId id, ExprId pattern,
+                      int32_t slot) {
+    if (program[id].kind != Expr::BINARY) return;
+    for (auto child : {program[id].lhs, program[id].rhs}) {
+      if (same(program, child, pattern)) {
+        auto load = program.Load(slot);
+        auto& e = program[id];
+        (child == e.lhs ? e.lhs : e.rhs) = load;
+      } else {
+        replace(program, child, pattern, slot);
+      }
+    }
+  }
+
+  // Finds the largest subexpression that occurs twice in the tree and is
+  // the first operation evaluated, replaces it with a load of slot, and
+  // returns the subexpression.
+  static std::optional<ExprId> hoist(Program& program, ExprId root,
+                                     int32_t slot) {
+    std::vector<Seen> seen;
+    std::size_t done = 0;
+    walk(program, root, done, seen);
+    // Operations seen so far by hash, in evaluation order.
+    std::unordered_map<uint64_t, std::vector<const Seen*>> groups;
+    const Seen* best = nullptr;
+    for (auto& s : seen) {
+      auto& group = groups[s.hash];
+      for (auto first : group) {
+        if (!same(program, first->id, s.id)) continue;
+        if (first->before == 0 && (best == nullptr || first->size > best->size))
+          best = first;
+        break;
+      }
+      group.push_back(&s);
+    }
+    if (best == nullptr) return {};
+    auto pattern = best->id;
+    replace(program, root, pattern, slot);
+    return pattern;
+  }
+};
+
+class DeadStoreElimination final : public Pass {
+ public:
+  std::string_view Name() const override { return "dse"; }
+
+  void Run(Program& program) override {
+    // Removing a store can leave the slots it read unused, and the other
+    // way round, so go until neither finds anything.
+    while (removeUnusedSlots(program) | removeDeadStores(program)) {
+    }
+  }
+
+ private:
+  // Drops slots that are never read and never written by anything that can
+  // trap, with every statement that writes them.
+  static bool removeUnusedSlots(Program& program) {
+    auto& stmts = program.Statements();
+    std::vector<bool> needed(program.SlotCount(), false);
+    for (auto& stmt : stmts) {
+      forEachLoad(program, stmt.value,
+                  [&](int32_t slot) { needed[slot] = true; });
+      if (stmt.kind != Stmt::PRINT && mayTrap(program, stmt.value))
+        needed[stmt.slot] = true;
+    }
+
+    std::vector<int32_t> remap(needed.size(), -1);
+    int32_t slots = 0;
+    for (std::size_t i = 0; i < needed.size(); i++)
+      if (needed[i]) remap[i] = slots++;
+    if (slots == program.SlotCount()) return false;
+
+    std::vector<Stmt> out;
+    out.reserve(stmts.size());
+    for (auto stmt : stmts) {
+      if (stmt.kind != Stmt::PRINT) {
+        if (remap[stmt.slot] < 0) continue;
+        stmt.slot = remap[stmt.slot];
+      }
+      renumberLoads(program, stmt.value, remap);
+      out.push_back(stmt);
+    }
+    stmts = std::move(out);
+    program.SetSlotCount(slots);
+    return true;
+  }
+
+  // Drops stores that are overwritten or never read before the end, and
+  // turns dead initial values into a literal. Slots stay as they are.
+  static bool removeDeadStores(Program& program) {
+    auto& stmts = program.Statements();
+    std::vector<bool> live(program.SlotCount(), false);
+    std::vector<bool> removed(stmts.size(), false);
+    bool changed = false;
+    auto gen = [&](int32_t slot) { live[slot] = true; };
+    for (std::size_t i = stmts.size(); i-- > 0;) {
+      auto& stmt = stmts[i];
+      if (stmt.kind == Stmt::PRINT) {
+        forEachLoad(program, stmt.value, gen);
+        continue;
+      }
+      bool dead = !live[stmt.slot] && !mayTrap(program, stmt.value);
+      if (dead && stmt.kind == Stmt::STORE) {
+        removed[i] = true;
+        changed = true;
+        continue;
+      }
+      if (dead && program[stmt.value].kind != Expr::LITERAL) {
+        // The slot itself is still needed by a later store.
+        stmt.value = program.Literal(0);
+        changed = true;
+      }
+      live[stmt.slot] = false;
+      forEachLoad(program, stmt.value, gen);
+    }
+    if (!changed) return false;
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < stmts.size(); i++)
+      if (!removed[i]) stmts[kept++] = stmts[i];
+    stmts.resize(kept);
+    return true;
+  }
+};
+
+class SlotAllocation final : public Pass {
+ public:
+  std::string_view Name() const override { return "alloc"; }
+
+  void Run(Program& program) override {
+    inlineConstants(program);
+    allocate(program);
+  }
+
+ private:
+  // Replaces loads of slots that only ever hold their literal initial value,
+  // and drops those slots.
+  static void inlineConstants(Program& program) {
+    auto& stmts = program.Statements();
+    std::vector<std::optional<int32_t>> constant(program.SlotCount());
+    for (auto& stmt : stmts)
+      if (stmt.kind == Stmt::DECLARE &&
+          program[stmt.value].kind == Expr::LITERAL)
+        constant[stmt.slot] = program[stmt.value].value;
+    for (auto& stmt : stmts)
+      if (stmt.kind == Stmt::STORE) constant[stmt.slot].reset();
+
+    std::vector<int32_t> remap(constant.size(), -1);
+    int32_t slots = 0;
+    for (std::size_t i = 0; i < constant.size(); i++)
+      if (!constant[i].has_value()) remap[i] = slots++;
+    if (slots == program.SlotCount()) return;
+
+    std::vector<Stmt> out;
+    out.reserve(stmts.size());
+    for (auto stmt : stmts) {
+      if (stmt.kind != Stmt::PRINT) {
+        if (remap[stmt.slot] < 0) continue;
+        stmt.slot = remap[stmt.slot];
+      }
+      substitute(program, stmt.value, constant, remap);
+      out.push_back(stmt);
+    }
+    stmts = std::move(out);
+    program.SetSlotCount(slots);
+  }
+
+  static void substitute(Program& program, ExprId id,
+                         const std::vector<std::optional<int32_t>>& constant,
+                         const std::vector<int32_t>& remap) {
+    auto& e = program[id];
+    if (e.kind == Expr::LOAD) {
+      if (constant[e.value].has_value()) {
+        e.kind = Expr::LITERAL;
+        e.value = constant[e.value].value();
+      } else {
+        e.value = remap[e.value];
+      }
+    }
+    if (e.kind != Expr::BINARY) return;
+    substitute(program, e.lhs, constant, remap);
+    substitute(program, e.rhs, constant, remap);
+  }
+
+  // Linear scan over the statements. A slot is free again once the statement
+  // that last reads or writes its variable has started: a declaration that
+  // reads the variable computes its value before storing it.
+  static void allocate(Program& program) {
+    auto& stmts = program.Statements();
+    std::vector<std::size_t> last(program.SlotCount(), 0);
+    for (std::size_t i = 0; i < stmts.size(); i++) {
+      forEachLoad(program, stmts[i].value,
+                  [&](int32_t slot) { last[slot] = i; });
+      if (stmts[i].kind != Stmt::PRINT) last[stmts[i].slot] = i;
+    }
+
+    using Live = std::pair<std::size_t, int32_t>;
+    std::priority_queue<Live, std::vector<Live>, std::greater<Live>> live;
+    // Lowest first, to keep the stack short and the variables close.
+    std::priority_queue<int32_t, std::vector<int32_t>, std::greater<int32_t>>
+        free;
+    std::vector<int32_t> assigned(program.SlotCount());
+    int32_t slots = 0;
+    for (std::size_t i = 0; i < stmts.size(); i++) {
+      auto& stmt = stmts[i];
+      renumberLoads(program, stmt.value, assigned);
+      if (stmt.kind == Stmt::STORE) stmt.slot = assigned[stmt.slot];
+      if (stmt.kind != Stmt::DECLARE) continue;
+      while (!live.empty() && live.top().first <= i) {
+        free.push(live.top().second);
+        live.pop();
+      }
+      int32_t slot;
+      if (free.empty()) {
+        slot = slots++;
+      } else {
+        slot = free.top();
+        free.pop();
+        stmt.kind = Stmt::STORE;
+      }
+      live.push({last[stmt.slot], slot});
+      assigned[stmt.slot] = slot;
+      stmt.slot = slot;
+    }
+    program.SetSlotCount(slots);
+  }
+};
+}  // namespace
+
+std::unique_ptr<Pass> MakeConstantFolding() {
+  return std::make_unique<ConstantFolding>();
+}
+
+std::unique_ptr<Pass> MakeCommonSubexpressionElimination() {
+  return std::make_unique<CommonSubexpressionElimination>();
+}
+
+std::unique_ptr<Pass> MakeDeadStoreElimination() {
+  return std::make_unique<DeadStoreElimination>();
+}
+
+std::unique_ptr<Pass> MakeSlotAllocation() {
+  return std::make_unique<SlotAllocation>();
+}
+
+PassManager PassManager::ForLevel(int level) {
+  PassManager pm;
+  if (level >= 1) pm.Add(MakeConstantFolding());
+  if (level >= 2) pm.Add(MakeCommonSubexpressionElimination());
+  if (level >= 1) pm.Add(MakeDeadStoreElimination());
+  if (level >= 1) pm.Add(MakeSlotAllocation());
+  return pm;
+}
+
+std::vector<std::string_view> PassManager::Names() const {
+  std::vector<std::string_view> names;
+  for (auto& pass : _passes) names.push_back(pass->Name());
+  return names;
+}
+}  // namespace miniplc0::ir
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ir/ir.h"
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace miniplc0::ir {
+
+// 对 Program 的一遍优化
+// 优化前后程序的输出必须一样；会出错的程序出错的种类也必须一样，
+// 但出错的指令的下标可以不同
+class Pass {
+ public:
+  virtual ~Pass() = default;
+  virtual std::string_view Name() const = 0;
+  virtual void Run(Program& program) = 0;
+};
+
+// 常量折叠和常量传播
+// 记住每条语句之后值已知的栈上位置，把对它们的读取换成字面量，
+// 再把操作数都是字面量并且不会出错的运算算出来
+std::unique_ptr<Pass> MakeConstantFolding();
+
+// 公共子表达式消除
+// 一条语句里重复出现的运算提前算到一个新声明的栈上位置里，之后都从那里读取。
+// 只在这样做不会改变出错的种类时才提前：第一次出现之前不能有别的运算
+std::unique_ptr<Pass> MakeCommonSubexpressionElimination();
+
+// 死存储和无用变量消除
+// 从来不被读取的变量连同它的声明和所有赋值一起删掉，之后的栈上位置依次前移；
+// 之后不会再被读取的赋值也删掉。只删除不会出错的计算，可能出错的赋值即使
+// 结果没有用也保留
+std::unique_ptr<Pass> MakeDeadStoreElimination();
+
+// 栈上位置分配
+// 只在声明时赋值过一个字面量的常量和变量直接换成字面量，不再占位置；
+// 其它变量在最后一次用到之后，它的位置可以给之后声明的变量用，
+// 这时那个变量的声明变成一次赋值
+std::unique_ptr<Pass> MakeSlotAllocation();
+
+// 依次执行一组 Pass
+class PassManager final {
+ public:
+  PassManager() : _passes() {}
+  PassManager(PassManager&&) = default;
+  PassManager& operator=(PassManager&&) = default;
+
+  // -O 对应的一组 Pass
+  // 0：不优化
+  // 1：常量折叠，死存储消除，栈上位置分配
+  // 2：常量折叠，公共子表达式消除，死存储消除，栈上位置分配
+  static PassManager ForLevel(int level);
+
+  PassManager& Add(std::unique_ptr<Pass> pass) {
+    _passes.push_back(std::move(pass));
+    return *this;
+  }
+  void Run(Program& program) const {
+    for (auto& pass : _passes) pass->Run(program);
+  }
+  std::vector<std::string_view> Names() const;
+
+ private:
+  std::vector<std::unique_ptr<Pass>> _passes;
+};
+}  // namespace miniplc0::ir
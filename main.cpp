@@ -1,99 +1,377 @@
-#include "3rd_party/argparse/include/argparse/argparse.hpp"
-#include "fmt/core.h"
-
-#include "tokenizer/tokenizer.h"
-#include "analyser/analyser.h"
-#include "fmts.hpp"
-
-#include <iostream>
-#include <fstream>
-
-std::vector<miniplc0::Token> _tokenize(std::istream& input) {
-  miniplc0::Tokenizer tkz(input);
-  auto p = tkz.AllTokens();
-  if (p.second.has_value()) {
-    fmt::print(stderr, "Tokenization error: {}\n", p.second.value());
-    exit(0);
-  }
-  return p.first;
-}
-
-void Tokenize(std::istream& input, std::ostream& output) {
-  auto v = _tokenize(input);
-  for (auto& it : v) output << fmt::format("{}\n", it);
-  return;
-}
-
-void Analyse(std::istream& input, std::ostream& output) {
-  auto tks = _tokenize(input);
-  miniplc0::Analyser analyser(tks);
-  auto p = analyser.Analyse();
-  if (p.second.has_value()) {
-    fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
-    exit(0);
-  }
-  auto v = p.first;
-  for (auto& it : v) output << fmt::format("{}\n", it);
-  return;
-}
-
-int main(int argc, char** argv) {
-  argparse::ArgumentParser program("miniplc0");
-  program.add_argument("input").help("speicify the file to be compiled.");
-  program.add_argument("-t").default_value(false).implicit_value(true).help(
-      "perform tokenization for the input file.");
-  program.add_argument("-l").default_value(false).implicit_value(true).help(
-      "perform syntactic analysis for the input file.");
-  program.add_argument("-o", "--output")
-      .required()
-      .default_value(std::string("-"))
-      .help("specify the output file.");
-
-  try {
-    program.parse_args(argc, argv);
-  } catch (const std::runtime_error& err) {
-    fmt::print(stderr, "{}\n\n", err.what());
-    program.print_help();
-    exit(2);
-  }
-
-  auto input_file = program.get<std::string>("input");
-  auto output_file = program.get<std::string>("--output");
-  std::istream* input;
-  std::ostream* output;
-  std::ifstream inf;
-  std::ofstream outf;
-  if (input_file != "-") {
-    inf.open(input_file, std::ios::in);
-    if (!inf) {
-      fmt::print(stderr, "Fail to open {} for reading.\n", input_file);
-      exit(2);
-    }
-    input = &inf;
-  } else
-    input = &std::cin;
-  if (output_file != "-") {
-    outf.open(output_file, std::ios::out | std::ios::trunc);
-    if (!outf) {
-      fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
-      exit(2);
-    }
-    output = &outf;
-  } else
-    output = &std::cout;
-  if (program["-t"] == true && program["-l"] == true) {
-    fmt::print(
-        stderr,
-        "You can only perform tokenization or syntactic analysis at one time.");
-    exit(2);
-  }
-  if (program["-t"] == true) {
-    Tokenize(*input, *output);
-  } else if (program["-l"] == true) {
-    Analyse(*input, *output);
-  } else {
-    fmt::print(stderr, "You must choose tokenization or syntactic analysis.");
-    exit(2);
-  }
-  return 0;
-}
+#include "3rd_party/argparse/include/argparse/argparse.hpp"
+#include "fmt/core.h"
+
+#include "tokenizer/tokenizer.h"
+#include "driver/batch.h"
+#include "driver/cache.h"
+#include "driver/compiler.h"
+#include "driver/lsp.h"
+#include "driver/server.h"
+#include "vm/jit.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+// A non-negative number given to option, with at most digits digits.
+std::size_t _count(const std::string& option, const std::string& value,
+                   std::size_t digits) {
+  if (value.empty() || value.size() > digits ||
+      value.find_first_not_of("0123456789") != std::string::npos) {
+    fmt::print(stderr, "Invalid value {} for {}.\n", value, option);
+    exit(2);
+  }
+  return std::stoul(value);
+}
+
+// Identifies this build of the compiler by the size and time of its
+// executable, so that rebuilding it invalidates what older builds cached.
+std::string _identity(const char* argv0) {
+  std::error_code ec;
+  auto exe = std::filesystem::canonical("/proc/self/exe", ec);
+  if (ec) exe = std::filesystem::absolute(argv0, ec);
+  auto size = std::filesystem::file_size(exe, ec);
+  auto time = std::filesystem::last_write_time(exe, ec);
+  return fmt::format("{} {}", size, time.time_since_epoch().count());
+}
+
+void ShowCacheStats(const std::string& dir, std::ostream& output) {
+  auto stats = miniplc0::CompileCache::Load(dir);
+  auto lookups = stats.hits + stats.misses;
+  output << fmt::format("hits: {}\nmisses: {}\n", stats.hits, stats.misses);
+  if (lookups != 0)
+    output << fmt::format("hit rate: {:.1f}%\n",
+                          100.0 * static_cast<double>(stats.hits) /
+                              static_cast<double>(lookups));
+  output << fmt::format(
+      "stores: {}\nevictions: {}\nentries: {}\nbytes: {}\n", stats.stores,
+      stats.evictions, stats.entries, stats.bytes);
+}
+
+// Compiles every file named by input, a directory or a manifest with one
+// file per line, on a pool of threads. Errors are reported for each file in
+// the order of the inputs, once everything is done.
+int Batch(const std::string& input, const std::string& output_dir,
+          const miniplc0::CompileOptions& options, std::size_t threads,
+          miniplc0::CompileCache* cache) {
+  std::vector<miniplc0::BatchJob> jobs;
+  std::error_code ec;
+  if (input == "-") {
+    jobs = miniplc0::ReadManifest(std::cin, output_dir, options.action);
+  } else if (std::filesystem::is_directory(input, ec)) {
+    auto listed = miniplc0::ListDirectory(input, output_dir, options.action);
+    if (!listed.has_value()) {
+      fmt::print(stderr, "Fail to read the directory {}.\n", input);
+      exit(2);
+    }
+    jobs = std::move(listed.value());
+  } else {
+    std::ifstream manifest(input);
+    if (!manifest) {
+      fmt::print(stderr, "Fail to open {} for reading.\n", input);
+      exit(2);
+    }
+    jobs = miniplc0::ReadManifest(manifest, output_dir, options.action);
+  }
+
+  miniplc0::ThreadPool pool(threads);
+  auto results = miniplc0::RunBatch(jobs, options, pool, cache);
+  std::size_t failed = 0;
+  for (std::size_t i = 0; i < jobs.size(); i++) {
+    if (results[i].status == miniplc0::CompileStatus::OK) continue;
+    failed++;
+    fmt::print(stderr, "{}: {}", jobs[i].input, results[i].errors);
+  }
+  if (failed != 0) {
+    fmt::print(stderr, "{} of {} files failed.\n", failed, jobs.size());
+    return 1;
+  }
+  return 0;
+}
+
+// Runs until SIGINT or SIGTERM, which stop the server properly so that the
+// socket file is removed.
+int Serve(const std::string& path, std::size_t threads) {
+#if defined(_WIN32)
+  (void)threads;
+  fmt::print(stderr, "Fail to listen on {}: no Unix domain sockets here.\n",
+             path);
+  exit(2);
+#else
+  // Blocked before the pool starts, so that only the waiter gets them.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  miniplc0::CompileServer server(path, threads);
+  if (server.Bad()) {
+    fmt::print(stderr, "Fail to listen on {}.\n", path);
+    exit(2);
+  }
+  std::thread waiter([&]() {
+    int sig;
+    sigwait(&signals, &sig);
+    server.Stop();
+  });
+  server.Serve();
+  // Serve may also return on its own, with the waiter still waiting.
+  pthread_kill(waiter.native_handle(), SIGTERM);
+  waiter.join();
+  return 0;
+#endif
+}
+
+// Sends the input to a server started with --serve, and prints the reply as
+// if it had been compiled here.
+int Connect(const std::string& path, const miniplc0::SourceBuffer& input,
+            const miniplc0::CompileOptions& options, std::ostream& output) {
+  miniplc0::CompileClient client(path);
+  if (client.Bad()) {
+    fmt::print(stderr, "Fail to connect to {}.\n", path);
+    exit(2);
+  }
+  auto reply = client.Compile(input.View(), options);
+  if (!reply.has_value()) {
+    fmt::print(stderr, "Lost the connection to {}.\n", path);
+    exit(2);
+  }
+  output << reply.value().out;
+  output.flush();
+  std::cerr << reply.value().err;
+  return 0;
+}
+
+// Talks to an editor over stdin and stdout until it says exit.
+int Lsp(const std::string& input) {
+  if (input != "-") {
+    fmt::print(stderr,
+               "The language server talks over stdin and stdout, so the input "
+               "should be -.\n");
+    exit(2);
+  }
+  std::ios::sync_with_stdio(false);
+  miniplc0::LanguageServer server(std::cin, std::cout);
+  return server.Run();
+}
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser program("miniplc0");
+  program.add_argument("input").help("speicify the file to be compiled.");
+  program.add_argument("-t").default_value(false).implicit_value(true).help(
+      "perform tokenization for the input file.");
+  program.add_argument("-l").default_value(false).implicit_value(true).help(
+      "perform syntactic analysis for the input file.");
+  program.add_argument("-r").default_value(false).implicit_value(true).help(
+      "compile the input file and run it.");
+  program.add_argument("--emit")
+      .default_value(std::string(""))
+      .help(
+          "translate the input file into a standalone C program (c) or a "
+          "compact binary that -r accepts in place of source (bin).");
+  program.add_argument("-o", "--output")
+      .required()
+      .default_value(std::string("-"))
+      .help("specify the output file.");
+  // Separate flags, since this argparse cannot take a value glued to -O.
+  program.add_argument("-O0").default_value(false).implicit_value(true).help(
+      "do not optimize (default).");
+  program.add_argument("-O1").default_value(false).implicit_value(true).help(
+      "fold constants, remove dead stores and reuse stack slots.");
+  program.add_argument("-O2").default_value(false).implicit_value(true).help(
+      "like -O1, and eliminate common subexpressions.");
+  program.add_argument("--lexer")
+      .default_value(std::string("auto"))
+      .help("scan with scalar, sse2 or avx2 code, or the fastest one (auto).");
+  program.add_argument("--vm")
+      .default_value(std::string("stack"))
+      .help(
+          "run -r on the stack machine, the register machine (register) or "
+          "as native code (jit).");
+  program.add_argument("--batch")
+      .default_value(false)
+      .implicit_value(true)
+      .help(
+          "compile every file in the input directory, or listed one per line "
+          "in the input file (- for stdin), into the output directory. Exits "
+          "with 1 if any file fails.");
+  program.add_argument("-j", "--jobs")
+      .default_value(std::string("0"))
+      .help(
+          "use this many threads for --batch and --serve, or one per core "
+          "(0).");
+  program.add_argument("--serve")
+      .default_value(false)
+      .implicit_value(true)
+      .help("serve compilations on the Unix domain socket named by input.");
+  program.add_argument("--connect")
+      .default_value(std::string(""))
+      .help("have the server listening on this socket do the work.");
+  program.add_argument("--cache")
+      .default_value(std::string(""))
+      .help(
+          "reuse results cached in this directory for identical inputs, and "
+          "cache new ones.");
+  program.add_argument("--cache-size")
+      .default_value(std::string("256"))
+      .help("keep the cache under this many MiB.");
+  program.add_argument("--cache-stats")
+      .default_value(false)
+      .implicit_value(true)
+      .help("print the statistics of the cache directory named by input.");
+  program.add_argument("--lsp")
+      .default_value(false)
+      .implicit_value(true)
+      .help(
+          "run a language server giving diagnostics to editors, on stdin and "
+          "stdout. The input should be -.");
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    fmt::print(stderr, "{}\n\n", err.what());
+    program.print_help();
+    exit(2);
+  }
+
+  auto input_file = program.get<std::string>("input");
+  auto output_file = program.get<std::string>("--output");
+  auto lexer = program.get<std::string>("--lexer");
+  auto vm = program.get<std::string>("--vm");
+  if (vm != "stack" && vm != "register" && vm != "jit") {
+    fmt::print(stderr, "Unknown vm {}.\n", vm);
+    exit(2);
+  }
+  if (lexer != "auto") {
+    auto engine = miniplc0::ParseScanEngine(lexer);
+    if (!engine.has_value()) {
+      fmt::print(stderr, "Unknown lexer {}.\n", lexer);
+      exit(2);
+    }
+    if (!miniplc0::Scanner::IsSupported(engine.value()))
+      fmt::print(stderr, "{} is not supported here, falling back to scalar.\n",
+                 lexer);
+    miniplc0::Scanner::SetDefault(engine.value());
+  }
+  auto threads = _count("--jobs", program.get<std::string>("--jobs"), 4);
+  auto cache_size = static_cast<std::uint64_t>(
+      _count("--cache-size", program.get<std::string>("--cache-size"), 7));
+  bool batch = program["--batch"] == true;
+  auto connect = program.get<std::string>("--connect");
+  auto cache_dir = program.get<std::string>("--cache");
+  if ((program["--serve"] == true) + batch + (connect != "") +
+          (program["--cache-stats"] == true) + (program["--lsp"] == true) >
+      1) {
+    fmt::print(stderr,
+               "You can only serve, compile a batch, connect to a server, run "
+               "a language server or print cache statistics at one time.");
+    exit(2);
+  }
+  if (program["--serve"] == true) return Serve(input_file, threads);
+  if (program["--lsp"] == true) return Lsp(input_file);
+  if (program["--cache-stats"] == true) {
+    ShowCacheStats(input_file, std::cout);
+    return 0;
+  }
+  auto emit = program.get<std::string>("--emit");
+  std::optional<miniplc0::SourceBuffer> input;
+  std::ostream* output = &std::cout;
+  std::ofstream outf;
+  if (batch) {
+    // Both name directories or manifests, which Batch opens itself.
+  } else if (input_file != "-") {
+    input = miniplc0::SourceBuffer::FromFile(input_file);
+    if (!input.has_value()) {
+      fmt::print(stderr, "Fail to open {} for reading.\n", input_file);
+      exit(2);
+    }
+  } else if (connect != "" || cache_dir != "") {
+    // The whole input goes to the server in one request, or is hashed.
+    input = miniplc0::SourceBuffer::FromStream(std::cin);
+  } else {
+    // Let std::cin buffer on its own so that reading a line from a pipe does
+    // not go through stdio one character at a time.
+    std::ios::sync_with_stdio(false);
+    input = miniplc0::SourceBuffer::Streaming(std::cin);
+  }
+  if (output_file != "-" && !batch) {
+    auto mode = std::ios::out | std::ios::trunc;
+    if (emit == "bin") mode |= std::ios::binary;
+    outf.open(output_file, mode);
+    if (!outf) {
+      fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
+      exit(2);
+    }
+    output = &outf;
+  }
+  miniplc0::CompileOptions options;
+  if ((program["-O0"] == true) + (program["-O1"] == true) +
+          (program["-O2"] == true) >
+      1) {
+    fmt::print(stderr, "You can only choose one optimization level.");
+    exit(2);
+  }
+  if (program["-O1"] == true) options.level = 1;
+  if (program["-O2"] == true) options.level = 2;
+  options.engine = vm;
+  if (emit != "" && emit != "c" && emit != "bin") {
+    fmt::print(stderr, "Unknown emit target {}.\n", emit);
+    exit(2);
+  }
+  if ((program["-t"] == true) + (program["-l"] == true) +
+          (program["-r"] == true) + (emit != "") >
+      1) {
+    fmt::print(stderr,
+               "You can only perform tokenization, syntactic analysis, "
+               "running or emitting at one time.");
+    exit(2);
+  }
+  if (program["-t"] == true) {
+    options.action = miniplc0::Action::TOKENIZE;
+  } else if (program["-l"] == true) {
+    options.action = miniplc0::Action::ANALYSE;
+  } else if (program["-r"] == true) {
+    options.action = miniplc0::Action::RUN;
+    if (vm == "jit" && !miniplc0::JitProgram::IsSupported())
+      fmt::print(stderr,
+                 "jit is not supported here, falling back to register.\n");
+  } else if (emit == "c") {
+    options.action = miniplc0::Action::EMIT_C;
+  } else if (emit == "bin") {
+    options.action = miniplc0::Action::EMIT_BINARY;
+  } else {
+    fmt::print(stderr,
+               "You must choose tokenization, syntactic analysis, running or "
+               "emitting.");
+    exit(2);
+  }
+
+  if (connect != "") return Connect(connect, input.value(), options, *output);
+  std::optional<miniplc0::CompileCache> cache;
+  if (cache_dir != "") {
+    cache.emplace(cache_dir, _identity(argv[0]), cache_size << 20);
+    if (cache.value().Bad()) {
+      fmt::print(stderr, "Fail to use {} as the cache.\n", cache_dir);
+      exit(2);
+    }
+  }
+  auto cached = cache.has_value() ? &cache.value() : nullptr;
+  if (batch)
+    return Batch(input_file, output_file == "-" ? "" : output_file, options,
+                 threads, cached);
+  if (cached != nullptr)
+    cached->Compile(std::move(input.value()), options, *output, std::cerr);
+  else
+    miniplc0::Compile(std::move(input.value()), options, *output, std::cerr);
+  return 0;
+}
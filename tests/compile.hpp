@@ -0,0 +1,23 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "instruction/instruction.h"
+#include "tokenizer/tokenizer.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+// Compiles a program the tests expect to be free of errors.
+inline std::vector<miniplc0::Instruction> compile(const std::string& input) {
+  std::stringstream ss(input);
+  miniplc0::Tokenizer lexer(ss);
+  auto tokens = lexer.AllTokens();
+  REQUIRE_FALSE(tokens.second.has_value());
+  miniplc0::Analyser parser(tokens.first);
+  auto result = parser.Analyse();
+  REQUIRE_FALSE(result.second.has_value());
+  return result.first;
+}
@@ -0,0 +1,258 @@
+#include "analyser/analyser.h"
+#include "bytes.hpp"
+#include "codegen/binary.h"
+#include "codegen/c.h"
+#include "instruction/instruction.h"
+#include "tokenizer/tokenizer.h"
+#include "vm/vm.h"
+
+#include <climits>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fmt/core.h"
+#include "fmts.hpp"
+#include "compile.hpp"
+#include "catch2/catch.hpp"
+
+namespace {
+using miniplc0::Instruction;
+using miniplc0::Operation;
+namespace fs = std::filesystem;
+using miniplc0::detail::ReadFile;
+
+bool haveCompiler() {
+  static bool have = std::system("cc --version > /dev/null 2>&1") == 0;
+  return have;
+}
+
+// Builds the generated C with the system compiler, runs it, and checks that
+// it prints exactly what -r would, runtime errors included.
+void runC(const std::vector<Instruction>& code) {
+  auto dir = fs::temp_directory_path() / "miniplc0_test_codegen";
+  fs::create_directories(dir);
+  auto source = dir / "program.c";
+  auto binary = dir / "program";
+  auto out = dir / "stdout";
+  auto err = dir / "stderr";
+  {
+    std::ofstream f(source);
+    miniplc0::EmitC(code, f, [](miniplc0::RuntimeErrorCode c) {
+      return fmt::format("{}", c);
+    });
+  }
+  auto build = "cc -O1 -o " + binary.string() + " " + source.string();
+  REQUIRE(std::system(build.c_str()) == 0);
+  auto run = binary.string() + " > " + out.string() + " 2> " + err.string();
+  REQUIRE(std::system(run.c_str()) == 0);
+
+  auto expected = miniplc0::VirtualMachine(code).Run();
+  std::string expected_out, expected_err;
+  for (auto v : expected.first) expected_out += fmt::format("{}\n", v);
+  if (expected.second.has_value())
+    expected_err =
+        fmt::format("Runtime error: {}\n", expected.second.value());
+  REQUIRE(ReadFile(out) == expected_out);
+  REQUIRE(ReadFile(err) == expected_err);
+}
+}  // namespace
+
+TEST_CASE("Generated C behaves like the VM") {
+  if (!haveCompiler()) {
+    WARN("No C compiler found as cc, skipping.");
+    return;
+  }
+  std::vector<std::vector<Instruction>> programs = {
+      compile("begin end"),
+      compile("begin const a = 7; var b = a * a - 3; var c; c = b / -a;"
+              "print(c); print(-2147483647 - 1); b = c * (b + a);"
+              "print(b); end"),
+      compile("begin print(1); print(2147483647 + 1); print(2); end"),
+      compile("begin var a = -2147483647; print(a - 2); end"),
+      compile("begin var a = 65536; print(a * a); end"),
+      compile("begin var a = 0; print(3); print(1 / a); end"),
+      {Instruction(Operation::LIT, INT_MIN), Instruction(Operation::LIT, -1),
+       Instruction(Operation::DIV, 0)},
+      {Instruction(Operation::LIT, 1), Instruction(Operation::WRT, 0),
+       Instruction(Operation::ILL, 0), Instruction(Operation::WRT, 0)},
+      // Misuses the stack, so nothing runs at all.
+      {Instruction(Operation::LIT, 1), Instruction(Operation::WRT, 0),
+       Instruction(Operation::WRT, 0)},
+  };
+  // Long enough to be split across functions.
+  std::string many = "begin var a = 0;";
+  for (int i = 0; i < 5000; i++) many += "a = a + " + std::to_string(i) + ";";
+  programs.push_back(compile(many + "print(a); end"));
+
+  for (auto& code : programs) {
+    INFO(code.size());
+    runC(code);
+  }
+}
+
+TEST_CASE("Generated C for random programs behaves like the VM") {
+  if (!haveCompiler()) {
+    WARN("No C compiler found as cc, skipping.");
+    return;
+  }
+  std::mt19937 rng(20191203);
+  auto pick = [&](int n) {
+    return std::uniform_int_distribution<int>(0, n - 1)(rng);
+  };
+  const int32_t values[] = {0, 1, -1, 2, 3, 7, 100, 46341, 65536, INT_MAX};
+  // Every build takes a while, so a few programs with many statements.
+  for (int round = 0; round < 12; round++) {
+    std::vector<Instruction> code;
+    int vars = 1 + pick(4);
+    for (int i = 0; i < vars; i++)
+      code.emplace_back(Operation::LIT, values[pick(10)]);
+    for (int stmt = 0; stmt < 40; stmt++) {
+      int depth = 0;
+      int ops = 1 + pick(6);
+      for (int i = 0; i < ops || depth > 1; i++) {
+        if (depth < 2 || (i < ops && pick(2) == 0)) {
+          if (pick(2) == 0)
+            code.emplace_back(Operation::LIT, values[pick(10)]);
+          else
+            code.emplace_back(Operation::LOD, pick(vars));
+          depth++;
+        } else {
+          code.emplace_back(static_cast<Operation>(Operation::ADD + pick(4)),
+                            0);
+          depth--;
+        }
+      }
+      if (pick(2) == 0)
+        code.emplace_back(Operation::WRT, 0);
+      else
+        code.emplace_back(Operation::STO, pick(vars));
+    }
+    runC(code);
+  }
+}
+
+namespace {
+std::string emitBinary(const std::vector<Instruction>& code) {
+  std::stringstream ss;
+  miniplc0::EmitBinary(code, ss);
+  return ss.str();
+}
+}  // namespace
+
+TEST_CASE("Binary programs decode to the same instructions") {
+  std::vector<std::vector<Instruction>> programs = {
+      {},
+      compile("begin end"),
+      compile("begin const a = 7; var b = a * a - 3; var c; c = b / -a;"
+              "print(c); print(-2147483647 - 1); b = c * (b + a);"
+              "print(b); end"),
+      // Every operation, the superinstructions included.
+      {Instruction(Operation::ILL, 0), Instruction(Operation::LIT, INT_MIN),
+       Instruction(Operation::LIT, INT_MAX), Instruction(Operation::LOD, 1),
+       Instruction(Operation::STO, 0), Instruction(Operation::ADD, 0),
+       Instruction(Operation::SUB, 0), Instruction(Operation::MUL, 0),
+       Instruction(Operation::DIV, 0), Instruction(Operation::WRT, 0),
+       Instruction(Operation::ADDI, -1), Instruction(Operation::SUBI, 64),
+       Instruction(Operation::MULI, -65),
+       Instruction(Operation::DIVI, 1 << 20),
+       Instruction(Operation::LODADD, 2), Instruction(Operation::LODSUB, 3),
+       Instruction(Operation::LODMUL, 4), Instruction(Operation::LODDIV, 5),
+       Instruction(Operation::NEG, 0), Instruction(Operation::ADDSTO, 6),
+       Instruction(Operation::SUBSTO, 7), Instruction(Operation::MULSTO, 8),
+       Instruction(Operation::DIVSTO, 9)},
+  };
+  // Large literals that repeat go through the constant pool.
+  std::mt19937 rng(20191204);
+  std::vector<Instruction> pooled;
+  for (int i = 0; i < 2000; i++)
+    pooled.emplace_back(Operation::LIT,
+                        std::uniform_int_distribution<int32_t>(
+                            INT_MIN, INT_MAX)(rng) %
+                            (i % 2 == 0 ? 1000 : 300));
+  for (int i = 0; i < 200; i++) {
+    pooled.emplace_back(Operation::LIT, 123456789);
+    pooled.emplace_back(Operation::LIT, -70000 - i % 3);
+  }
+  programs.push_back(pooled);
+
+  for (auto& code : programs) {
+    INFO(code.size());
+    auto bytes = emitBinary(code);
+    REQUIRE(miniplc0::IsBinary(bytes));
+    auto decoded = miniplc0::DecodeBinary(bytes);
+    REQUIRE(decoded.has_value());
+    REQUIRE(decoded.value() == code);
+  }
+
+  // The pooled literals take one index byte after the first time.
+  auto bytes = emitBinary(pooled);
+  REQUIRE(bytes.size() <
+          miniplc0::binary::HeaderSize + 2000 * 3 + 400 * 2 + 16);
+
+  // Much smaller than the listing -l prints.
+  std::string listing;
+  for (auto& it : programs[2]) listing += fmt::format("{}\n", it);
+  REQUIRE(emitBinary(programs[2]).size() * 2 < listing.size());
+}
+
+TEST_CASE("Corrupt binary programs are rejected") {
+  auto code = compile(
+      "begin const a = 100000; var b = a * a; var c = a + a;"
+      "print(b / c); print(a); end");
+  auto good = emitBinary(code);
+  REQUIRE(miniplc0::DecodeBinary(good).has_value());
+
+  SECTION("truncated anywhere") {
+    for (std::size_t n = 0; n < good.size(); n++) {
+      INFO(n);
+      REQUIRE_FALSE(miniplc0::DecodeBinary(good.substr(0, n)).has_value());
+    }
+  }
+  SECTION("trailing bytes") {
+    REQUIRE_FALSE(miniplc0::DecodeBinary(good + '\0').has_value());
+  }
+  SECTION("header") {
+    auto patched = [&](std::size_t at, char ch) {
+      auto bytes = good;
+      bytes[at] = ch;
+      return miniplc0::DecodeBinary(bytes);
+    };
+    REQUIRE_FALSE(patched(0, 'X').has_value());
+    // version and flags
+    REQUIRE_FALSE(patched(4, 2).has_value());
+    REQUIRE_FALSE(patched(6, 1).has_value());
+    // More instructions or constants than there are bytes.
+    REQUIRE_FALSE(patched(11, '\x7f').has_value());
+    REQUIRE_FALSE(patched(15, '\x7f').has_value());
+  }
+  SECTION("instructions") {
+    auto at = miniplc0::binary::HeaderSize;
+    auto withFirst = [&](std::string first) {
+      // The header of a one instruction program without a pool, followed
+      // by the given bytes as that instruction.
+      std::vector<Instruction> one = {Instruction(Operation::LIT, 0)};
+      auto bytes = emitBinary(one);
+      return miniplc0::DecodeBinary(bytes.substr(0, at) + first);
+    };
+    REQUIRE(withFirst("\x01") ==
+            std::make_optional(std::vector<Instruction>{
+                Instruction(Operation::LIT, 0)}));
+    // An operation past the last one.
+    REQUIRE_FALSE(withFirst("\x1f").has_value());
+    // A mode that does not exist.
+    REQUIRE_FALSE(withFirst("\x61\x01").has_value());
+    // An index into a pool that is not there.
+    REQUIRE_FALSE(withFirst("\x41\x00").has_value());
+    // A varint longer than five bytes, or one that overflows 32 bits.
+    REQUIRE_FALSE(withFirst("\x21\x80\x80\x80\x80\x80\x00").has_value());
+    REQUIRE_FALSE(withFirst("\x21\xff\xff\xff\xff\x1f").has_value());
+    REQUIRE(withFirst("\x21\xfe\xff\xff\xff\x0f") ==
+            std::make_optional(std::vector<Instruction>{
+                Instruction(Operation::LIT, INT_MAX)}));
+  }
+}
@@ -0,0 +1,699 @@
+#include "bytes.hpp"
+#include "driver/batch.h"
+#include "driver/cache.h"
+#include "driver/compiler.h"
+#include "driver/json.h"
+#include "driver/lsp.h"
+#include "driver/server.h"
+#include "driver/sha256.h"
+#include "driver/thread_pool.h"
+#include "tokenizer/interner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+using miniplc0::Action;
+using miniplc0::CompileStatus;
+namespace fs = std::filesystem;
+using miniplc0::detail::ReadFile;
+
+std::pair<CompileStatus, std::pair<std::string, std::string>> compile(
+    const std::string& source, Action action, int level = 0) {
+  miniplc0::CompileOptions options;
+  options.action = action;
+  options.level = level;
+  std::ostringstream out, err;
+  auto status = miniplc0::Compile(miniplc0::SourceBuffer(source), options,
+                                  out, err);
+  return std::make_pair(status, std::make_pair(out.str(), err.str()));
+}
+
+void write(const fs::path& path, const std::string& content) {
+  fs::create_directories(path.parent_path());
+  std::ofstream(path) << content;
+}
+}  // namespace
+
+TEST_CASE("Each compile numbers its own symbols") {
+  auto global = miniplc0::Interner::Global().Size();
+  auto result = compile(
+      "begin var onlyinthistest = 1; print(onlyinthistest); end", Action::RUN);
+  REQUIRE(result.first == CompileStatus::OK);
+  REQUIRE(result.second.first == "1\n");
+  REQUIRE(miniplc0::Interner::Global().Size() == global);
+}
+
+TEST_CASE("Every task submitted to the thread pool runs once") {
+  for (std::size_t threads : {1, 2, 8}) {
+    miniplc0::ThreadPool pool(threads);
+    REQUIRE(pool.Size() == threads);
+    std::vector<std::atomic<int>> runs(1000);
+    for (auto& it : runs) it = 0;
+    for (std::size_t i = 0; i < runs.size(); i++)
+      pool.Submit([&, i]() { runs[i]++; });
+    pool.Wait();
+    for (auto& it : runs) REQUIRE(it == 1);
+
+    // Tasks may submit more tasks, and Wait covers them too.
+    std::atomic<int> leaves(0);
+    for (int i = 0; i < 10; i++)
+      pool.Submit([&]() {
+        for (int j = 0; j < 10; j++) pool.Submit([&]() { leaves++; });
+      });
+    pool.Wait();
+    REQUIRE(leaves == 100);
+  }
+}
+
+TEST_CASE("Idle threads steal from busy ones") {
+  miniplc0::ThreadPool pool(4);
+  std::atomic<int> done(0);
+  bool stolen = false;
+  // All of these land in one thread's queue, behind a task that keeps
+  // that thread busy until the others have done them.
+  pool.Submit([&]() {
+    for (int i = 0; i < 100; i++) pool.Submit([&]() { done++; });
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (done < 100 && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::yield();
+    stolen = done == 100;
+  });
+  pool.Wait();
+  REQUIRE(stolen);
+  REQUIRE(done == 100);
+}
+
+TEST_CASE("Compile writes what the command line would") {
+  auto ok = compile("begin var a = 1; print(a + 2); end", Action::RUN);
+  REQUIRE(ok.first == CompileStatus::OK);
+  REQUIRE(ok.second.first == "3\n");
+  REQUIRE(ok.second.second.empty());
+
+  auto listing = compile("begin print(1 + 2); end", Action::ANALYSE, 1);
+  REQUIRE(listing.second.first == "LIT 3\nWRT\n");
+
+  auto syntax = compile("begin print(1) end", Action::ANALYSE);
+  REQUIRE(syntax.first == CompileStatus::FAILED);
+  REQUIRE(syntax.second.second.rfind("Syntactic analysis error: ", 0) == 0);
+
+  auto lexing = compile("begin $ end", Action::TOKENIZE);
+  REQUIRE(lexing.first == CompileStatus::FAILED);
+  REQUIRE(lexing.second.second.rfind("Tokenization error: ", 0) == 0);
+
+  auto runtime = compile("begin print(5); print(1 / 0); end", Action::RUN);
+  REQUIRE(runtime.first == CompileStatus::FAILED);
+  REQUIRE(runtime.second.first == "5\n");
+  REQUIRE(runtime.second.second.rfind("Runtime error: ", 0) == 0);
+
+  // Binaries are decoded instead of compiled, but only by -r.
+  auto binary = compile("begin var a = 6; print(a * 7); end",
+                        Action::EMIT_BINARY, 2);
+  auto run = compile(binary.second.first, Action::RUN);
+  REQUIRE(run.second.first == "42\n");
+  REQUIRE(compile(binary.second.first, Action::ANALYSE).first ==
+          CompileStatus::FAILED);
+  auto corrupt = binary.second.first;
+  corrupt.pop_back();
+  REQUIRE(compile(corrupt, Action::RUN).first == CompileStatus::FAILED);
+
+  // Source that happens to start with the magic is still source.
+  for (auto action : {Action::ANALYSE, Action::RUN}) {
+    auto magic = compile("MPC0abc\n", action);
+    REQUIRE(magic.first == CompileStatus::FAILED);
+    REQUIRE(magic.second.second ==
+            "Syntactic analysis error: Line: 0 Column: 7 Error: The program "
+            "should start with 'begin'.\n");
+  }
+}
+
+TEST_CASE("Batches compile each file to its own output") {
+  auto dir = fs::temp_directory_path() / "miniplc0_test_batch";
+  fs::remove_all(dir);
+  write(dir / "src" / "a.txt", "begin print(1); end");
+  write(dir / "src" / "nested" / "b.txt", "begin print(2); end");
+  write(dir / "src" / "c.txt", "begin print(1 / 0); end");
+  write(dir / "d.txt", "begin print(4); end");
+  // A result of an earlier run, which is not an input.
+  write(dir / "src" / "stale.out", "");
+
+  auto listed = miniplc0::ListDirectory((dir / "src").string(),
+                                        (dir / "out").string(), Action::RUN);
+  REQUIRE(listed.has_value());
+  auto& jobs = listed.value();
+  REQUIRE(jobs.size() == 3);
+  REQUIRE(fs::path(jobs[0].input).filename() == "a.txt");
+  REQUIRE(fs::path(jobs[1].input).filename() == "c.txt");
+  REQUIRE(fs::path(jobs[2].output) == dir / "out" / "nested" / "b.out");
+
+  miniplc0::CompileOptions options;
+  options.action = Action::RUN;
+  miniplc0::ThreadPool pool(3);
+  auto results = miniplc0::RunBatch(jobs, options, pool);
+  REQUIRE(results[0].status == CompileStatus::OK);
+  REQUIRE(results[1].status == CompileStatus::FAILED);
+  REQUIRE(results[1].errors.rfind("Runtime error: ", 0) == 0);
+  REQUIRE(results[2].status == CompileStatus::OK);
+  REQUIRE(ReadFile(dir / "out" / "a.out") == "1\n");
+  REQUIRE(ReadFile(dir / "out" / "nested" / "b.out") == "2\n");
+
+  std::stringstream manifest;
+  manifest << "# comment\n\n"
+           << (dir / "src" / "a.txt").string() << "\n"
+           << (dir / "src" / "nested" / "b.txt").string() << "\t"
+           << (dir / "b.list").string() << "\n"
+           << (dir / "missing.txt").string() << "\n"
+           // Would write over a.list from the first line.
+           << (dir / "src" / "a.txt").string() << "\n"
+           << (dir / "src" / "a.txt").string() << "\t"
+           << (dir / "src" / "a.txt").string() << "\n"
+           // Would write over the input of the next line.
+           << (dir / "src" / "c.txt").string() << "\t"
+           << (dir / "out" / ".." / "d.txt").string() << "\n"
+           << (dir / "d.txt").string() << "\n";
+  auto read = miniplc0::ReadManifest(manifest, "", Action::ANALYSE);
+  REQUIRE(read.size() == 7);
+  REQUIRE(fs::path(read[0].output) == dir / "src" / "a.list");
+  REQUIRE(fs::path(read[1].output) == dir / "b.list");
+  options.action = Action::ANALYSE;
+  results = miniplc0::RunBatch(read, options, pool);
+  REQUIRE(results[0].status == CompileStatus::OK);
+  REQUIRE(ReadFile(dir / "src" / "a.list") == "LIT 1\nWRT\n");
+  REQUIRE(results[1].status == CompileStatus::OK);
+  REQUIRE(ReadFile(dir / "b.list") == "LIT 2\nWRT\n");
+  REQUIRE(results[2].status == CompileStatus::FAILED);
+  REQUIRE(results[2].errors.rfind("Fail to open ", 0) == 0);
+  REQUIRE(results[3].status == CompileStatus::FAILED);
+  REQUIRE(results[4].status == CompileStatus::FAILED);
+  REQUIRE(ReadFile(dir / "src" / "a.txt") == "begin print(1); end");
+  REQUIRE(results[5].status == CompileStatus::FAILED);
+  REQUIRE(results[6].status == CompileStatus::OK);
+  REQUIRE(ReadFile(dir / "d.txt") == "begin print(4); end");
+  REQUIRE(ReadFile(dir / "d.list") == "LIT 4\nWRT\n");
+
+  fs::remove_all(dir);
+}
+
+TEST_CASE("The compile server answers like Compile") {
+  auto path = (fs::temp_directory_path() / "miniplc0_test.sock").string();
+  miniplc0::CompileServer server(path, 2);
+  if (server.Bad()) {
+    WARN("Cannot listen on " + path + ", skipping.");
+    return;
+  }
+  std::thread serving([&]() { server.Serve(); });
+
+  // A second server must not take over a socket in use.
+  REQUIRE(miniplc0::CompileServer(path).Bad());
+  auto interned = miniplc0::Interner::Global().Size();
+
+  const std::string sources[] = {
+      "begin var a = 6; print(a * 7); end",
+      "begin print(1) end",
+      "begin $ end",
+      "begin print(5); print(1 / 0); end",
+      "",
+  };
+  std::vector<std::thread> clients;
+  std::atomic<int> matched(0);
+  for (int c = 0; c < 4; c++)
+    clients.emplace_back([&]() {
+      miniplc0::CompileClient client(path);
+      if (client.Bad()) return;
+      // Many requests on one connection.
+      for (int round = 0; round < 10; round++)
+        for (auto& source : sources)
+          for (auto action : {Action::TOKENIZE, Action::ANALYSE, Action::RUN,
+                              Action::EMIT_BINARY}) {
+            miniplc0::CompileOptions options;
+            options.action = action;
+            options.level = round % 3;
+            options.engine = round % 2 == 0 ? "stack" : "register";
+            auto reply = client.Compile(source, options);
+            if (!reply.has_value()) return;
+            std::ostringstream out, err;
+            auto status = miniplc0::Compile(miniplc0::SourceBuffer(source),
+                                            options, out, err);
+            if (reply.value().status == status &&
+                reply.value().out == out.str() &&
+                reply.value().err == err.str())
+              matched++;
+          }
+    });
+  for (auto& t : clients) t.join();
+  REQUIRE(matched == 4 * 10 * 5 * 4);
+
+  // Binaries sent back are accepted as requests.
+  miniplc0::CompileClient client(path);
+  miniplc0::CompileOptions options;
+  options.action = Action::EMIT_BINARY;
+  auto binary = client.Compile("begin print(3); end", options);
+  REQUIRE(binary.has_value());
+  options.action = Action::RUN;
+  auto run = client.Compile(binary.value().out, options);
+  REQUIRE(run.has_value());
+  REQUIRE(run.value().out == "3\n");
+  // Nothing the requests used is kept.
+  REQUIRE(miniplc0::Interner::Global().Size() == interned);
+  // An engine the protocol does not know is refused by the client.
+  options.engine = "nope";
+  REQUIRE_FALSE(client.Compile("begin end", options).has_value());
+
+  // Stopping also drops connections that are still open.
+  server.Stop();
+  serving.join();
+  options.engine = "stack";
+  REQUIRE_FALSE(client.Compile("begin end", options).has_value());
+}
+
+#if !defined(_WIN32)
+TEST_CASE("Idle and slow clients do not hold up the compile server") {
+  auto path = (fs::temp_directory_path() / "miniplc0_test_slow.sock").string();
+  miniplc0::CompileServer server(path, 1, std::chrono::milliseconds(200));
+  if (server.Bad()) {
+    WARN("Cannot listen on " + path + ", skipping.");
+    return;
+  }
+  std::thread serving([&]() { server.Serve(); });
+
+  // One client that never sends anything, and one that claims the largest
+  // request there is and then stalls.
+  miniplc0::CompileClient idle(path);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.data(), path.size());
+  int slow = socket(AF_UNIX, SOCK_STREAM, 0);
+  REQUIRE(connect(slow, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ==
+          0);
+  const char header[] = {1, 0, 0, 0, 0, 0, 0, 16, 'b', 'e'};
+  REQUIRE(write(slow, header, sizeof(header)) ==
+          static_cast<ssize_t>(sizeof(header)));
+
+  // The only thread is still there for everyone else.
+  miniplc0::CompileOptions options;
+  options.action = Action::RUN;
+  for (int i = 0; i < 3; i++) {
+    miniplc0::CompileClient client(path);
+    auto reply = client.Compile("begin print(7); end", options);
+    REQUIRE(reply.has_value());
+    REQUIRE(reply.value().out == "7\n");
+  }
+
+  // The stalled request is dropped once it has taken too long.
+  char byte;
+  REQUIRE(read(slow, &byte, 1) == 0);
+  close(slow);
+  auto reply = idle.Compile("begin print(8); end", options);
+  REQUIRE(reply.has_value());
+  REQUIRE(reply.value().out == "8\n");
+
+  server.Stop();
+  serving.join();
+}
+
+TEST_CASE("The compile server outlasts running out of descriptors") {
+  auto path = (fs::temp_directory_path() / "miniplc0_test_fds.sock").string();
+  miniplc0::CompileServer server(path, 1);
+  if (server.Bad()) {
+    WARN("Cannot listen on " + path + ", skipping.");
+    return;
+  }
+  std::atomic<bool> returned{false};
+  std::thread serving([&]() {
+    server.Serve();
+    returned = true;
+  });
+
+  // Fill the descriptor table, then queue a connection the server has no
+  // descriptor left to accept.
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.data(), path.size());
+  int pending = socket(AF_UNIX, SOCK_STREAM, 0);
+  REQUIRE(pending >= 0);
+  rlimit limit{};
+  REQUIRE(getrlimit(RLIMIT_NOFILE, &limit) == 0);
+  auto lowered = limit;
+  lowered.rlim_cur = std::min<rlim_t>(limit.rlim_cur, 256);
+  REQUIRE(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+  std::vector<int> fillers;
+  for (int fd; (fd = dup(pending)) >= 0;) fillers.push_back(fd);
+  bool refused = errno == EMFILE;
+  bool connected =
+      connect(pending, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  bool serving_while_full = !returned;
+  for (auto fd : fillers) close(fd);
+  setrlimit(RLIMIT_NOFILE, &limit);
+  REQUIRE(refused);
+  REQUIRE(connected);
+  REQUIRE(serving_while_full);
+
+  // Once there is room again, connections are accepted again.
+  miniplc0::CompileOptions options;
+  options.action = Action::RUN;
+  miniplc0::CompileClient client(path);
+  auto reply = client.Compile("begin print(9); end", options);
+  REQUIRE(reply.has_value());
+  REQUIRE(reply.value().out == "9\n");
+  close(pending);
+
+  server.Stop();
+  serving.join();
+}
+#endif
+
+TEST_CASE("SHA-256 matches the published test vectors") {
+  auto hex = [](const std::vector<std::string>& parts) {
+    miniplc0::Sha256 sha;
+    for (auto& part : parts) sha.Update(part);
+    return miniplc0::Sha256::Hex(sha.Final());
+  };
+  REQUIRE(hex({""}) ==
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  REQUIRE(hex({"abc"}) ==
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  REQUIRE(hex({"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"}) ==
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+  // The same bytes in pieces that straddle the blocks.
+  std::string million(1000000, 'a');
+  std::vector<std::string> pieces;
+  for (std::size_t at = 0, n = 1; at < million.size(); at += n, n = n * 3 % 97)
+    pieces.push_back(million.substr(at, n));
+  REQUIRE(hex(pieces) ==
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST_CASE("The compile cache skips compiling identical inputs") {
+  auto dir = fs::temp_directory_path() / "miniplc0_test_cache";
+  fs::remove_all(dir);
+  const std::string sources[] = {
+      "begin var a = 6; print(a * 7); end",
+      "begin print(1) end",
+      "begin print(5); print(1 / 0); end",
+  };
+  auto check = [&](miniplc0::CompileCache& cache, const std::string& source,
+                   miniplc0::CompileOptions options) {
+    std::ostringstream out, err, expected_out, expected_err;
+    auto status = cache.Compile(miniplc0::SourceBuffer(source), options, out,
+                                err);
+    auto expected = miniplc0::Compile(miniplc0::SourceBuffer(source), options,
+                                      expected_out, expected_err);
+    REQUIRE(status == expected);
+    REQUIRE(out.str() == expected_out.str());
+    REQUIRE(err.str() == expected_err.str());
+  };
+
+  {
+    miniplc0::CompileCache cache(dir.string(), "one");
+    REQUIRE_FALSE(cache.Bad());
+    for (int round = 0; round < 2; round++)
+      for (auto& source : sources)
+        for (auto action : {Action::TOKENIZE, Action::ANALYSE, Action::RUN,
+                            Action::EMIT_C, Action::EMIT_BINARY})
+          for (int level : {0, 2}) {
+            miniplc0::CompileOptions options;
+            options.action = action;
+            options.level = level;
+            check(cache, source, options);
+          }
+    auto stats = cache.Stats();
+    // The tokens are the same at every level, and -r shares what
+    // --emit bin caches.
+    REQUIRE(stats.misses == 3 * 7);
+    REQUIRE(stats.hits == 3 * 2 * 5 * 2 - 3 * 7);
+    REQUIRE(stats.stores == stats.misses);
+  }
+  auto saved = miniplc0::CompileCache::Load(dir.string());
+  REQUIRE(saved.hits == 3 * 2 * 5 * 2 - 3 * 7);
+  REQUIRE(saved.entries == 3 * 7);
+  REQUIRE(saved.bytes > 0);
+
+  {
+    // Another version of the compiler starts from scratch.
+    miniplc0::CompileCache cache(dir.string(), "two");
+    miniplc0::CompileOptions options;
+    check(cache, sources[0], options);
+    REQUIRE(cache.Stats().misses == 1);
+  }
+
+  // A damaged entry is dropped instead of being trusted.
+  for (auto& it : fs::recursive_directory_iterator(dir))
+    if (it.is_regular_file() && it.path().filename() != "stats")
+      std::ofstream(it.path()) << "MPCC";
+  {
+    miniplc0::CompileCache cache(dir.string(), "one");
+    miniplc0::CompileOptions options;
+    options.action = Action::RUN;
+    check(cache, sources[2], options);
+    REQUIRE(cache.Stats().hits == 0);
+  }
+  fs::remove_all(dir);
+}
+
+TEST_CASE("The compile cache evicts the least recently used entries") {
+  auto dir = fs::temp_directory_path() / "miniplc0_test_cache_limit";
+  fs::remove_all(dir);
+  {
+    // Room for a few listings in each of the 16 buckets.
+    miniplc0::CompileCache cache(dir.string(), "one", 16 * 400);
+    miniplc0::CompileOptions options;
+    std::ostringstream out, err;
+    for (int i = 0; i < 500; i++)
+      cache.Compile(miniplc0::SourceBuffer("begin print(" + std::to_string(i) +
+                                           "); end"),
+                    options, out, err);
+    REQUIRE(cache.Stats().evictions > 0);
+  }
+  auto stats = miniplc0::CompileCache::Load(dir.string());
+  REQUIRE(stats.entries + stats.evictions == 500);
+  REQUIRE(stats.bytes <= 16 * 400);
+  fs::remove_all(dir);
+}
+
+TEST_CASE("JSON round-trips what the language server exchanges") {
+  using miniplc0::Json;
+  auto parsed = Json::Parse(
+      " {\"id\": 7, \"ok\" : [true, false, null, -1.5e2, \"a\\\"\\n\\u00e9"
+      "\\ud83d\\ude00\"], \"o\": {}} ");
+  REQUIRE(parsed.has_value());
+  auto& json = parsed.value();
+  REQUIRE(json.Get("id")->GetInteger() == 7);
+  auto ok = json.Get("ok")->GetArray();
+  REQUIRE(ok->size() == 5);
+  REQUIRE((*ok)[0].GetBool() == true);
+  REQUIRE((*ok)[2].IsNull());
+  REQUIRE((*ok)[3].GetNumber() == -150.0);
+  REQUIRE((*ok)[3].GetInteger() == -150);
+  REQUIRE_FALSE(Json(0.5).GetInteger().has_value());
+  REQUIRE(*(*ok)[4].GetString() == "a\"\n\xc3\xa9\xf0\x9f\x98\x80");
+  REQUIRE(json.Find({"o"})->GetType() == Json::OBJECT);
+  REQUIRE(json.Find({"o", "missing"}) == nullptr);
+  REQUIRE(json.Dump() ==
+          "{\"id\":7,\"ok\":[true,false,null,-150,\"a\\\"\\n\xc3\xa9"
+          "\xf0\x9f\x98\x80\"],\"o\":{}}");
+  REQUIRE(Json::Parse(json.Dump()) == json);
+
+  for (auto bad : {"", "{", "[1,]", "{\"a\" 1}", "01", "1.", "\"\\ud83d\"",
+                   "\"\n\"", "tru", "1 2"})
+    REQUIRE_FALSE(Json::Parse(bad).has_value());
+  REQUIRE(Json::Parse(std::string(Json::MaxDepth, '[') +
+                      std::string(Json::MaxDepth, ']'))
+              .has_value());
+  REQUIRE_FALSE(Json::Parse(std::string(Json::MaxDepth + 2, '[') +
+                            std::string(Json::MaxDepth + 2, ']'))
+                    .has_value());
+}
+
+namespace {
+std::string frame(const miniplc0::Json& message) {
+  auto body = message.Dump();
+  return "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" +
+         body;
+}
+
+miniplc0::Json notification(const std::string& method,
+                            miniplc0::Json params) {
+  return miniplc0::Json::Object()
+      .Set("jsonrpc", "2.0")
+      .Set("method", method)
+      .Set("params", std::move(params));
+}
+
+miniplc0::Json request(int id, const std::string& method,
+                       miniplc0::Json params = miniplc0::Json::Object()) {
+  return notification(method, std::move(params)).Set("id", id);
+}
+
+miniplc0::Json didOpen(const std::string& uri, const std::string& text) {
+  return notification(
+      "textDocument/didOpen",
+      miniplc0::Json::Object().Set("textDocument", miniplc0::Json::Object()
+                                                       .Set("uri", uri)
+                                                       .Set("version", 1)
+                                                       .Set("text", text)));
+}
+
+miniplc0::Json didChange(const std::string& uri, int version, int line,
+                         int from, int to, const std::string& text) {
+  auto position = [line](int character) {
+    return miniplc0::Json::Object()
+        .Set("line", line)
+        .Set("character", character);
+  };
+  auto change = miniplc0::Json::Object()
+                    .Set("range", miniplc0::Json::Object()
+                                      .Set("start", position(from))
+                                      .Set("end", position(to)))
+                    .Set("text", text);
+  return notification(
+      "textDocument/didChange",
+      miniplc0::Json::Object()
+          .Set("textDocument",
+               miniplc0::Json::Object().Set("uri", uri).Set("version",
+                                                            version))
+          .Set("contentChanges", miniplc0::Json::Array().Push(change)));
+}
+
+std::vector<miniplc0::Json> messages(const std::string& output) {
+  std::vector<miniplc0::Json> result;
+  std::size_t pos = 0;
+  while (pos < output.size()) {
+    auto header_end = output.find("\r\n\r\n", pos);
+    REQUIRE(header_end != std::string::npos);
+    auto length = std::stoul(output.substr(pos + 16, header_end - pos - 16));
+    auto json = miniplc0::Json::Parse(output.substr(header_end + 4, length));
+    REQUIRE(json.has_value());
+    result.push_back(json.value());
+    pos = header_end + 4 + length;
+  }
+  return result;
+}
+
+std::pair<int, std::vector<miniplc0::Json>> session(
+    const std::vector<miniplc0::Json>& input) {
+  std::string framed;
+  for (auto& message : input) framed += frame(message);
+  std::istringstream in(framed);
+  std::ostringstream out;
+  miniplc0::LanguageServer server(in, out);
+  auto code = server.Run();
+  return std::make_pair(code, messages(out.str()));
+}
+}  // namespace
+
+TEST_CASE("The language server publishes what -l would report") {
+  std::string uninitialized = "begin\n  var a;\n  print(a);\nend\n";
+  // An e with an acute accent and an emoji, one and two UTF-16 code units.
+  std::string unicode = "begin\n\xc3\xa9\xf0\x9f\x98\x80 end\n";
+  auto result = session({
+      request(1, "initialize"),
+      notification("initialized", miniplc0::Json::Object()),
+      didOpen("file:///a", uninitialized),
+      didChange("file:///a", 2, 1, 7, 7, " = 1"),
+      didOpen("file:///b", unicode),
+      didChange("file:///b", 2, 1, 0, 3, ""),
+      didOpen("file:///c", "begin print(1) end"),
+      notification("textDocument/didClose",
+                   miniplc0::Json::Object().Set(
+                       "textDocument",
+                       miniplc0::Json::Object().Set("uri", "file:///c"))),
+      didOpen("file:///d", uninitialized),
+      didOpen("file:///e", unicode),
+      request(2, "shutdown"),
+      notification("exit", miniplc0::Json::Object()),
+  });
+  REQUIRE(result.first == 0);
+
+  std::map<int64_t, miniplc0::Json> replies;
+  std::map<std::string, miniplc0::Json> published;
+  for (auto& message : result.second) {
+    if (message.Get("id") != nullptr) {
+      replies[message.Get("id")->GetInteger().value()] = message;
+    } else {
+      REQUIRE(*message.Get("method")->GetString() ==
+              "textDocument/publishDiagnostics");
+      published[*message.Find({"params", "uri"})->GetString()] =
+          *message.Get("params");
+    }
+  }
+  REQUIRE(replies.size() == 2);
+  REQUIRE(*replies[1].Find({"result", "capabilities", "positionEncoding"})
+               ->GetString() == "utf-16");
+  REQUIRE(replies[2].Get("result")->IsNull());
+
+  // The last diagnostics are for the last version, fixed or not.
+  REQUIRE(published.size() == 5);
+  for (auto uri : {"file:///a", "file:///b"}) {
+    INFO(uri);
+    REQUIRE(published[uri].Get("version")->GetInteger() == 2);
+    REQUIRE(published[uri].Get("diagnostics")->GetArray()->empty());
+  }
+  REQUIRE(published["file:///c"].Get("version") == nullptr);
+  REQUIRE(published["file:///c"].Get("diagnostics")->GetArray()->empty());
+
+  auto range = [](int line, int from, int to) {
+    auto position = [line](int character) {
+      return miniplc0::Json::Object()
+          .Set("line", line)
+          .Set("character", character);
+    };
+    return miniplc0::Json::Object()
+        .Set("start", position(from))
+        .Set("end", position(to));
+  };
+  auto d = published["file:///d"].Get("diagnostics")->GetArray();
+  REQUIRE(d->size() == 1);
+  REQUIRE(*(*d)[0].Get("message")->GetString() ==
+          "Syntactic analysis error: The variable has not been initialized.");
+  REQUIRE(*(*d)[0].Get("range") == range(2, 9, 10));
+  auto e = published["file:///e"].Get("diagnostics")->GetArray();
+  REQUIRE(e->size() == 1);
+  REQUIRE(*(*e)[0].Get("message")->GetString() ==
+          "Tokenization error: The input is invalid.");
+  REQUIRE(*(*e)[0].Get("range") == range(1, 0, 1));
+}
+
+TEST_CASE("The language server follows the protocol's lifecycle") {
+  auto result = session({
+      request(1, "textDocument/hover"),
+      request(2, "initialize"),
+      request(3, "textDocument/hover"),
+      notification("exit", miniplc0::Json::Object()),
+  });
+  // Exiting without a shutdown first.
+  REQUIRE(result.first == 1);
+  REQUIRE(result.second.size() == 3);
+  REQUIRE(result.second[0].Find({"error", "code"})->GetInteger() == -32002);
+  REQUIRE(result.second[1].Get("result") != nullptr);
+  REQUIRE(result.second[2].Find({"error", "code"})->GetInteger() == -32601);
+
+  std::istringstream in("Content-Length: 1\r\n\r\n{");
+  std::ostringstream out;
+  miniplc0::LanguageServer server(in, out);
+  REQUIRE(server.Run() == 1);
+  auto replies = messages(out.str());
+  REQUIRE(replies.size() == 1);
+  REQUIRE(replies[0].Get("id")->IsNull());
+  REQUIRE(replies[0].Find({"error", "code"})->GetInteger() == -32700);
+}
@@ -0,0 +1,321 @@
+#include "analyser/analyser.h"
+#include "instruction/instruction.h"
+#include "ir/ir.h"
+#include "ir/passes.h"
+#include "tokenizer/tokenizer.h"
+#include "vm/vm.h"
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "fmt/core.h"
+#include "fmts.hpp"
+#include "catch2/catch.hpp"
+
+namespace {
+using miniplc0::Instruction;
+using miniplc0::Operation;
+using miniplc0::VirtualMachine;
+
+std::vector<miniplc0::Token> lex(const std::string& input) {
+  std::stringstream ss(input);
+  miniplc0::Tokenizer lexer(ss);
+  auto tokens = lexer.AllTokens();
+  REQUIRE_FALSE(tokens.second.has_value());
+  return tokens.first;
+}
+
+std::vector<Instruction> compile(const std::string& input,
+                                 const miniplc0::ir::PassManager& passes) {
+  miniplc0::Analyser parser(lex(input));
+  auto ir = parser.AnalyseToIR();
+  REQUIRE_FALSE(ir.second.has_value());
+  passes.Run(ir.first);
+  return ir.first.Lower();
+}
+
+std::vector<Instruction> compile(const std::string& input, int level) {
+  return compile(input, miniplc0::ir::PassManager::ForLevel(level));
+}
+
+// Every program in miniplc0 is a constant, so folding leaves nothing for the
+// other passes; they get tested on their own as well.
+miniplc0::ir::PassManager only(std::unique_ptr<miniplc0::ir::Pass> pass) {
+  miniplc0::ir::PassManager passes;
+  passes.Add(std::move(pass));
+  return passes;
+}
+
+// Runs the program at -O0, -O1, -O2 and with only the non-folding passes,
+// and checks that they print the same and fail the same way. Returns the
+// -O0 result.
+std::pair<std::vector<int32_t>, std::optional<miniplc0::RuntimeError>>
+runLevels(const std::string& input) {
+  auto expected = VirtualMachine(compile(input, 0)).Run();
+  std::vector<miniplc0::ir::PassManager> pipelines;
+  pipelines.push_back(miniplc0::ir::PassManager::ForLevel(1));
+  pipelines.push_back(miniplc0::ir::PassManager::ForLevel(2));
+  pipelines.push_back(only(miniplc0::ir::MakeCommonSubexpressionElimination()));
+  pipelines.push_back(only(miniplc0::ir::MakeDeadStoreElimination()));
+  pipelines.push_back(only(miniplc0::ir::MakeSlotAllocation()));
+  pipelines.push_back(
+      std::move(only(miniplc0::ir::MakeCommonSubexpressionElimination())
+                    .Add(miniplc0::ir::MakeDeadStoreElimination())
+                    .Add(miniplc0::ir::MakeSlotAllocation())));
+  for (auto& passes : pipelines) {
+    std::string names;
+    for (auto name : passes.Names()) names += std::string(name) + " ";
+    INFO(names);
+    auto result = VirtualMachine(compile(input, passes)).Run();
+    REQUIRE(result.first == expected.first);
+    REQUIRE(result.second.has_value() == expected.second.has_value());
+    if (expected.second.has_value())
+      REQUIRE(result.second.value().GetCode() ==
+              expected.second.value().GetCode());
+  }
+  return expected;
+}
+}  // namespace
+
+TEST_CASE("Unoptimised IR lowers to what the analyser emits") {
+  std::vector<std::string> inputs = {
+      "begin end",
+      "begin const a = -5; var b; var c = a * (3 + a); b = c / -a;"
+      "print(b - -(c)); ; end",
+      "begin var a = 1; print(a); a = +a + 1 * (2 - 3) / 4; end",
+      "begin print(-(-(-1))); end",
+  };
+  for (auto& input : inputs) {
+    INFO(input);
+    miniplc0::Analyser direct(lex(input));
+    miniplc0::Analyser viaIR(lex(input));
+    auto expected = direct.Analyse();
+    auto ir = viaIR.AnalyseToIR();
+    REQUIRE_FALSE(expected.second.has_value());
+    REQUIRE_FALSE(ir.second.has_value());
+    REQUIRE(ir.first.Lower() == expected.first);
+  }
+}
+
+TEST_CASE("Building IR reports the same errors") {
+  std::vector<std::string> inputs = {
+      "begin var a; print(a); end",
+      "begin const a = 1; a = 2; end",
+      "begin print(b); end",
+      "begin var a = 1 end",
+  };
+  for (auto& input : inputs) {
+    INFO(input);
+    miniplc0::Analyser direct(lex(input));
+    miniplc0::Analyser viaIR(lex(input));
+    auto expected = direct.Analyse();
+    auto ir = viaIR.AnalyseToIR();
+    REQUIRE(expected.second.has_value());
+    REQUIRE(ir.second.has_value());
+    REQUIRE(ir.second.value().GetCode() == expected.second.value().GetCode());
+    REQUIRE(ir.second.value().GetPos() == expected.second.value().GetPos());
+  }
+
+  // Direct emission carries on past an error inside brackets and leaves the
+  // operand out; building IR reports that error instead.
+  using miniplc0::ErrorCode;
+  std::vector<std::tuple<std::string, ErrorCode, uint64_t>> bracketed = {
+      {"begin var a; print((a)); end", ErrorCode::ErrNotInitialized, 21},
+      {"begin print((b)); end", ErrorCode::ErrNotDeclared, 14},
+      {"begin print(1 + ()); end", ErrorCode::ErrIncompleteExpression, 18},
+  };
+  for (auto& [input, code, column] : bracketed) {
+    INFO(input);
+    miniplc0::Analyser direct(lex(input));
+    miniplc0::Analyser viaIR(lex(input));
+    REQUIRE_FALSE(direct.Analyse().second.has_value());
+    auto ir = viaIR.AnalyseToIR();
+    REQUIRE(ir.second.has_value());
+    REQUIRE(ir.second.value().GetCode() == code);
+    REQUIRE(ir.second.value().GetPos().second == column);
+  }
+}
+
+TEST_CASE("Constant folding and propagation") {
+  auto code = compile(
+      "begin const a = 6; var b = a * 7; var c; c = b - a; print(c / 4);"
+      "c = c + b; print(c); print(2147483647 + a); end",
+      only(miniplc0::ir::MakeConstantFolding()));
+  std::vector<Instruction> expected = {
+      Instruction(Operation::LIT, 6),  Instruction(Operation::LIT, 42),
+      Instruction(Operation::LIT, 0),  Instruction(Operation::LIT, 36),
+      Instruction(Operation::STO, 2),  Instruction(Operation::LIT, 9),
+      Instruction(Operation::WRT, 0),  Instruction(Operation::LIT, 78),
+      Instruction(Operation::STO, 2),  Instruction(Operation::LIT, 78),
+      Instruction(Operation::WRT, 0),
+      // Overflows, so it is left for the VM.
+      Instruction(Operation::LIT, 2147483647), Instruction(Operation::LIT, 6),
+      Instruction(Operation::ADD, 0),  Instruction(Operation::WRT, 0),
+  };
+  REQUIRE(code == expected);
+  auto result = runLevels(
+      "begin const a = 6; var b = a * 7; var c; c = b - a; print(c / 4);"
+      "c = c + b; print(c); print(2147483647 + a); end");
+  REQUIRE(result.first == std::vector<int32_t>{9, 78});
+  REQUIRE(result.second.value().GetCode() == miniplc0::ErrAddOverflow);
+}
+
+TEST_CASE("Common subexpressions are computed once") {
+  std::string input =
+      "begin var a = 3; var b = 4;"
+      "var c = (a + b) * (a + b) - a * b / (a * b);"
+      "var d = 1; print(c + d); end";
+  auto code = compile(input,
+                      only(miniplc0::ir::MakeCommonSubexpressionElimination()));
+  std::vector<Instruction> expected = {
+      Instruction(Operation::LIT, 3), Instruction(Operation::LIT, 4),
+      // The temporary for a + b.
+      Instruction(Operation::LOD, 0), Instruction(Operation::LOD, 1),
+      Instruction(Operation::ADD, 0),
+      // c, now in slot 3.
+      Instruction(Operation::LOD, 2), Instruction(Operation::LOD, 2),
+      Instruction(Operation::MUL, 0),
+      // a * b is not hoisted: the multiplication above could trap first.
+      Instruction(Operation::LOD, 0), Instruction(Operation::LOD, 1),
+      Instruction(Operation::MUL, 0), Instruction(Operation::LOD, 0),
+      Instruction(Operation::LOD, 1), Instruction(Operation::MUL, 0),
+      Instruction(Operation::DIV, 0), Instruction(Operation::SUB, 0),
+      // d, moved up a slot too.
+      Instruction(Operation::LIT, 1), Instruction(Operation::LOD, 3),
+      Instruction(Operation::LOD, 4), Instruction(Operation::ADD, 0),
+      Instruction(Operation::WRT, 0),
+  };
+  REQUIRE(code == expected);
+  REQUIRE(runLevels(input).first == std::vector<int32_t>{49});
+}
+
+TEST_CASE("Dead stores and unused variables are removed") {
+  std::string input =
+      "begin var a; var b = 1; var c = 2; var d; a = b; c = 3; d = c * 2;"
+      "print(c); b = 7; end";
+  auto code = compile(input, only(miniplc0::ir::MakeDeadStoreElimination()));
+  std::vector<Instruction> expected = {
+      // a is never read, and b only by a.
+      Instruction(Operation::LIT, 2), Instruction(Operation::LIT, 0),
+      Instruction(Operation::LIT, 3), Instruction(Operation::STO, 0),
+      // d is never read, but the multiplication could trap.
+      Instruction(Operation::LOD, 0), Instruction(Operation::LIT, 2),
+      Instruction(Operation::MUL, 0), Instruction(Operation::STO, 1),
+      Instruction(Operation::LOD, 0), Instruction(Operation::WRT, 0),
+  };
+  REQUIRE(code == expected);
+  // Once folded, nothing reads any variable.
+  REQUIRE(compile(input, 1) == std::vector<Instruction>{
+                                   Instruction(Operation::LIT, 3),
+                                   Instruction(Operation::WRT, 0)});
+  REQUIRE(runLevels(input).first == std::vector<int32_t>{3});
+
+  // A dead initial value still needs its slot for the store after it.
+  code = compile("begin var a = 1; var b = a; b = 2; print(b); end",
+                 only(miniplc0::ir::MakeDeadStoreElimination()));
+  expected = {
+      Instruction(Operation::LIT, 0), Instruction(Operation::LIT, 2),
+      Instruction(Operation::STO, 0), Instruction(Operation::LOD, 0),
+      Instruction(Operation::WRT, 0),
+  };
+  REQUIRE(code == expected);
+
+  // Overflows, so it stays even though a is never read.
+  code = compile("begin var a = 2147483647 + 1; end", 1);
+  REQUIRE(code.size() == 3);
+  REQUIRE(runLevels("begin var a = 2147483647 + 1; end").second.value()
+              .GetCode() == miniplc0::ErrAddOverflow);
+}
+
+TEST_CASE("Constants are inlined and slots reused") {
+  std::string input =
+      "begin const k = 3; var a = k + 1; var b = a * 2; var c = b - a;"
+      "print(c); end";
+  auto code = compile(input, only(miniplc0::ir::MakeSlotAllocation()));
+  std::vector<Instruction> expected = {
+      Instruction(Operation::LIT, 3), Instruction(Operation::LIT, 1),
+      Instruction(Operation::ADD, 0), Instruction(Operation::LOD, 0),
+      Instruction(Operation::LIT, 2), Instruction(Operation::MUL, 0),
+      // a and b are not used after this, so c takes the slot of a.
+      Instruction(Operation::LOD, 1), Instruction(Operation::LOD, 0),
+      Instruction(Operation::SUB, 0), Instruction(Operation::STO, 0),
+      Instruction(Operation::LOD, 0), Instruction(Operation::WRT, 0),
+  };
+  REQUIRE(code == expected);
+  REQUIRE(runLevels(input).first == std::vector<int32_t>{4});
+
+  // Temporaries from common subexpression elimination are short-lived.
+  input =
+      "begin var a = 5; var b = 6; print((a + b) * (a + b));"
+      "print((a - b) * (a - b)); end";
+  code = compile(
+      input, std::move(only(miniplc0::ir::MakeCommonSubexpressionElimination())
+                           .Add(miniplc0::ir::MakeSlotAllocation())));
+  expected = {
+      // a and b never change, so they are inlined as well.
+      Instruction(Operation::LIT, 5), Instruction(Operation::LIT, 6),
+      Instruction(Operation::ADD, 0), Instruction(Operation::LOD, 0),
+      Instruction(Operation::LOD, 0), Instruction(Operation::MUL, 0),
+      Instruction(Operation::WRT, 0), Instruction(Operation::LIT, 5),
+      Instruction(Operation::LIT, 6), Instruction(Operation::SUB, 0),
+      Instruction(Operation::STO, 0), Instruction(Operation::LOD, 0),
+      Instruction(Operation::LOD, 0), Instruction(Operation::MUL, 0),
+      Instruction(Operation::WRT, 0),
+  };
+  REQUIRE(code == expected);
+  REQUIRE(runLevels(input).first == std::vector<int32_t>{121, 1});
+}
+
+TEST_CASE("Optimised programs behave like unoptimised ones") {
+  std::mt19937 rng(20191120);
+  auto pick = [&](int n) {
+    return std::uniform_int_distribution<int>(0, n - 1)(rng);
+  };
+  const char* literals[] = {"0", "1", "2", "3", "7", "46341", "2147483647"};
+  std::vector<std::string> names;
+  std::function<std::string(int)> expr = [&](int depth) -> std::string {
+    int r = pick(10);
+    if (depth > 3 || r < 3) {
+      std::string prefix[] = {"", "", "-", "+"};
+      auto leaf = names.empty() || pick(2) == 0 ? std::string(literals[pick(7)])
+                                                 : names[pick(names.size())];
+      return prefix[pick(4)] + leaf;
+    }
+    if (r < 5) return "-(" + expr(depth + 1) + ")";
+    // Repeats give common subexpression elimination something to find.
+    auto lhs = expr(depth + 1);
+    const char* ops[] = {" + ", " - ", " * ", " / "};
+    auto rhs = pick(3) == 0 ? lhs : expr(depth + 1);
+    return "(" + lhs + ops[pick(4)] + rhs + ")";
+  };
+  for (int round = 0; round < 300; round++) {
+    names.clear();
+    std::string input = "begin\n";
+    for (int i = 0, n = pick(3); i < n; i++) {
+      auto name = "k" + std::to_string(i);
+      input += "const " + name + " = " + literals[pick(7)] + ";\n";
+      names.push_back(name);
+    }
+    std::vector<std::string> vars;
+    for (int i = 0, n = 1 + pick(3); i < n; i++) {
+      auto name = "v" + std::to_string(i);
+      input += "var " + name + " = " + expr(0) + ";\n";
+      names.push_back(name);
+      vars.push_back(name);
+    }
+    for (int i = 0; i < 5; i++) {
+      if (pick(2) == 0)
+        input += "print(" + expr(0) + ");\n";
+      else
+        input += vars[pick(vars.size())] + " = " + expr(0) + ";\n";
+    }
+    input += "end\n";
+    INFO(input);
+    runLevels(input);
+  }
+}
@@ -1,2 +1,2 @@
-#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_MAIN
 #include "catch2/catch.hpp"
\ No newline at end of file
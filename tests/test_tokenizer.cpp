@@ -1,305 +1,595 @@
-#include <sstream>
-#include <vector>
-
-#include "fmt/core.h"
-#include "fmts.hpp"
-std::ostream& operator<<(std::ostream& os, miniplc0::Token const& t) {
-  os << fmt::format("{}", t);
-  return os;
-}
-#include "tokenizer/tokenizer.h"
-#include "catch2/catch.hpp"
-
-// 下面是示例如何书写测试用例
-TEST_CASE("Test keywords") {
-  std::string input = "begin end var const print";
-  std::stringstream ss(input);
-  miniplc0::Tokenizer lexer(ss);
-  auto result = lexer.AllTokens();
-
-  std::vector<miniplc0::Token> expected = {
-      miniplc0::Token(miniplc0::TokenType::BEGIN, std::string("begin"), {0, 0},
-                      {0, 5}),
-      miniplc0::Token(miniplc0::TokenType::END, std::string("end"), {0, 6},
-                      {0, 9}),
-      miniplc0::Token(miniplc0::TokenType::VAR, std::string("var"), {0, 10},
-                      {0, 13}),
-      miniplc0::Token(miniplc0::TokenType::CONST, std::string("const"), {0, 14},
-                      {0, 19}),
-      miniplc0::Token(miniplc0::TokenType::PRINT, std::string("print"), {0, 20},
-                      {0, 25}),
-  };
-
-  if (result.second.has_value()) {
-    FAIL("Error introduced in lexing keywords");
-  } else {
-    // for (auto& x : result.first) {
-    //   std::cout << x.GetType() << " " << x.GetValueString() << " "
-    //             << x.GetStartPos().first << " " << x.GetStartPos().second <<
-    //             " "
-    //             << x.GetEndPos().first << " " << x.GetEndPos().second
-    //             << std::endl;
-    // }
-    REQUIRE(result.first == expected);
-  }
-}
-
-TEST_CASE("Test regular numbers") {
-  std::string input = "1 -1 999";
-  std::stringstream ss(input);
-  miniplc0::Tokenizer lexer(ss);
-  auto result = lexer.AllTokens();
-
-  std::vector<miniplc0::Token> expected = {
-      miniplc0::Token(miniplc0::TokenType::UNSIGNED_INTEGER, (int32_t)1, {0, 0},
-                      {0, 1}),
-      miniplc0::Token(miniplc0::TokenType::MINUS_SIGN, '-', {0, 2}, {0, 3}),
-      // minus sign is parsed as separate token
-      miniplc0::Token(miniplc0::TokenType::UNSIGNED_INTEGER, (int32_t)1, {0, 3},
-                      {0, 4}),
-      miniplc0::Token(miniplc0::TokenType::UNSIGNED_INTEGER, (int32_t)999,
-                      {0, 5}, {0, 8}),
-  };
-
-  // miniplc0::CompilationError expected_err()
-
-  if (result.second.has_value()) {
-    FAIL("Error introduced in lexing keywords");
-  } else {
-    REQUIRE(result.first == expected);
-  }
-}
-
-TEST_CASE("Test Identifiers") {
-  std::vector<std::pair<std::string, miniplc0::Token>> cases = {
-      {"a", miniplc0::Token(miniplc0::TokenType::IDENTIFIER, std::string("a"),
-                            {0, 0}, {0, 1})},
-      {"abc123", miniplc0::Token(miniplc0::TokenType::IDENTIFIER,
-                                 std::string("abc123"), {0, 0}, {0, 6})},
-      {"ull", miniplc0::Token(miniplc0::TokenType::IDENTIFIER,
-                              std::string("ull"), {0, 0}, {0, 3})},
-  };
-
-  for (auto& c : cases) {
-    SECTION(fmt::format("case token: {}", c.first)) {
-      std::stringstream in(c.first);
-      miniplc0::Tokenizer lexer(in);
-      auto res = lexer.NextToken();
-      REQUIRE_FALSE(res.second.has_value());
-      REQUIRE(res.first.has_value());
-      REQUIRE(res.first.value() == c.second);
-    }
-  }
-}
-
-TEST_CASE("Test Symbols") {
-  auto s = "+-*/()=;";
-  std::stringstream in(s);
-  miniplc0::Tokenizer lexer(in);
-  auto res = lexer.NextToken();
-
-  SECTION("Plus") {
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    REQUIRE(res.first.value() == miniplc0::Token(miniplc0::TokenType::PLUS_SIGN,
-                                                 '+', {0, 0}, {0, 1}));
-  }
-
-  res = lexer.NextToken();
-  SECTION("Minus") {
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    REQUIRE(
-        res.first.value() ==
-        miniplc0::Token(miniplc0::TokenType::MINUS_SIGN, '-', {0, 1}, {0, 2}));
-  }
-
-  res = lexer.NextToken();
-  SECTION("Mult") {
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    REQUIRE(res.first.value() ==
-            miniplc0::Token(miniplc0::TokenType::MULTIPLICATION_SIGN, '*',
-                            {0, 2}, {0, 3}));
-  }
-
-  res = lexer.NextToken();
-  SECTION("Div") {
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    REQUIRE(res.first.value() ==
-            miniplc0::Token(miniplc0::TokenType::DIVISION_SIGN, '/', {0, 3},
-                            {0, 4}));
-  }
-
-  res = lexer.NextToken();
-  SECTION("LParen") {
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    REQUIRE(res.first.value() ==
-            miniplc0::Token(miniplc0::TokenType::LEFT_BRACKET, '(', {0, 4},
-                            {0, 5}));
-  }
-
-  res = lexer.NextToken();
-  SECTION("RParen") {
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    REQUIRE(res.first.value() ==
-            miniplc0::Token(miniplc0::TokenType::RIGHT_BRACKET, ')', {0, 5},
-                            {0, 6}));
-  }
-
-  res = lexer.NextToken();
-  SECTION("Equal") {
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    REQUIRE(
-        res.first.value() ==
-        miniplc0::Token(miniplc0::TokenType::EQUAL_SIGN, '=', {0, 6}, {0, 7}));
-  }
-
-  res = lexer.NextToken();
-  SECTION("Semicolon") {
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    REQUIRE(res.first.value() == miniplc0::Token(miniplc0::TokenType::SEMICOLON,
-                                                 ';', {0, 7}, {0, 8}));
-  }
-}
-
-/* ======== Errors ======== */
-
-TEST_CASE("Test number overflow") {
-  SECTION("Too large numbers obviously overflow") {
-    std::string ins = "10000000000000000 ";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrIntegerOverflow);
-  }
-  SECTION("2147483647 does not overflow") {
-    std::string ins = "2147483647";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE_FALSE(res.second.has_value());
-    REQUIRE(res.first.has_value());
-    // REQUIRE(res.second.value().GetCode() ==
-    // miniplc0::ErrorCode::ErrIntegerOverflow);
-  }
-  SECTION("2147483648 overflows") {
-    std::string ins = "2147483648";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrIntegerOverflow);
-  }
-}
-
-TEST_CASE("Test invalid characters") {
-  SECTION("Single quotes") {
-    std::string ins = "'";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-  SECTION("Double quotes") {
-    std::string ins = "\"";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-  SECTION("Dollar") {
-    std::string ins = "$";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-  SECTION("At") {
-    std::string ins = "@";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-  SECTION("Hashtag") {
-    std::string ins = "#";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-  SECTION("Tilde") {
-    std::string ins = "~";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-  SECTION("Angled bracket") {
-    std::string ins = "<";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-  SECTION("Square bracket") {
-    std::string ins = "<";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-  SECTION("Backslash") {
-    std::string ins = "\\";
-    std::stringstream in(ins);
-    miniplc0::Tokenizer lexer(in);
-    auto res = lexer.NextToken();
-    REQUIRE(res.second.has_value());
-    REQUIRE(res.second.value().GetCode() ==
-            miniplc0::ErrorCode::ErrInvalidInput);
-  }
-}
-
-TEST_CASE("EOF should be reported") {
-  std::string ins = "";
-  std::stringstream in(ins);
-  miniplc0::Tokenizer lexer(in);
-  auto res = lexer.NextToken();
-  REQUIRE(res.second.has_value());
-  REQUIRE(res.second.value().GetCode() == miniplc0::ErrorCode::ErrEOF);
-}
-
-TEST_CASE("EInvalidIdentifier: digit proceeded with letter") {
-  std::string ins = "123abc";
-  std::stringstream in(ins);
-  miniplc0::Tokenizer lexer(in);
-  auto res = lexer.NextToken();
-  REQUIRE(res.second.has_value());
-  REQUIRE(res.second.value().GetCode() ==
-          miniplc0::ErrorCode::ErrInvalidIdentifier);
-}
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "fmt/core.h"
+#include "fmts.hpp"
+std::ostream& operator<<(std::ostream& os, miniplc0::Token const& t) {
+  os << fmt::format("{}", t);
+  return os;
+}
+#include "tokenizer/keywords.h"
+#include "tokenizer/tokenizer.h"
+#include "catch2/catch.hpp"
+
+// 下面是示例如何书写测试用例
+TEST_CASE("Test keywords") {
+  std::string input = "begin end var const print";
+  std::stringstream ss(input);
+  miniplc0::Tokenizer lexer(ss);
+  auto result = lexer.AllTokens();
+
+  std::vector<miniplc0::Token> expected = {
+      miniplc0::Token(miniplc0::TokenType::BEGIN, std::string("begin"), {0, 0},
+                      {0, 5}),
+      miniplc0::Token(miniplc0::TokenType::END, std::string("end"), {0, 6},
+                      {0, 9}),
+      miniplc0::Token(miniplc0::TokenType::VAR, std::string("var"), {0, 10},
+                      {0, 13}),
+      miniplc0::Token(miniplc0::TokenType::CONST, std::string("const"), {0, 14},
+                      {0, 19}),
+      miniplc0::Token(miniplc0::TokenType::PRINT, std::string("print"), {0, 20},
+                      {0, 25}),
+  };
+
+  if (result.second.has_value()) {
+    FAIL("Error introduced in lexing keywords");
+  } else {
+    // for (auto& x : result.first) {
+    //   std::cout << x.GetType() << " " << x.GetValueString() << " "
+    //             << x.GetStartPos().first << " " << x.GetStartPos().second <<
+    //             " "
+    //             << x.GetEndPos().first << " " << x.GetEndPos().second
+    //             << std::endl;
+    // }
+    REQUIRE(result.first == expected);
+  }
+}
+
+TEST_CASE("Test regular numbers") {
+  std::string input = "1 -1 999";
+  std::stringstream ss(input);
+  miniplc0::Tokenizer lexer(ss);
+  auto result = lexer.AllTokens();
+
+  std::vector<miniplc0::Token> expected = {
+      miniplc0::Token(miniplc0::TokenType::UNSIGNED_INTEGER, (int32_t)1, {0, 0},
+                      {0, 1}),
+      miniplc0::Token(miniplc0::TokenType::MINUS_SIGN, '-', {0, 2}, {0, 3}),
+      // minus sign is parsed as separate token
+      miniplc0::Token(miniplc0::TokenType::UNSIGNED_INTEGER, (int32_t)1, {0, 3},
+                      {0, 4}),
+      miniplc0::Token(miniplc0::TokenType::UNSIGNED_INTEGER, (int32_t)999,
+                      {0, 5}, {0, 8}),
+  };
+
+  // miniplc0::CompilationError expected_err()
+
+  if (result.second.has_value()) {
+    FAIL("Error introduced in lexing keywords");
+  } else {
+    REQUIRE(result.first == expected);
+  }
+}
+
+TEST_CASE("Test Identifiers") {
+  std::vector<std::pair<std::string, miniplc0::Token>> cases = {
+      {"a", miniplc0::Token(miniplc0::TokenType::IDENTIFIER, std::string("a"),
+                            {0, 0}, {0, 1})},
+      {"abc123", miniplc0::Token(miniplc0::TokenType::IDENTIFIER,
+                                 std::string("abc123"), {0, 0}, {0, 6})},
+      {"ull", miniplc0::Token(miniplc0::TokenType::IDENTIFIER,
+                              std::string("ull"), {0, 0}, {0, 3})},
+  };
+
+  for (auto& c : cases) {
+    SECTION(fmt::format("case token: {}", c.first)) {
+      std::stringstream in(c.first);
+      miniplc0::Tokenizer lexer(in);
+      auto res = lexer.NextToken();
+      REQUIRE_FALSE(res.second.has_value());
+      REQUIRE(res.first.has_value());
+      REQUIRE(res.first.value() == c.second);
+    }
+  }
+}
+
+TEST_CASE("Test Symbols") {
+  auto s = "+-*/()=;";
+  std::stringstream in(s);
+  miniplc0::Tokenizer lexer(in);
+  auto res = lexer.NextToken();
+
+  SECTION("Plus") {
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    REQUIRE(res.first.value() == miniplc0::Token(miniplc0::TokenType::PLUS_SIGN,
+                                                 '+', {0, 0}, {0, 1}));
+  }
+
+  res = lexer.NextToken();
+  SECTION("Minus") {
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    REQUIRE(
+        res.first.value() ==
+        miniplc0::Token(miniplc0::TokenType::MINUS_SIGN, '-', {0, 1}, {0, 2}));
+  }
+
+  res = lexer.NextToken();
+  SECTION("Mult") {
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    REQUIRE(res.first.value() ==
+            miniplc0::Token(miniplc0::TokenType::MULTIPLICATION_SIGN, '*',
+                            {0, 2}, {0, 3}));
+  }
+
+  res = lexer.NextToken();
+  SECTION("Div") {
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    REQUIRE(res.first.value() ==
+            miniplc0::Token(miniplc0::TokenType::DIVISION_SIGN, '/', {0, 3},
+                            {0, 4}));
+  }
+
+  res = lexer.NextToken();
+  SECTION("LParen") {
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    REQUIRE(res.first.value() ==
+            miniplc0::Token(miniplc0::TokenType::LEFT_BRACKET, '(', {0, 4},
+                            {0, 5}));
+  }
+
+  res = lexer.NextToken();
+  SECTION("RParen") {
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    REQUIRE(res.first.value() ==
+            miniplc0::Token(miniplc0::TokenType::RIGHT_BRACKET, ')', {0, 5},
+                            {0, 6}));
+  }
+
+  res = lexer.NextToken();
+  SECTION("Equal") {
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    REQUIRE(
+        res.first.value() ==
+        miniplc0::Token(miniplc0::TokenType::EQUAL_SIGN, '=', {0, 6}, {0, 7}));
+  }
+
+  res = lexer.NextToken();
+  SECTION("Semicolon") {
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    REQUIRE(res.first.value() == miniplc0::Token(miniplc0::TokenType::SEMICOLON,
+                                                 ';', {0, 7}, {0, 8}));
+  }
+}
+
+/* ======== Errors ======== */
+
+TEST_CASE("Test number overflow") {
+  SECTION("Too large numbers obviously overflow") {
+    std::string ins = "10000000000000000 ";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrIntegerOverflow);
+  }
+  SECTION("2147483647 does not overflow") {
+    std::string ins = "2147483647";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.has_value());
+    // REQUIRE(res.second.value().GetCode() ==
+    // miniplc0::ErrorCode::ErrIntegerOverflow);
+  }
+  SECTION("Leading zeros do not count towards overflow") {
+    std::string ins = "000000000000000002147483647 0000";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.AllTokens();
+    REQUIRE_FALSE(res.second.has_value());
+    REQUIRE(res.first.size() == 2);
+    REQUIRE(res.first[0].GetIntegerValue() == 2147483647);
+    REQUIRE(res.first[0].GetEndPos() ==
+            std::make_pair<uint64_t, uint64_t>(0, 27));
+    REQUIRE(res.first[1].GetIntegerValue() == 0);
+  }
+  SECTION("Overflow is reported at the start of the number") {
+    std::string ins = "1 +\n  99999999999999999999999999999999999999999";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.AllTokens();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrIntegerOverflow);
+    REQUIRE(res.second.value().GetPos() ==
+            std::make_pair<uint64_t, uint64_t>(1, 2));
+  }
+  SECTION("2147483648 overflows") {
+    std::string ins = "2147483648";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrIntegerOverflow);
+  }
+}
+
+TEST_CASE("Test invalid characters") {
+  SECTION("Single quotes") {
+    std::string ins = "'";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+  SECTION("Double quotes") {
+    std::string ins = "\"";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+  SECTION("Dollar") {
+    std::string ins = "$";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+  SECTION("At") {
+    std::string ins = "@";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+  SECTION("Hashtag") {
+    std::string ins = "#";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+  SECTION("Tilde") {
+    std::string ins = "~";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+  SECTION("Angled bracket") {
+    std::string ins = "<";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+  SECTION("Square bracket") {
+    std::string ins = "<";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+  SECTION("Backslash") {
+    std::string ins = "\\";
+    std::stringstream in(ins);
+    miniplc0::Tokenizer lexer(in);
+    auto res = lexer.NextToken();
+    REQUIRE(res.second.has_value());
+    REQUIRE(res.second.value().GetCode() ==
+            miniplc0::ErrorCode::ErrInvalidInput);
+  }
+}
+
+TEST_CASE("EOF should be reported") {
+  std::string ins = "";
+  std::stringstream in(ins);
+  miniplc0::Tokenizer lexer(in);
+  auto res = lexer.NextToken();
+  REQUIRE(res.second.has_value());
+  REQUIRE(res.second.value().GetCode() == miniplc0::ErrorCode::ErrEOF);
+}
+
+TEST_CASE("EInvalidIdentifier: digit proceeded with letter") {
+  std::string ins = "123abc";
+  std::stringstream in(ins);
+  miniplc0::Tokenizer lexer(in);
+  auto res = lexer.NextToken();
+  REQUIRE(res.second.has_value());
+  REQUIRE(res.second.value().GetCode() ==
+          miniplc0::ErrorCode::ErrInvalidIdentifier);
+}
+
+
+/* ======== Source buffer ======== */
+
+TEST_CASE("Source buffer positions are computed from offsets") {
+  miniplc0::SourceBuffer buffer(std::string("ab\n\ncd\nef"));
+  REQUIRE(buffer.PosOf(0) == std::make_pair<uint64_t, uint64_t>(0, 0));
+  REQUIRE(buffer.PosOf(2) == std::make_pair<uint64_t, uint64_t>(0, 2));
+  REQUIRE(buffer.PosOf(3) == std::make_pair<uint64_t, uint64_t>(1, 0));
+  REQUIRE(buffer.PosOf(9) == std::make_pair<uint64_t, uint64_t>(3, 2));
+  // Looking backwards after the index has been built.
+  REQUIRE(buffer.PosOf(5) == std::make_pair<uint64_t, uint64_t>(2, 1));
+  REQUIRE(buffer.PosOf(4) == std::make_pair<uint64_t, uint64_t>(2, 0));
+}
+
+TEST_CASE("Input without trailing newline") {
+  std::vector<std::pair<std::string, miniplc0::Token>> cases = {
+      {"abc", miniplc0::Token(miniplc0::TokenType::IDENTIFIER,
+                              std::string("abc"), {0, 0}, {0, 3})},
+      {"\n 123", miniplc0::Token(miniplc0::TokenType::UNSIGNED_INTEGER,
+                                 (int32_t)123, {1, 1}, {1, 4})},
+  };
+
+  for (auto& c : cases) {
+    SECTION(fmt::format("case token: {}", c.first)) {
+      miniplc0::Tokenizer lexer(miniplc0::SourceBuffer(std::string(c.first)));
+      auto res = lexer.NextToken();
+      REQUIRE_FALSE(res.second.has_value());
+      REQUIRE(res.first.value() == c.second);
+      res = lexer.NextToken();
+      REQUIRE(res.second.value().GetCode() == miniplc0::ErrorCode::ErrEOF);
+    }
+  }
+}
+
+TEST_CASE("Mapped files are tokenized like streams") {
+  std::string input = "begin\r\n  var a = 12;\n\tprint(a);\nend";
+  auto path = std::string("miniplc0_test_mapped_file.txt");
+  {
+    std::ofstream out(path, std::ios::out | std::ios::binary);
+    out << input;
+  }
+  auto buffer = miniplc0::SourceBuffer::FromFile(path);
+  REQUIRE(buffer.has_value());
+  miniplc0::Tokenizer mapped(std::move(buffer.value()));
+  auto from_file = mapped.AllTokens();
+  std::remove(path.c_str());
+
+  std::stringstream ss(input);
+  miniplc0::Tokenizer streamed(ss);
+  auto from_stream = streamed.AllTokens();
+
+  REQUIRE_FALSE(from_file.second.has_value());
+  REQUIRE_FALSE(from_stream.second.has_value());
+  REQUIRE(from_file.first == from_stream.first);
+  REQUIRE(from_file.first.back() ==
+          miniplc0::Token(miniplc0::TokenType::END, std::string("end"), {3, 0},
+                          {3, 3}));
+}
+
+TEST_CASE("Missing files cannot be mapped") {
+  REQUIRE_FALSE(miniplc0::SourceBuffer::FromFile(
+                    "this/file/does/not/exist.miniplc0")
+                    .has_value());
+}
+
+TEST_CASE("Streaming tokenization matches whole-buffer tokenization") {
+  std::string input =
+      "begin\n"
+      "  const limit = 2147483647;\n"
+      "\n"
+      "  var averyveryveryverylongidentifier = (limit - 1) / 2;\n"
+      "  print(averyveryveryverylongidentifier);\r\n"
+      "end";
+  std::stringstream whole_ss(input);
+  miniplc0::Tokenizer whole(whole_ss);
+  auto expected = whole.AllTokens();
+  REQUIRE_FALSE(expected.second.has_value());
+
+  for (std::size_t window : {1, 16, 17, 64, 4096}) {
+    SECTION(fmt::format("window: {}", window)) {
+      std::stringstream ss(input);
+      miniplc0::Tokenizer lexer(miniplc0::SourceBuffer::Streaming(ss, window));
+      auto result = lexer.AllTokens();
+      REQUIRE_FALSE(result.second.has_value());
+      REQUIRE(result.first == expected.first);
+    }
+  }
+}
+
+TEST_CASE("Streaming buffers keep a bounded window") {
+  std::stringstream ss;
+  for (int i = 0; i < 1000; i++) ss << "print(" << i << ");\n";
+  auto buffer = miniplc0::SourceBuffer::Streaming(ss, 64);
+  uint64_t ptr = 0;
+  while (true) {
+    if (ptr == buffer.End() && !buffer.Refill(ptr == 0 ? 0 : ptr - 1)) break;
+    REQUIRE(buffer.Size() <= 64);
+    ptr = buffer.End();
+  }
+  REQUIRE(buffer.End() == ss.str().size());
+  REQUIRE(buffer.PosOf(buffer.End()) ==
+          std::make_pair<uint64_t, uint64_t>(1000, 0));
+}
+
+/* ======== Token values ======== */
+
+TEST_CASE("Token values are accessed without casts") {
+  std::stringstream ss("abc 42 abc +");
+  miniplc0::Tokenizer lexer(ss);
+  auto result = lexer.AllTokens();
+  REQUIRE_FALSE(result.second.has_value());
+  auto& tokens = result.first;
+  REQUIRE(tokens.size() == 4);
+
+  REQUIRE(tokens[0].GetSymbol().has_value());
+  REQUIRE(tokens[0].GetSymbol() == tokens[2].GetSymbol());
+  REQUIRE_FALSE(tokens[0].GetIntegerValue().has_value());
+
+  REQUIRE(tokens[1].GetIntegerValue() == 42);
+  REQUIRE_FALSE(tokens[1].GetSymbol().has_value());
+  REQUIRE(tokens[1].GetValueString() == "42");
+
+  REQUIRE(tokens[3].GetValueString() == "+");
+  REQUIRE_FALSE(tokens[3].GetIntegerValue().has_value());
+
+  auto& interner = miniplc0::Interner::Global();
+  REQUIRE(interner.View(tokens[0].GetSymbol().value()) == "abc");
+  REQUIRE(interner.Intern("abc").first == tokens[0].GetSymbol().value());
+}
+
+TEST_CASE("Tokens use the interner of the innermost scope") {
+  auto global = miniplc0::Interner::Global().Size();
+  miniplc0::Interner outer, inner;
+  std::vector<miniplc0::Token> tokens;
+  {
+    miniplc0::Interner::Scope scope(outer);
+    REQUIRE(&miniplc0::Interner::Current() == &outer);
+    {
+      miniplc0::Interner::Scope nested(inner);
+      std::stringstream ss("scopedonly other scopedonly");
+      miniplc0::Tokenizer lexer(ss);
+      tokens = lexer.AllTokens().first;
+    }
+    REQUIRE(&miniplc0::Interner::Current() == &outer);
+  }
+  REQUIRE(&miniplc0::Interner::Current() == &miniplc0::Interner::Global());
+
+  // Numbered from 0 by the inner interner, and nothing reached the others.
+  REQUIRE(tokens.size() == 3);
+  REQUIRE(tokens[0].GetSymbol() == 0u);
+  REQUIRE(tokens[1].GetSymbol() == 1u);
+  REQUIRE(tokens[2].GetSymbol() == 0u);
+  REQUIRE(inner.Size() == 2);
+  REQUIRE(inner.View(0) == "scopedonly");
+  REQUIRE(outer.Size() == 0);
+  REQUIRE(miniplc0::Interner::Global().Size() == global);
+
+  // Tokens from different interners still compare by their text.
+  REQUIRE(tokens[0] == miniplc0::Token(miniplc0::TokenType::IDENTIFIER,
+                                       std::string("scopedonly"), 0, 0, 0,
+                                       10));
+}
+
+/* ======== Keywords ======== */
+
+TEST_CASE("Keywords are classified by the perfect hash") {
+  REQUIRE(miniplc0::ClassifyWord("begin") == miniplc0::TokenType::BEGIN);
+  REQUIRE(miniplc0::ClassifyWord("end") == miniplc0::TokenType::END);
+  REQUIRE(miniplc0::ClassifyWord("var") == miniplc0::TokenType::VAR);
+  REQUIRE(miniplc0::ClassifyWord("const") == miniplc0::TokenType::CONST);
+  REQUIRE(miniplc0::ClassifyWord("print") == miniplc0::TokenType::PRINT);
+  // The length bounds come from the table, so no keyword falls outside them.
+  for (auto& kw : miniplc0::detail::Keywords)
+    REQUIRE(miniplc0::ClassifyWord(kw.text) == kw.type);
+  REQUIRE(miniplc0::detail::KeywordMinLength == 3);
+  REQUIRE(miniplc0::detail::KeywordMaxLength == 5);
+  // Same length, first and last char as some keyword, and case variants.
+  for (auto word : {"bxxxn", "exd", "vbr", "cxxst", "pxxxt", "Begin", "END",
+                    "beginx", "en", "", "a", "vars", "printf", "const0",
+                    "pint", "b3gin", "tne", "rav"})
+    REQUIRE(miniplc0::ClassifyWord(word) == miniplc0::TokenType::IDENTIFIER);
+}
+
+/* ======== Scan engines ======== */
+
+TEST_CASE("Scan engines agree with the character class table") {
+  // Every byte value, at every position of a run long enough to go through
+  // the vector loops.
+  for (auto engine : {miniplc0::ScanEngine::SCALAR, miniplc0::ScanEngine::SSE2,
+                      miniplc0::ScanEngine::AVX2}) {
+    if (!miniplc0::Scanner::IsSupported(engine)) continue;
+    auto& scanner = miniplc0::Scanner::Get(engine);
+    REQUIRE(scanner.engine == engine);
+    for (int ch = 0; ch < 256; ch++) {
+      for (std::size_t at = 0; at < 70; at += 3) {
+        std::string spaces(80, ' '), ident(80, 'a'), digits(80, '7');
+        spaces[at] = ident[at] = digits[at] = static_cast<char>(ch);
+        auto cls = miniplc0::ClassOf(static_cast<char>(ch));
+        auto expect = [&](bool in_class) { return in_class ? 80 : at; };
+        auto run = [](miniplc0::Scanner::ScanFunction f, const std::string& s) {
+          return static_cast<std::size_t>(f(s.data(), s.data() + s.size()) -
+                                          s.data());
+        };
+        INFO(fmt::format("{} byte {} at {}",
+                         miniplc0::ScanEngineName(engine), ch, at));
+        REQUIRE(run(scanner.SkipSpaces, spaces) ==
+                expect(cls & miniplc0::SPACE_CHAR));
+        REQUIRE(run(scanner.SkipIdentifier, ident) ==
+                expect(cls & (miniplc0::ALPHA_CHAR | miniplc0::DIGIT_CHAR)));
+        REQUIRE(run(scanner.SkipDigits, digits) ==
+                expect(cls & miniplc0::DIGIT_CHAR));
+      }
+      REQUIRE(static_cast<bool>(miniplc0::ClassOf(static_cast<char>(ch)) &
+                                miniplc0::SPACE_CHAR) ==
+              miniplc0::isspace(static_cast<char>(ch)));
+      REQUIRE(static_cast<bool>(miniplc0::ClassOf(static_cast<char>(ch)) &
+                                miniplc0::ALPHA_CHAR) ==
+              miniplc0::isalpha(static_cast<char>(ch)));
+      REQUIRE(static_cast<bool>(miniplc0::ClassOf(static_cast<char>(ch)) &
+                                miniplc0::DIGIT_CHAR) ==
+              miniplc0::isdigit(static_cast<char>(ch)));
+    }
+  }
+}
+
+TEST_CASE("Scan engines produce identical tokens") {
+  std::vector<std::string> inputs = {
+      "begin\n  const a = 1;\n  var b;\nend\n",
+      std::string(100, ' ') + "\t\r\n\v\f" + std::string(100, 'x') + "1;" +
+          std::string(40, '9') + " " + std::string(33, '1'),
+      "verylongidentifierwithdigits0123456789andmoreletters = 2147483647;",
+      "print(1234567890123);",
+      "a\x80" "b",
+      "12345678901234567890123456789012345abc",
+      "x = (y + 12) * z / 3 - 4;\r\n" + std::string(64, '\n') + "end",
+  };
+  for (auto& input : inputs) {
+    std::stringstream expected_ss(input);
+    miniplc0::Tokenizer expected_lexer(expected_ss);
+    expected_lexer.UseScanEngine(miniplc0::ScanEngine::SCALAR);
+    auto expected = expected_lexer.AllTokens();
+
+    for (auto engine : {miniplc0::ScanEngine::SSE2,
+                        miniplc0::ScanEngine::AVX2}) {
+      for (std::size_t window : {0, 16, 33}) {
+        INFO(fmt::format("{} window {}: {}", miniplc0::ScanEngineName(engine),
+                         window, input));
+        std::stringstream ss(input);
+        auto buffer = window == 0
+                          ? miniplc0::SourceBuffer::FromStream(ss)
+                          : miniplc0::SourceBuffer::Streaming(ss, window);
+        miniplc0::Tokenizer lexer(std::move(buffer));
+        lexer.UseScanEngine(engine);
+        auto result = lexer.AllTokens();
+        REQUIRE(result.first == expected.first);
+        REQUIRE(result.second.has_value() == expected.second.has_value());
+        if (expected.second.has_value())
+          REQUIRE(result.second.value().GetCode() ==
+                  expected.second.value().GetCode());
+      }
+    }
+  }
+}
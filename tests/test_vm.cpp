@@ -0,0 +1,324 @@
+#include "analyser/analyser.h"
+#include "instruction/instruction.h"
+#include "tokenizer/tokenizer.h"
+#include "vm/fusion.h"
+#include "vm/jit.h"
+#include "vm/register_vm.h"
+#include "vm/vm.h"
+
+#include <climits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "fmt/core.h"
+#include "fmts.hpp"
+#include "compile.hpp"
+#include "simple_vm.hpp"
+#include "catch2/catch.hpp"
+
+namespace {
+using miniplc0::Instruction;
+using miniplc0::Operation;
+using miniplc0::VirtualMachine;
+
+// Runs the program on the test VM, with both dispatch modes, fused and
+// unfused, on the register machine and as native code, and checks that
+// they agree.
+// Returns the error, if any.
+std::optional<miniplc0::RuntimeError> runAll(
+    const std::vector<Instruction>& code) {
+  std::vector<int32_t> expected;
+  bool trapped = false;
+  try {
+    miniplc0::VM vm(code);
+    expected = vm.Run();
+  } catch (std::out_of_range&) {
+    trapped = true;
+  }
+
+  VirtualMachine threaded_vm(code, VirtualMachine::THREADED);
+  VirtualMachine switch_vm(code, VirtualMachine::SWITCH);
+  auto threaded = threaded_vm.Run();
+  auto switched = switch_vm.Run();
+  // A second run starts over.
+  REQUIRE(threaded_vm.Run() == threaded);
+  REQUIRE(threaded.first == switched.first);
+  REQUIRE(threaded.second == switched.second);
+  REQUIRE(threaded.second.has_value() == trapped);
+  if (!trapped) REQUIRE(threaded.first == expected);
+
+  auto fused = miniplc0::FuseInstructions(code);
+  REQUIRE(fused.first.size() == fused.second.size());
+  REQUIRE(fused.first.size() <= code.size());
+  for (auto dispatch : {VirtualMachine::THREADED, VirtualMachine::SWITCH}) {
+    auto result = VirtualMachine(fused.first, dispatch).Run();
+    REQUIRE(result.first == threaded.first);
+    REQUIRE(result.second.has_value() == threaded.second.has_value());
+    if (result.second.has_value()) {
+      auto& err = result.second.value();
+      REQUIRE(miniplc0::RuntimeError(fused.second[err.GetIndex()],
+                                     err.GetCode()) == threaded.second);
+    }
+  }
+
+  miniplc0::RegisterMachine registers(code);
+  REQUIRE(registers.Size() <= code.size());
+  REQUIRE(registers.Run() == threaded);
+  REQUIRE(registers.Run() == threaded);
+  miniplc0::JitProgram jit(code);
+  REQUIRE(jit.Run() == threaded);
+  REQUIRE(jit.Run() == threaded);
+  auto fused_registers = miniplc0::RegisterMachine(fused.first).Run();
+  REQUIRE(fused_registers.first == threaded.first);
+  if (fused_registers.second.has_value()) {
+    auto& err = fused_registers.second.value();
+    REQUIRE(miniplc0::RuntimeError(fused.second[err.GetIndex()],
+                                   err.GetCode()) == threaded.second);
+  }
+  return threaded.second;
+}
+}  // namespace
+
+TEST_CASE("Compiled programs run like on the test VM") {
+  std::string input =
+      "begin\n"
+      "  const a = 7;\n"
+      "  var b = a * a - 3;\n"
+      "  var c;\n"
+      "  c = (b + a) / -2;\n"
+      "  print(c);\n"
+      "  print(a - (b - c) * 2);\n"
+      "  b = 2147483647;\n"
+      "  print(b);\n"
+      "end";
+  auto err = runAll(compile(input));
+  REQUIRE_FALSE(err.has_value());
+  VirtualMachine vm(compile(input));
+  REQUIRE(vm.Run().first == std::vector<int32_t>{-26, -137, 2147483647});
+}
+
+TEST_CASE("Arithmetic errors trap at the faulting instruction") {
+  SECTION("Addition") {
+    auto err = runAll(compile("begin print(2147483647 + 1); end"));
+    REQUIRE(err == miniplc0::RuntimeError(2, miniplc0::ErrAddOverflow));
+  }
+  SECTION("Subtraction") {
+    auto err = runAll(compile("begin print(-2147483647 - 2); end"));
+    REQUIRE(err.has_value());
+    REQUIRE(err.value().GetCode() == miniplc0::ErrSubOverflow);
+  }
+  SECTION("Multiplication") {
+    auto err = runAll(compile("begin print(65536 * 32768); end"));
+    REQUIRE(err == miniplc0::RuntimeError(2, miniplc0::ErrMulOverflow));
+  }
+  SECTION("Division by zero") {
+    auto err = runAll(compile("begin print(1); print(1 / (1 - 1)); end"));
+    REQUIRE(err.has_value());
+    REQUIRE(err.value().GetCode() == miniplc0::ErrDivideByZero);
+  }
+  SECTION("INT_MIN / -1") {
+    std::vector<Instruction> code = {
+        Instruction(Operation::LIT, INT_MIN),
+        Instruction(Operation::LIT, -1),
+        Instruction(Operation::DIV, 0),
+    };
+    VirtualMachine vm(code);
+    auto result = vm.Run();
+    REQUIRE(result.second ==
+            miniplc0::RuntimeError(2, miniplc0::ErrDivOverflow));
+  }
+  SECTION("Illegal instruction") {
+    std::vector<Instruction> code = {
+        Instruction(Operation::LIT, 1),
+        Instruction(Operation::WRT, 0),
+        Instruction(Operation::ILL, 0),
+        Instruction(Operation::WRT, 0),
+    };
+    VirtualMachine vm(code);
+    auto result = vm.Run();
+    REQUIRE(result.first == std::vector<int32_t>{1});
+    REQUIRE(result.second ==
+            miniplc0::RuntimeError(2, miniplc0::ErrIllegalInstruction));
+  }
+}
+
+TEST_CASE("Programs that misuse the stack are rejected before running") {
+  std::vector<std::vector<Instruction>> programs = {
+      {Instruction(Operation::WRT, 0)},
+      {Instruction(Operation::LIT, 1), Instruction(Operation::ADD, 0)},
+      {Instruction(Operation::LIT, 1), Instruction(Operation::LOD, 1)},
+      {Instruction(Operation::LIT, 1), Instruction(Operation::STO, -1)},
+      {Instruction(Operation::LIT, 1), Instruction(Operation::WRT, 0),
+       Instruction(Operation::STO, 0)},
+  };
+  for (auto& code : programs) {
+    VirtualMachine vm(code);
+    auto result = vm.Run();
+    REQUIRE(result.first.empty());
+    REQUIRE(result.second.has_value());
+    REQUIRE(result.second.value().GetCode() == miniplc0::ErrInvalidProgram);
+    REQUIRE(result.second.value().GetIndex() == code.size() - 1);
+    REQUIRE(miniplc0::RegisterMachine(code).Run() == result);
+    REQUIRE(miniplc0::JitProgram(code).Run() == result);
+  }
+}
+
+TEST_CASE("Common sequences are fused into superinstructions") {
+  auto code = compile(
+      "begin const b = 2; var a = 1; a = -(a + b) * a; a = a / -b - 3;"
+      "a = a * b + a * a; print(-a); end");
+  auto fused = miniplc0::FuseInstructions(code);
+  std::vector<Instruction> expected = {
+      Instruction(Operation::LIT, 2),    Instruction(Operation::LIT, 1),
+      // a = -(a + b) * a;
+      Instruction(Operation::LOD, 1),    Instruction(Operation::LODADD, 0),
+      Instruction(Operation::NEG, 0),    Instruction(Operation::LODMUL, 1),
+      Instruction(Operation::STO, 1),
+      // a = a / -b - 3;
+      Instruction(Operation::LOD, 1),    Instruction(Operation::LIT, 0),
+      Instruction(Operation::LODSUB, 0), Instruction(Operation::DIV, 0),
+      Instruction(Operation::SUBI, 3),   Instruction(Operation::STO, 1),
+      // a = a * b + a * a;
+      Instruction(Operation::LOD, 1),    Instruction(Operation::LODMUL, 0),
+      Instruction(Operation::LOD, 1),    Instruction(Operation::LODMUL, 1),
+      Instruction(Operation::ADDSTO, 1),
+      // print(-a);
+      Instruction(Operation::LIT, 0),    Instruction(Operation::LODSUB, 1),
+      Instruction(Operation::WRT, 0),
+  };
+  REQUIRE(fused.first == expected);
+  REQUIRE(runAll(code) == std::nullopt);
+
+  // The LIT 0 of a unary minus can only go when nothing in between names a
+  // slot that would move.
+  std::vector<Instruction> moved = {
+      Instruction(Operation::LIT, 5),    Instruction(Operation::LIT, 0),
+      Instruction(Operation::LIT, 7),    Instruction(Operation::LOD, 2),
+      Instruction(Operation::MUL, 0),    Instruction(Operation::SUB, 0),
+      Instruction(Operation::WRT, 0),
+  };
+  REQUIRE(miniplc0::FuseInstructions(moved).first.size() == 6);
+  REQUIRE(runAll(moved) == std::nullopt);
+
+  // The trap is reported at the SUB, which is what the fused NEG came from.
+  auto trap = compile("begin var a = 1; print(-(a - 2147483647 - 2)); end");
+  auto err = runAll(trap);
+  REQUIRE(err.has_value());
+  REQUIRE(err.value().GetCode() == miniplc0::ErrSubOverflow);
+}
+
+TEST_CASE("Programs are lowered to three-address register code") {
+  using miniplc0::RegisterOperation;
+  auto code =
+      compile("begin var a = 1; var b; b = a + 2; print(b * a); end");
+  auto lowered = miniplc0::LowerToRegisters(code);
+  // Loads and literals are read where they are, and the sum goes straight
+  // into b. Constants 1, 0 and 2 follow the four stack registers.
+  std::vector<miniplc0::RegisterInstruction> expected = {
+      {RegisterOperation::ADD, 1, 4, 6},
+      {RegisterOperation::MUL, 2, 1, 4},
+      {RegisterOperation::WRT, 0, 2, 0},
+  };
+  REQUIRE(lowered.code == expected);
+  REQUIRE(lowered.stack == 4);
+  REQUIRE(lowered.constants == std::vector<int32_t>{1, 0, 2});
+  REQUIRE(lowered.origins == std::vector<std::size_t>{4, 8, 9});
+  REQUIRE(runAll(code) == std::nullopt);
+
+  // b still reads a when a changes, so it gets a copy first.
+  code = compile(
+      "begin var a = 2 * 3; var b = a; a = 5; print(b); print(a); end");
+  lowered = miniplc0::LowerToRegisters(code);
+  expected = {
+      {RegisterOperation::MUL, 0, 3, 4}, {RegisterOperation::MOV, 1, 0, 0},
+      {RegisterOperation::MOV, 0, 5, 0}, {RegisterOperation::WRT, 0, 1, 0},
+      {RegisterOperation::WRT, 0, 0, 0},
+  };
+  REQUIRE(lowered.code == expected);
+  REQUIRE(miniplc0::RegisterMachine(code).Run().first ==
+          std::vector<int32_t>{6, 5});
+
+  // A result stored to where its left operand was lands just past the top
+  // of the stack, where nothing can read it.
+  std::vector<std::vector<Instruction>> past_top = {
+      {Instruction(Operation::LIT, 1), Instruction(Operation::LIT, 2),
+       Instruction(Operation::ADDSTO, 0)},
+      {Instruction(Operation::LIT, 1), Instruction(Operation::LIT, 2),
+       Instruction(Operation::ADDSTO, 0), Instruction(Operation::LIT, 4),
+       Instruction(Operation::WRT, 0)},
+      {Instruction(Operation::LIT, 5), Instruction(Operation::LIT, 1),
+       Instruction(Operation::LIT, 2), Instruction(Operation::MULSTO, 1),
+       Instruction(Operation::LOD, 0), Instruction(Operation::WRT, 0)},
+  };
+  for (auto& program : past_top) REQUIRE(runAll(program) == std::nullopt);
+}
+
+TEST_CASE("Native code traps like the interpreter") {
+  if (miniplc0::JitProgram::IsSupported())
+    REQUIRE(miniplc0::JitProgram(compile("begin print(1); end")).IsCompiled());
+  // Divisors known at compile time and divisors in a variable take different
+  // paths through the generated code.
+  std::vector<std::vector<Instruction>> programs = {
+      {Instruction(Operation::LIT, INT_MIN), Instruction(Operation::LIT, -1),
+       Instruction(Operation::DIV, 0)},
+      {Instruction(Operation::LIT, INT_MIN), Instruction(Operation::LIT, -1),
+       Instruction(Operation::LIT, 7), Instruction(Operation::WRT, 0),
+       Instruction(Operation::LOD, 0), Instruction(Operation::LOD, 1),
+       Instruction(Operation::DIV, 0)},
+      {Instruction(Operation::LIT, 0), Instruction(Operation::LIT, 3),
+       Instruction(Operation::LOD, 0), Instruction(Operation::DIV, 0)},
+      {Instruction(Operation::LIT, 3), Instruction(Operation::LIT, 0),
+       Instruction(Operation::DIV, 0)},
+      {Instruction(Operation::LIT, -7), Instruction(Operation::LIT, 2),
+       Instruction(Operation::LOD, 0), Instruction(Operation::LIT, -1),
+       Instruction(Operation::DIV, 0), Instruction(Operation::LOD, 0),
+       Instruction(Operation::LOD, 1), Instruction(Operation::DIV, 0),
+       Instruction(Operation::WRT, 0), Instruction(Operation::WRT, 0)},
+      {Instruction(Operation::LIT, 1), Instruction(Operation::WRT, 0),
+       Instruction(Operation::ILL, 0), Instruction(Operation::WRT, 0)},
+  };
+  for (auto& code : programs) {
+    INFO(code.size());
+    auto expected = VirtualMachine(code).Run();
+    REQUIRE(miniplc0::JitProgram(code).Run() == expected);
+  }
+}
+
+TEST_CASE("Random programs run like on the test VM") {
+  std::mt19937 rng(20191106);
+  auto pick = [&](int n) {
+    return std::uniform_int_distribution<int>(0, n - 1)(rng);
+  };
+  const int32_t values[] = {0, 1, -1, 2, 3, 7, 100, 46341, 65536, INT_MAX};
+  for (int round = 0; round < 500; round++) {
+    // A few variables, then statements that keep the stack balanced.
+    std::vector<Instruction> code;
+    int vars = 1 + pick(4);
+    for (int i = 0; i < vars; i++)
+      code.emplace_back(Operation::LIT, values[pick(10)]);
+    for (int stmt = 0; stmt < 8; stmt++) {
+      int depth = 0;
+      int ops = 1 + pick(6);
+      for (int i = 0; i < ops || depth > 1; i++) {
+        if (depth < 2 || (i < ops && pick(2) == 0)) {
+          if (pick(2) == 0)
+            code.emplace_back(Operation::LIT, values[pick(10)]);
+          else
+            code.emplace_back(Operation::LOD, pick(vars));
+          depth++;
+        } else {
+          code.emplace_back(static_cast<Operation>(Operation::ADD + pick(4)),
+                            0);
+          depth--;
+        }
+      }
+      if (pick(2) == 0)
+        code.emplace_back(Operation::WRT, 0);
+      else
+        code.emplace_back(Operation::STO, pick(vars));
+    }
+    runAll(code);
+  }
+}
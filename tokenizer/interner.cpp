@@ -0,0 +1,84 @@
+#include "tokenizer/interner.h"
+
+#include "error/error.h"
+
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+namespace miniplc0 {
+
+namespace {
+// The interner installed by the innermost Scope on this thread, if any.
+thread_local Interner* current_interner = nullptr;
+}  // namespace
+
+Interner& Interner::Global() {
+  static Interner interner;
+  return interner;
+}
+
+Interner& Interner::Current() {
+  return current_interner != nullptr ? *current_interner : Global();
+}
+
+Interner::Scope::Scope(Interner& interner) : _previous(current_interner) {
+  current_interner = &interner;
+}
+
+Interner::Scope::~Scope() { current_interner = _previous; }
+
+std::pair<Symbol, std::string_view> Interner::Intern(std::string_view s) {
+  {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _index.find(s);
+    if (it != _index.end()) return std::make_pair(it->second, it->first);
+  }
+
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  // Someone else may have added it while we were waiting for the lock.
+  auto it = _index.find(s);
+  if (it != _index.end()) return std::make_pair(it->second, it->first);
+
+  if (_views.size() == std::numeric_limits<Symbol>::max())
+    DieAndPrint("too many distinct identifiers");
+  auto sym = static_cast<Symbol>(_views.size());
+  auto view = store(s);
+  _views.emplace_back(view);
+  _index.emplace(view, sym);
+  return std::make_pair(sym, view);
+}
+
+std::string_view Interner::View(Symbol sym) const {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  if (sym >= _views.size()) DieAndPrint("unknown symbol");
+  return _views[sym];
+}
+
+std::size_t Interner::Size() const {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _views.size();
+}
+
+std::string_view Interner::store(std::string_view s) {
+  static const size_t chunk = 64 * 1024;
+  if (s.empty()) return std::string_view();
+  if (s.size() > _left) {
+    // Oversized strings get a chunk of their own so that the current one
+    // can still be filled up.
+    if (s.size() > chunk / 4) {
+      _chunks.emplace_back(new char[s.size()]);
+      std::memcpy(_chunks.back().get(), s.data(), s.size());
+      return std::string_view(_chunks.back().get(), s.size());
+    }
+    _chunks.emplace_back(new char[chunk]);
+    _cur = _chunks.back().get();
+    _left = chunk;
+  }
+  std::memcpy(_cur, s.data(), s.size());
+  std::string_view view(_cur, s.size());
+  _cur += s.size();
+  _left -= s.size();
+  return view;
+}
+}  // namespace miniplc0
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 字符串在 Interner 中的编号
+using Symbol = std::uint32_t;
+
+// 标识符和关键字的字符串表
+//
+// 内容相同的字符串只保存一份，并按出现的顺序分配从 0 开始的稠密编号。
+// 保存下来的字符串在 Interner 销毁之前既不会被释放也不会被移动，
+// 所以可以放心地在 Token 里用 std::string_view 引用它们。
+// 可以在多个线程中同时使用。
+//
+// Token 用的是当前线程的 Current()，默认是整个程序共用、从不释放的
+// Global()。一直运行的 --batch --serve --lsp 用 Scope 给每次编译或者每个
+// 文档换上自己的实例，用完就释放，编号也只和这一次编译有关；
+// 这时得到的 Token 不能比那个实例活得更久。
+class Interner final {
+ private:
+  using size_t = std::size_t;
+
+ public:
+  static Interner& Global();
+  // 当前线程的 Token 使用的实例
+  static Interner& Current();
+
+  // 在一个作用域里让当前线程使用 interner，离开时恢复原来的
+  class Scope final {
+   public:
+    explicit Scope(Interner& interner);
+    Scope(const Scope&) = delete;
+    Scope& operator=(Scope) = delete;
+    ~Scope();
+
+   private:
+    Interner* _previous;
+  };
+
+  Interner() : _chunks(), _cur(nullptr), _left(0), _index(), _views() {}
+  Interner(const Interner&) = delete;
+  Interner(Interner&&) = delete;
+  Interner& operator=(Interner) = delete;
+
+  // 返回 s 的编号和一份不会失效的拷贝
+  std::pair<Symbol, std::string_view> Intern(std::string_view s);
+  // 编号对应的字符串，编号必须来自 Intern
+  std::string_view View(Symbol sym) const;
+  // 已经保存的字符串个数，所有编号都小于它
+  size_t Size() const;
+
+ private:
+  // 把字符串拷贝进不会移动的存储里
+  std::string_view store(std::string_view s);
+
+ private:
+  mutable std::shared_mutex _mutex;
+
+  // 字符串的实际存储，一块用完了再申请下一块
+  std::vector<std::unique_ptr<char[]>> _chunks;
+  char* _cur;
+  size_t _left;
+
+  std::unordered_map<std::string_view, Symbol> _index;
+  std::vector<std::string_view> _views;
+};
+}  // namespace miniplc0
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "tokenizer/token.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace miniplc0 {
+
+namespace detail {
+struct Keyword {
+  std::string_view text;
+  TokenType type;
+};
+
+inline constexpr Keyword Keywords[] = {
+    {"begin", TokenType::BEGIN}, {"end", TokenType::END},
+    {"var", TokenType::VAR},     {"const", TokenType::CONST},
+    {"print", TokenType::PRINT},
+};
+
+// 最短和最长的关键字的长度，长度不在这之间的单词一定是标识符
+constexpr std::size_t FindKeywordLength(bool longest) {
+  auto length = Keywords[0].text.size();
+  for (auto& kw : Keywords)
+    if (longest ? kw.text.size() > length : kw.text.size() < length)
+      length = kw.text.size();
+  return length;
+}
+
+inline constexpr std::size_t KeywordMinLength = FindKeywordLength(false);
+inline constexpr std::size_t KeywordMaxLength = FindKeywordLength(true);
+inline constexpr std::uint32_t KeywordTableSize = 1 << 3;
+
+// 只看首尾两个字符和长度，拼起来之后做一次乘法哈希，取最高的三位
+// 乘数 seed 在编译期从黄金分割数附近找出来，保证关键字之间没有冲突
+constexpr std::uint32_t KeywordHash(std::string_view s, std::uint32_t seed) {
+  auto key = static_cast<std::uint32_t>(static_cast<unsigned char>(s.front()))
+                 << 16 |
+             static_cast<std::uint32_t>(static_cast<unsigned char>(s.back()))
+                 << 8 |
+             static_cast<std::uint32_t>(s.size() & 0xff);
+  return static_cast<std::uint32_t>(key * seed) >> 29;
+}
+
+constexpr bool IsPerfect(std::uint32_t seed) {
+  bool used[KeywordTableSize] = {};
+  for (auto& kw : Keywords) {
+    auto h = KeywordHash(kw.text, seed);
+    if (used[h]) return false;
+    used[h] = true;
+  }
+  return true;
+}
+
+constexpr std::uint32_t FindKeywordSeed() {
+  for (std::uint32_t seed = 0x9e3779b1; seed < 0x9e3779b1 + 8192; seed += 2)
+    if (IsPerfect(seed)) return seed;
+  return 0;
+}
+
+inline constexpr std::uint32_t KeywordSeed = FindKeywordSeed();
+static_assert(KeywordSeed != 0, "no perfect hash for the keywords");
+
+constexpr std::array<Keyword, KeywordTableSize> MakeKeywordTable() {
+  std::array<Keyword, KeywordTableSize> table{};
+  for (auto& slot : table) slot = Keyword{std::string_view(), IDENTIFIER};
+  for (auto& kw : Keywords) table[KeywordHash(kw.text, KeywordSeed)] = kw;
+  return table;
+}
+
+inline constexpr std::array<Keyword, KeywordTableSize> KeywordTable =
+    MakeKeywordTable();
+}  // namespace detail
+
+// 一个由字母和数字组成的单词是关键字还是标识符
+// 用编译期生成的完美哈希表查找，最多只需要和一个关键字比较一次
+inline TokenType ClassifyWord(std::string_view word) {
+  if (word.size() < detail::KeywordMinLength ||
+      word.size() > detail::KeywordMaxLength)
+    return IDENTIFIER;
+  auto& kw =
+      detail::KeywordTable[detail::KeywordHash(word, detail::KeywordSeed)];
+  return kw.text == word ? kw.type : IDENTIFIER;
+}
+}  // namespace miniplc0
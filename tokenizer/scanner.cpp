@@ -0,0 +1,172 @@
+#include "tokenizer/scanner.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MINIPLC0_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace miniplc0 {
+
+namespace {
+
+template <std::uint8_t Class>
+const char* skipScalar(const char* p, const char* end) {
+  while (p != end && (ClassOf(*p) & Class)) p++;
+  return p;
+}
+
+#ifdef MINIPLC0_SCAN_X86
+// The vector kernels classify a whole block with a few compares and then find
+// the first byte outside the class from the movemask. Unsigned range checks
+// are done as min(x - lo, hi - lo) == x - lo, since SSE2 has no unsigned
+// byte compare. Whatever is left over at the end goes through the table.
+
+inline __m128i inRange(__m128i x, char lo, char hi) {
+  auto t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(hi - lo)), t);
+}
+
+template <std::uint8_t Class>
+inline __m128i classify(__m128i x) {
+  auto r = _mm_setzero_si128();
+  if (Class & SPACE_CHAR)
+    r = _mm_or_si128(r, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                                     inRange(x, '\t', '\r')));
+  if (Class & ALPHA_CHAR)
+    r = _mm_or_si128(r, inRange(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z'));
+  if (Class & DIGIT_CHAR) r = _mm_or_si128(r, inRange(x, '0', '9'));
+  return r;
+}
+
+template <std::uint8_t Class>
+const char* skipSSE2(const char* p, const char* end) {
+  // Most runs between tokens are empty or a single space, which is not worth
+  // a vector load.
+  if (p == end || !(ClassOf(*p) & Class)) return p;
+  while (end - p >= 16) {
+    auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = ~_mm_movemask_epi8(classify<Class>(x)) & 0xffffu;
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+  return skipScalar<Class>(p, end);
+}
+
+__attribute__((target("avx2"))) inline __m256i inRange256(__m256i x, char lo,
+                                                          char hi) {
+  auto t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(hi - lo)), t);
+}
+
+template <std::uint8_t Class>
+__attribute__((target("avx2"))) inline __m256i classify256(__m256i x) {
+  auto r = _mm256_setzero_si256();
+  if (Class & SPACE_CHAR)
+    r = _mm256_or_si256(
+        r, _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                           inRange256(x, '\t', '\r')));
+  if (Class & ALPHA_CHAR)
+    r = _mm256_or_si256(
+        r, inRange256(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z'));
+  if (Class & DIGIT_CHAR) r = _mm256_or_si256(r, inRange256(x, '0', '9'));
+  return r;
+}
+
+template <std::uint8_t Class>
+__attribute__((target("avx2"))) const char* skipAVX2(const char* p,
+                                                      const char* end) {
+  if (p == end || !(ClassOf(*p) & Class)) return p;
+  while (end - p >= 32) {
+    auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    auto mask = ~static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(classify256<Class>(x)));
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return skipSSE2<Class>(p, end);
+}
+#endif
+
+constexpr std::uint8_t IdentifierChar = ALPHA_CHAR | DIGIT_CHAR;
+
+const Scanner scalarScanner{ScanEngine::SCALAR, skipScalar<SPACE_CHAR>,
+                            skipScalar<IdentifierChar>,
+                            skipScalar<DIGIT_CHAR>};
+#ifdef MINIPLC0_SCAN_X86
+const Scanner sse2Scanner{ScanEngine::SSE2, skipSSE2<SPACE_CHAR>,
+                          skipSSE2<IdentifierChar>, skipSSE2<DIGIT_CHAR>};
+const Scanner avx2Scanner{ScanEngine::AVX2, skipAVX2<SPACE_CHAR>,
+                          skipAVX2<IdentifierChar>, skipAVX2<DIGIT_CHAR>};
+#endif
+
+std::atomic<const Scanner*>& defaultScanner() {
+  static std::atomic<const Scanner*> scanner(&Scanner::Best());
+  return scanner;
+}
+}  // namespace
+
+bool Scanner::IsSupported(ScanEngine engine) {
+  switch (engine) {
+    case ScanEngine::SCALAR:
+      return true;
+#ifdef MINIPLC0_SCAN_X86
+    case ScanEngine::SSE2:
+      // Part of the x86-64 baseline.
+      return true;
+    case ScanEngine::AVX2: {
+      static const bool avx2 = __builtin_cpu_supports("avx2");
+      return avx2;
+    }
+#endif
+    default:
+      return false;
+  }
+}
+
+const Scanner& Scanner::Get(ScanEngine engine) {
+  if (!IsSupported(engine)) return scalarScanner;
+  switch (engine) {
+#ifdef MINIPLC0_SCAN_X86
+    case ScanEngine::SSE2:
+      return sse2Scanner;
+    case ScanEngine::AVX2:
+      return avx2Scanner;
+#endif
+    default:
+      return scalarScanner;
+  }
+}
+
+const Scanner& Scanner::Best() {
+  for (auto engine : {ScanEngine::AVX2, ScanEngine::SSE2})
+    if (IsSupported(engine)) return Get(engine);
+  return scalarScanner;
+}
+
+const Scanner& Scanner::Default() { return *defaultScanner().load(); }
+
+void Scanner::SetDefault(ScanEngine engine) {
+  defaultScanner().store(&Get(engine));
+}
+
+std::optional<ScanEngine> ParseScanEngine(std::string_view name) {
+  if (name == "scalar") return ScanEngine::SCALAR;
+  if (name == "sse2") return ScanEngine::SSE2;
+  if (name == "avx2") return ScanEngine::AVX2;
+  return {};
+}
+
+std::string_view ScanEngineName(ScanEngine engine) {
+  switch (engine) {
+    case ScanEngine::SCALAR:
+      return "scalar";
+    case ScanEngine::SSE2:
+      return "sse2";
+    case ScanEngine::AVX2:
+      return "avx2";
+  }
+  return "unknown";
+}
+}  // namespace miniplc0
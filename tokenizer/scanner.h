@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace miniplc0 {
+
+// 字符的种类，用位表示
+enum CharClass : std::uint8_t {
+  OTHER_CHAR = 0,
+  SPACE_CHAR = 1 << 0,
+  ALPHA_CHAR = 1 << 1,
+  DIGIT_CHAR = 1 << 2,
+};
+
+namespace detail {
+constexpr std::array<std::uint8_t, 256> MakeCharClassTable() {
+  std::array<std::uint8_t, 256> table{};
+  for (int ch = 0; ch < 256; ch++) {
+    std::uint8_t cls = OTHER_CHAR;
+    if (ch == ' ' || (ch >= '\t' && ch <= '\r')) cls |= SPACE_CHAR;
+    if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')) cls |= ALPHA_CHAR;
+    if (ch >= '0' && ch <= '9') cls |= DIGIT_CHAR;
+    table[ch] = cls;
+  }
+  return table;
+}
+}  // namespace detail
+
+// 256 项的字符分类表，和 C locale 下的 std::isspace、std::isalpha、std::isdigit
+// 的结果一致，但不用每次都去查 locale
+inline constexpr std::array<std::uint8_t, 256> CharClassTable =
+    detail::MakeCharClassTable();
+
+inline std::uint8_t ClassOf(char ch) {
+  return CharClassTable[static_cast<unsigned char>(ch)];
+}
+
+// 扫描用的指令集
+enum class ScanEngine {
+  SCALAR,
+  SSE2,
+  AVX2,
+};
+
+// 一组扫描函数
+//
+// 每个函数都返回 [begin, end) 中第一个不属于对应种类的字符，全都属于时返回 end。
+// 不同的 ScanEngine 得到的结果完全相同，只是快慢不同。
+// SIMD 的版本只在 x86-64 上有，运行时检查 CPU 是否支持，不支持时退回到标量的版本。
+struct Scanner final {
+  using ScanFunction = const char* (*)(const char* begin, const char* end);
+
+  ScanEngine engine;
+  // 空白
+  ScanFunction SkipSpaces;
+  // 标识符的后续部分，也就是字母和数字
+  ScanFunction SkipIdentifier;
+  // 数字
+  ScanFunction SkipDigits;
+
+  // 当前 CPU 能否使用 engine
+  static bool IsSupported(ScanEngine engine);
+  // engine 对应的扫描函数，不支持时得到标量的版本
+  static const Scanner& Get(ScanEngine engine);
+  // 当前 CPU 支持的最快的版本
+  static const Scanner& Best();
+  // 新建的 Tokenizer 默认使用的版本，一开始是 Best()
+  static const Scanner& Default();
+  static void SetDefault(ScanEngine engine);
+};
+
+// "scalar"、"sse2"、"avx2" 和 ScanEngine 之间的转换
+std::optional<ScanEngine> ParseScanEngine(std::string_view name);
+std::string_view ScanEngineName(ScanEngine engine);
+}  // namespace miniplc0
@@ -0,0 +1,201 @@
+#include "tokenizer/source.h"
+
+#include "error/error.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace miniplc0 {
+
+SourceBuffer::SourceBuffer(std::string text)
+    : _owned(std::move(text)),
+      _stream(nullptr),
+      _mapping(nullptr),
+      _mapping_size(0),
+      _data(nullptr),
+      _size(0),
+      _begin(0),
+      _bad(false),
+      _line_starts({0}),
+      _first_line(0),
+      _indexed(0) {
+  rebase();
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer&& sb) : SourceBuffer() {
+  swap(*this, sb);
+}
+
+SourceBuffer::~SourceBuffer() {
+#if !defined(_WIN32)
+  if (_mapping != nullptr) munmap(_mapping, _mapping_size);
+#endif
+}
+
+void swap(SourceBuffer& lhs, SourceBuffer& rhs) {
+  using std::swap;
+  swap(lhs._owned, rhs._owned);
+  swap(lhs._stream, rhs._stream);
+  swap(lhs._mapping, rhs._mapping);
+  swap(lhs._mapping_size, rhs._mapping_size);
+  swap(lhs._data, rhs._data);
+  swap(lhs._size, rhs._size);
+  swap(lhs._begin, rhs._begin);
+  swap(lhs._bad, rhs._bad);
+  swap(lhs._line_starts, rhs._line_starts);
+  swap(lhs._first_line, rhs._first_line);
+  swap(lhs._indexed, rhs._indexed);
+  // Swapping short strings moves their bytes, so the pointers may be stale.
+  lhs.rebase();
+  rhs.rebase();
+}
+
+void SourceBuffer::rebase() {
+  if (_mapping != nullptr) return;
+  _data = _owned.data();
+  // In streaming mode only the front of the window holds valid bytes.
+  if (_stream == nullptr) _size = _owned.size();
+}
+
+SourceBuffer SourceBuffer::FromStream(std::istream& is) {
+  // Read in big chunks straight into the string instead of line by line.
+  static const std::size_t chunk = 64 * 1024;
+  std::string text;
+  while (is) {
+    auto old = text.size();
+    text.resize(old + chunk);
+    is.read(&text[old], chunk);
+    text.resize(old + static_cast<std::size_t>(is.gcount()));
+  }
+  SourceBuffer sb(std::move(text));
+  sb._bad = is.bad();
+  return sb;
+}
+
+SourceBuffer SourceBuffer::Streaming(std::istream& is, std::size_t window) {
+  // One byte is kept around for unreading and one is taken by the '\0'
+  // std::istream::get writes, so tiny windows would make no progress.
+  SourceBuffer sb(std::string(std::max<std::size_t>(window, 16), '\0'));
+  sb._stream = &is;
+  sb._size = 0;
+  return sb;
+}
+
+bool SourceBuffer::Refill(uint64_t keep_from) {
+  if (_stream == nullptr || _bad || _stream->eof()) return false;
+  if (keep_from < _begin || keep_from > End())
+    DieAndPrint("refill drops bytes which are still in use");
+
+  // Remember the newlines we are about to drop, then forget every line
+  // except the one keep_from is on.
+  indexUntil(keep_from);
+  auto line = std::upper_bound(_line_starts.begin(), _line_starts.end(),
+                               keep_from) -
+              1;
+  _first_line += static_cast<uint64_t>(line - _line_starts.begin());
+  _line_starts.erase(_line_starts.begin(), line);
+
+  auto keep = End() - keep_from;
+  std::memmove(&_owned[0], _data + (keep_from - _begin), keep);
+  _begin = keep_from;
+  _size = keep;
+  // Only a single token longer than the whole window gets here. Let the
+  // window grow rather than cut the token apart.
+  if (_owned.size() - _size < 16) {
+    _owned.resize(_owned.size() * 2);
+    _data = _owned.data();
+  }
+
+  // Read a single line, or as much of it as fits. std::istream::get stops
+  // in front of the delimiter and always writes a trailing '\0'.
+  auto room = _owned.size() - _size;
+  _stream->get(&_owned[_size], static_cast<std::streamsize>(room), '\n');
+  _size += static_cast<uint64_t>(_stream->gcount());
+  if (_stream->bad()) {
+    _bad = true;
+    return false;
+  }
+  // An empty line makes get() fail without reaching EOF.
+  if (!_stream->eof()) _stream->clear();
+  if (!_stream->eof() && _stream->peek() == '\n') {
+    _stream->get();
+    _owned[_size++] = '\n';
+  }
+  return _size > keep;
+}
+
+std::optional<SourceBuffer> SourceBuffer::FromFile(const std::string& path) {
+#if defined(_WIN32)
+  std::ifstream ifs(path, std::ios::in | std::ios::binary);
+  if (!ifs) return {};
+  return FromStream(ifs);
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return {};
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return {};
+  }
+  // mmap refuses empty files and makes no sense for pipes and the like.
+  if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if (!ifs) return {};
+    return FromStream(ifs);
+  }
+  auto size = static_cast<std::size_t>(st.st_size);
+  void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if (!ifs) return {};
+    return FromStream(ifs);
+  }
+  madvise(p, size, MADV_SEQUENTIAL);
+
+  SourceBuffer sb;
+  sb._mapping = p;
+  sb._mapping_size = size;
+  sb._data = static_cast<const char*>(p);
+  sb._size = size;
+  return std::make_optional<SourceBuffer>(std::move(sb));
+#endif
+}
+
+void SourceBuffer::indexUntil(uint64_t offset) {
+  while (_indexed < offset) {
+    auto from = _data + (_indexed - _begin);
+    auto p = static_cast<const char*>(
+        std::memchr(from, '\n', offset - _indexed));
+    if (p == nullptr) {
+      _indexed = offset;
+      break;
+    }
+    _indexed += static_cast<uint64_t>(p - from) + 1;
+    _line_starts.emplace_back(_indexed);
+  }
+}
+
+std::pair<std::uint64_t, std::uint64_t> SourceBuffer::PosOf(uint64_t offset) {
+  if (offset > End()) DieAndPrint("position after the end of the source");
+  if (offset < _line_starts.front())
+    DieAndPrint("position of a line which has been dropped");
+  indexUntil(offset);
+  // The lexer almost always asks about the line it is currently on.
+  if (offset >= _line_starts.back())
+    return std::make_pair(_first_line + _line_starts.size() - 1,
+                          offset - _line_starts.back());
+  auto it = std::upper_bound(_line_starts.begin(), _line_starts.end(), offset);
+  auto line = static_cast<uint64_t>(it - _line_starts.begin()) - 1;
+  return std::make_pair(_first_line + line, offset - _line_starts[line]);
+}
+}  // namespace miniplc0
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 词法分析用的源码缓冲区
+//
+// 文件直接 mmap 进内存，流则一次性读进一块连续的内存，Tokenizer 在这块内存上
+// 原地扫描，不再按行拷贝出一堆 std::string。
+// 缓冲区里只有字节偏移，(行, 列) 在需要的时候由行首偏移表算出来；
+// 行首偏移表是惰性建立的，只会扫描到被查询过的最远位置。
+//
+// 另外还有一种流式的模式：内存里只保留一个固定大小的窗口 [Begin(), End())，
+// 读到窗口末尾时用 Refill() 丢掉不再需要的部分并从流里继续读，
+// 这样无论输入多长，占用的内存都是固定的，而且不用等到 EOF 就能开始分析。
+// 一次 Refill() 最多读一行，交互式的管道输入也能及时得到 token。
+class SourceBuffer final {
+ private:
+  using uint64_t = std::uint64_t;
+
+ public:
+  // 流式模式默认的窗口大小
+  static constexpr std::size_t DefaultWindow = 64 * 1024;
+
+ public:
+  friend void swap(SourceBuffer& lhs, SourceBuffer& rhs);
+
+ public:
+  // 读入整个流，读取失败时 Bad() 为真
+  static SourceBuffer FromStream(std::istream& is);
+  // 映射整个文件，无法打开时返回空
+  static std::optional<SourceBuffer> FromFile(const std::string& path);
+  // 流式读取，内存中最多保留 window 个字节
+  // 只有遇到比整个窗口还长的 token 时窗口才会变大
+  static SourceBuffer Streaming(std::istream& is,
+                               std::size_t window = DefaultWindow);
+
+  explicit SourceBuffer(std::string text);
+  SourceBuffer() : SourceBuffer(std::string()) {}
+  SourceBuffer(SourceBuffer&& sb);
+  SourceBuffer& operator=(SourceBuffer sb) {
+    swap(*this, sb);
+    return *this;
+  }
+  SourceBuffer(const SourceBuffer&) = delete;
+  ~SourceBuffer();
+
+  // 内存中的内容，Data()[0] 是偏移为 Begin() 的字节
+  // 除了流式模式以外 Begin() 总是 0，End() 总是整个输入的长度
+  const char* Data() const { return _data; }
+  uint64_t Size() const { return _size; }
+  uint64_t Begin() const { return _begin; }
+  uint64_t End() const { return _begin + _size; }
+  std::string_view View() const { return std::string_view(_data, _size); }
+  bool Bad() const { return _bad; }
+  bool IsStreaming() const { return _stream != nullptr; }
+
+  // 丢掉 keep_from 之前的内容，再从流里读入新的内容
+  // 只有在流式模式下，并且确实读到了新内容时才返回 true
+  bool Refill(uint64_t keep_from);
+
+  // 偏移 offset 处的 (行, 列)，允许 offset == End()
+  // 流式模式下 offset 不能早于最近一次 Refill() 的 keep_from
+  std::pair<uint64_t, uint64_t> PosOf(uint64_t offset);
+
+ private:
+  // 行首偏移表扩展到能够回答 offset 的位置
+  void indexUntil(uint64_t offset);
+  // _data 指向自己持有的 _owned 时，移动之后需要重新指一下
+  void rebase();
+
+ private:
+  // 从流里读入的内容，流式模式下就是窗口本身
+  std::string _owned;
+  // 流式模式下的输入流，其他模式为空
+  std::istream* _stream;
+  // mmap 得到的内存，为空时表示内容在 _owned 里
+  void* _mapping;
+  std::size_t _mapping_size;
+
+  const char* _data;
+  uint64_t _size;
+  uint64_t _begin;
+  bool _bad;
+
+  // _line_starts[i] 是第 _first_line + i 行第一个字符的偏移
+  // 流式模式下窗口之前的行会被丢掉
+  std::vector<uint64_t> _line_starts;
+  uint64_t _first_line;
+  // [0, _indexed) 中的换行都已经记录过了
+  uint64_t _indexed;
+};
+
+void swap(SourceBuffer& lhs, SourceBuffer& rhs);
+}  // namespace miniplc0
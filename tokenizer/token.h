@@ -1,99 +1,181 @@
-#pragma once
-
-#include "error/error.h"
-
-#include <any>
-#include <cstdint>
-#include <string>
-
-namespace miniplc0 {
-
-enum TokenType {
-  NULL_TOKEN,
-  UNSIGNED_INTEGER,
-  IDENTIFIER,
-  BEGIN,
-  END,
-  VAR,
-  CONST,
-  PRINT,
-  PLUS_SIGN,
-  MINUS_SIGN,
-  MULTIPLICATION_SIGN,
-  DIVISION_SIGN,
-  EQUAL_SIGN,
-  SEMICOLON,
-  LEFT_BRACKET,
-  RIGHT_BRACKET
-};
-
-class Token final {
-private:
-  using uint64_t = std::uint64_t;
-  using int32_t = std::int32_t;
-
-public:
-  friend void swap(Token &lhs, Token &rhs);
-
-public:
-  Token(TokenType type, std::any value, uint64_t start_line,
-        uint64_t start_column, uint64_t end_line, uint64_t end_column)
-      : _type(type), _value(std::move(value)),
-        _start_pos(start_line, start_column), _end_pos(end_line, end_column) {}
-  Token(TokenType type, std::any value, std::pair<uint64_t, uint64_t> start,
-        std::pair<uint64_t, uint64_t> end)
-      : Token(type, value, start.first, start.second, end.first, end.second) {}
-  Token(const Token &t) {
-    _type = t._type;
-    _value = t._value;
-    _start_pos = t._start_pos;
-    _end_pos = t._end_pos;
-  }
-  Token(Token &&t) : Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0) {
-    swap(*this, t);
-  }
-  Token &operator=(Token t) {
-    swap(*this, t);
-    return *this;
-  }
-  bool operator==(const Token &rhs) const {
-    return _type == rhs._type && GetValueString() == rhs.GetValueString() &&
-           _start_pos == rhs._start_pos && _end_pos == rhs._end_pos;
-  }
-
-  TokenType GetType() const { return _type; };
-  std::any GetValue() const { return _value; };
-  std::pair<uint64_t, uint64_t> GetStartPos() const { return _start_pos; }
-  std::pair<uint64_t, uint64_t> GetEndPos() const { return _end_pos; }
-  std::string GetValueString() const {
-    try {
-      return std::any_cast<std::string>(_value);
-    } catch (const std::bad_any_cast &) {
-    }
-    try {
-      return std::string(1, std::any_cast<char>(_value));
-    } catch (const std::bad_any_cast &) {
-    }
-    try {
-      return std::to_string(std::any_cast<int32_t>(_value));
-    } catch (const std::bad_any_cast &) {
-      DieAndPrint("No suitable cast for token value.");
-    }
-    return "Invalid";
-  }
-
-private:
-  TokenType _type;
-  std::any _value;
-  std::pair<uint64_t, uint64_t> _start_pos;
-  std::pair<uint64_t, uint64_t> _end_pos;
-};
-
-inline void swap(Token &lhs, Token &rhs) {
-  using std::swap;
-  swap(lhs._type, rhs._type);
-  swap(lhs._value, rhs._value);
-  swap(lhs._start_pos, rhs._start_pos);
-  swap(lhs._end_pos, rhs._end_pos);
-}
-} // namespace miniplc0
\ No newline at end of file
+#pragma once
+
+#include "error/error.h"
+#include "tokenizer/interner.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace miniplc0 {
+
+enum TokenType : std::uint8_t {
+  NULL_TOKEN,
+  UNSIGNED_INTEGER,
+  IDENTIFIER,
+  BEGIN,
+  END,
+  VAR,
+  CONST,
+  PRINT,
+  PLUS_SIGN,
+  MINUS_SIGN,
+  MULTIPLICATION_SIGN,
+  DIVISION_SIGN,
+  EQUAL_SIGN,
+  SEMICOLON,
+  LEFT_BRACKET,
+  RIGHT_BRACKET
+};
+
+// Token 只由几个定长的字段组成，可以直接按位拷贝
+// 值按种类存放：
+// - 整数直接存在 token 里
+// - 符号只需要一个字符
+// - 标识符和关键字保存在当前的 Interner 里，token 里只有编号和指向它的
+//   string_view
+// 位置用 32 位的行号和列号保存
+class Token final {
+ private:
+  using uint64_t = std::uint64_t;
+  using uint32_t = std::uint32_t;
+  using int32_t = std::int32_t;
+
+ public:
+  // 值的种类
+  enum ValueKind : std::uint8_t {
+    NO_VALUE,
+    INTEGER_VALUE,
+    CHAR_VALUE,
+    STRING_VALUE
+  };
+
+ public:
+  Token(TokenType type, int32_t value, uint64_t start_line,
+        uint64_t start_column, uint64_t end_line, uint64_t end_column)
+      : Token(type, INTEGER_VALUE, start_line, start_column, end_line,
+              end_column) {
+    _int = value;
+  }
+  Token(TokenType type, char value, uint64_t start_line, uint64_t start_column,
+        uint64_t end_line, uint64_t end_column)
+      : Token(type, CHAR_VALUE, start_line, start_column, end_line,
+              end_column) {
+    _int = static_cast<unsigned char>(value);
+  }
+  Token(TokenType type, std::string_view value, uint64_t start_line,
+        uint64_t start_column, uint64_t end_line, uint64_t end_column)
+      : Token(type, STRING_VALUE, start_line, start_column, end_line,
+              end_column) {
+    auto interned = Interner::Current().Intern(value);
+    _symbol = interned.first;
+    _text = interned.second;
+  }
+  Token(TokenType type, const std::string &value, uint64_t start_line,
+        uint64_t start_column, uint64_t end_line, uint64_t end_column)
+      : Token(type, std::string_view(value), start_line, start_column,
+              end_line, end_column) {}
+  template <typename T>
+  Token(TokenType type, T value, std::pair<uint64_t, uint64_t> start,
+        std::pair<uint64_t, uint64_t> end)
+      : Token(type, value, start.first, start.second, end.first, end.second) {}
+  bool operator==(const Token &rhs) const {
+    if (_type != rhs._type || _start_line != rhs._start_line ||
+        _start_column != rhs._start_column || _end_line != rhs._end_line ||
+        _end_column != rhs._end_column)
+      return false;
+    if (_kind != rhs._kind) return GetValueString() == rhs.GetValueString();
+    // 编号只在同一个 Interner 里有意义，所以比较字符串
+    return _kind == STRING_VALUE ? _text == rhs._text : _int == rhs._int;
+  }
+
+  TokenType GetType() const { return _type; };
+  ValueKind GetValueKind() const { return _kind; }
+  std::pair<uint64_t, uint64_t> GetStartPos() const {
+    return std::make_pair(_start_line, _start_column);
+  }
+  std::pair<uint64_t, uint64_t> GetEndPos() const {
+    return std::make_pair(_end_line, _end_column);
+  }
+  // 同一个 token 往下挪 lines 行，列不变
+  // 增量分析时每一行单独做词法分析，token 的行号都从 0 算起
+  Token MovedDown(uint64_t lines) const {
+    auto t = *this;
+    t._start_line += static_cast<uint32_t>(lines);
+    t._end_line += static_cast<uint32_t>(lines);
+    return t;
+  }
+  // 整数的值，其他种类的 token 返回空
+  std::optional<int32_t> GetIntegerValue() const {
+    if (_kind != INTEGER_VALUE) return {};
+    return _int;
+  }
+  // 标识符和关键字在 Interner 中的编号
+  std::optional<Symbol> GetSymbol() const {
+    if (_kind != STRING_VALUE) return {};
+    return _symbol;
+  }
+  std::string GetValueString() const {
+    switch (_kind) {
+      case STRING_VALUE:
+        return std::string(_text);
+      case CHAR_VALUE:
+        return std::string(1, static_cast<char>(_int));
+      case INTEGER_VALUE:
+        return std::to_string(_int);
+      case NO_VALUE:
+        break;
+    }
+    return "Invalid";
+  }
+
+ private:
+  Token(TokenType type, ValueKind kind, uint64_t start_line,
+        uint64_t start_column, uint64_t end_line, uint64_t end_column)
+      : _type(type),
+        _kind(kind),
+        _int(0),
+        _text(),
+        _start_line(static_cast<uint32_t>(start_line)),
+        _start_column(static_cast<uint32_t>(start_column)),
+        _end_line(static_cast<uint32_t>(end_line)),
+        _end_column(static_cast<uint32_t>(end_column)) {}
+
+ private:
+  TokenType _type;
+  ValueKind _kind;
+  union {
+    int32_t _int;
+    Symbol _symbol;
+  };
+  std::string_view _text;
+  uint32_t _start_line;
+  uint32_t _start_column;
+  uint32_t _end_line;
+  uint32_t _end_column;
+
+#ifdef MINIPLC0_COUNT_TOKEN_COPIES
+  // 统计 token 被拷贝的次数，只在 benchmarks 里打开
+  struct CopyCounter {
+    inline static std::uint64_t Copies = 0;
+    CopyCounter() = default;
+    CopyCounter(const CopyCounter &) { Copies++; }
+    CopyCounter &operator=(const CopyCounter &) {
+      Copies++;
+      return *this;
+    }
+  } _copies;
+
+ public:
+  static std::uint64_t CopyCount() { return CopyCounter::Copies; }
+#endif
+};
+
+#ifndef MINIPLC0_COUNT_TOKEN_COPIES
+static_assert(std::is_trivially_copyable_v<Token>);
+#endif
+static_assert(sizeof(Token) <= 64, "a token should fit in a cache line");
+}  // namespace miniplc0
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "error/error.h"
+#include "tokenizer/token.h"
+#include "tokenizer/tokenizer.h"
+
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 按需一个一个地取 token
+//
+// 语法分析从这里拉取 token，于是词法分析和语法分析在同一遍里完成，
+// 不用先把所有 token 存进一个数组。
+class TokenStream {
+ public:
+  virtual ~TokenStream() = default;
+
+  // 下一个 token，流已经结束或者遇到了词法错误时返回空
+  virtual std::optional<Token> Next() = 0;
+  // 遇到的词法错误，正常结束时为空
+  virtual std::optional<CompilationError> Error() const { return {}; }
+};
+
+// 一边词法分析一边给出 token
+class TokenizerStream final : public TokenStream {
+ public:
+  TokenizerStream(Tokenizer& tkz) : _tkz(tkz), _done(false), _error() {}
+
+  std::optional<Token> Next() override {
+    if (_done) return {};
+    auto p = _tkz.NextToken();
+    if (p.second.has_value()) {
+      _done = true;
+      if (p.second.value().GetCode() != ErrorCode::ErrEOF) _error = p.second;
+      return {};
+    }
+    return p.first;
+  }
+  std::optional<CompilationError> Error() const override { return _error; }
+
+ private:
+  Tokenizer& _tkz;
+  bool _done;
+  std::optional<CompilationError> _error;
+};
+
+// 已经全部分析好的 token
+class VectorTokenStream final : public TokenStream {
+ public:
+  VectorTokenStream(std::vector<Token> v) : _tokens(std::move(v)), _offset(0) {}
+
+  std::optional<Token> Next() override {
+    if (_offset == _tokens.size()) return {};
+    return _tokens[_offset++];
+  }
+
+ private:
+  std::vector<Token> _tokens;
+  std::size_t _offset;
+};
+}  // namespace miniplc0
@@ -1,252 +1,223 @@
-#include "tokenizer/tokenizer.h"
-
-#include <cctype>
-#include <sstream>
-#include <string>
-
-namespace miniplc0 {
-
-std::pair<std::optional<Token>, std::optional<CompilationError>>
-Tokenizer::NextToken() {
-  if (!_initialized) readAll();
-  if (_rdr.bad())
-    return std::make_pair(
-        std::optional<Token>(),
-        std::make_optional<CompilationError>(0, 0, ErrorCode::ErrStreamError));
-  if (isEOF())
-    return std::make_pair(
-        std::optional<Token>(),
-        std::make_optional<CompilationError>(0, 0, ErrorCode::ErrEOF));
-  auto p = nextToken();
-  if (p.second.has_value()) return std::make_pair(p.first, p.second);
-  auto err = checkToken(p.first.value());
-  if (err.has_value()) return std::make_pair(p.first, err.value());
-  return std::make_pair(p.first, std::optional<CompilationError>());
-}
-
-std::pair<std::vector<Token>, std::optional<CompilationError>>
-Tokenizer::AllTokens() {
-  std::vector<Token> result;
-  while (true) {
-    auto p = NextToken();
-    if (p.second.has_value()) {
-      if (p.second.value().GetCode() == ErrorCode::ErrEOF)
-        return std::make_pair(result, std::optional<CompilationError>());
-      else
-        return std::make_pair(std::vector<Token>(), p.second);
-    }
-    result.emplace_back(p.first.value());
-  }
-}
-
-// 注意：这里的返回值中 Token 和 CompilationError 只能返回一个，不能同时返回。
-//
-// this function is rearranged by Rynco.
-//
-std::pair<std::optional<Token>, std::optional<CompilationError>>
-Tokenizer::nextToken() {
-  // read in a character
-  auto current_char = nextChar();
-
-  // 已经读到了文件尾
-  if (!current_char.has_value())
-    // 返回一个空的token，和编译错误ErrEOF：遇到了文件尾
-    return {std::optional<Token>(),
-            std::make_optional<CompilationError>(0, 0, ErrEOF)};
-
-  std::pair<int64_t, int64_t> pos;
-  std::stringstream ss;
-
-  // check which category this character is in.
-  auto cur = current_char.value();
-  if (miniplc0::isspace(cur)) {
-    // skip_spaces
-    while (current_char.has_value() && miniplc0::isspace(current_char.value()))
-      current_char = nextChar();
-
-    // 已经读到了文件尾
-    if (!current_char.has_value())
-      // 返回一个空的token，和编译错误ErrEOF：遇到了文件尾
-      return {std::optional<Token>(),
-              std::make_optional<CompilationError>(0, 0, ErrEOF)};
-  }
-
-  cur = current_char.value();
-  if (miniplc0::isalpha(cur)) {
-    // lex_ident
-    pos = previousPos();
-
-    // while isalnum(cur)
-    while (current_char.has_value() &&
-           (miniplc0::isalpha(current_char.value()) ||
-            miniplc0::isdigit(current_char.value()))) {
-      ss << current_char.value();
-      current_char = nextChar();
-    }
-
-    // the last char is not alnum. unread.
-    unreadLast();
-
-    auto s = ss.str();
-    TokenType typ;
-
-    if (s == "begin") {
-      typ = TokenType::BEGIN;
-    } else if (s == "end") {
-      typ = TokenType::END;
-    } else if (s == "var") {
-      typ = TokenType::VAR;
-    } else if (s == "const") {
-      typ = TokenType::CONST;
-    } else if (s == "print") {
-      typ = TokenType::PRINT;
-    } else {
-      typ = TokenType::IDENTIFIER;
-    }
-
-    return {std::make_optional<Token>(typ, s, pos, currentPos()),
-            std::optional<CompilationError>()};
-
-  } else if (miniplc0::isdigit(cur)) {
-    // lex_uint
-    pos = previousPos();
-
-    while (current_char.has_value() &&
-           miniplc0::isdigit(current_char.value())) {
-      ss << current_char.value();
-      current_char = nextChar();
-    }
-
-    //* This is for dealing with numbers directly having letters trailling them.
-    //* Might need to move it into another function
-    if (miniplc0::isalpha(current_char.value())) {
-      // It **should** be an invalid identifier and be sent to CheckToken().
-      // However we can skip that and send a invalid identifier error from here.
-      //
-      // LAZY mio =x=                             - Rynco
-      return {std::optional<Token>(),
-              std::make_optional<CompilationError>(
-                  pos, ErrorCode::ErrInvalidIdentifier)};
-    }
-
-    unreadLast();
-
-    auto s = ss.str();
-
-    try {
-      int32_t val = std::stoi(s);
-      return {std::make_optional<Token>(TokenType::UNSIGNED_INTEGER, val, pos,
-                                        currentPos()),
-              std::optional<CompilationError>()};
-    } catch (std::out_of_range& _) {
-      return {std::optional<Token>(), std::make_optional<CompilationError>(
-                                          pos, ErrorCode::ErrIntegerOverflow)};
-    } catch (std::invalid_argument& _) {
-      return {std::optional<Token>(), std::make_optional<CompilationError>(
-                                          pos, ErrorCode::ErrInvalidInput)};
-    }
-
-  } else {
-    pos = previousPos();
-    auto current_pos = currentPos();
-    // other chars
-    switch (cur) {
-      case '+':
-        return {std::make_optional<Token>(TokenType::PLUS_SIGN, '+', pos,
-                                          current_pos),
-                std::optional<CompilationError>()};
-      case '-':
-        return {std::make_optional<Token>(TokenType::MINUS_SIGN, '-', pos,
-                                          current_pos),
-                std::optional<CompilationError>()};
-      case '*':
-        return {std::make_optional<Token>(TokenType::MULTIPLICATION_SIGN, '*',
-                                          pos, current_pos),
-                std::optional<CompilationError>()};
-      case '/':
-        return {std::make_optional<Token>(TokenType::DIVISION_SIGN, '/', pos,
-                                          current_pos),
-                std::optional<CompilationError>()};
-      case '=':
-        return {std::make_optional<Token>(TokenType::EQUAL_SIGN, '=', pos,
-                                          current_pos),
-                std::optional<CompilationError>()};
-      case '(':
-        return {std::make_optional<Token>(TokenType::LEFT_BRACKET, '(', pos,
-                                          current_pos),
-                std::optional<CompilationError>()};
-      case ')':
-        return {std::make_optional<Token>(TokenType::RIGHT_BRACKET, ')', pos,
-                                          current_pos),
-                std::optional<CompilationError>()};
-      case ';':
-        return {std::make_optional<Token>(TokenType::SEMICOLON, ';', pos,
-                                          current_pos),
-                std::optional<CompilationError>()};
-      default:
-        return std::make_pair(std::optional<Token>(),
-                              std::make_optional<CompilationError>(
-                                  pos, ErrorCode::ErrInvalidInput));
-    }
-  }
-}
-
-std::optional<CompilationError> Tokenizer::checkToken(const Token& t) {
-  switch (t.GetType()) {
-    case IDENTIFIER: {
-      auto val = t.GetValueString();
-      if (miniplc0::isdigit(val[0]))
-        return std::make_optional<CompilationError>(
-            t.GetStartPos().first, t.GetStartPos().second,
-            ErrorCode::ErrInvalidIdentifier);
-      break;
-    }
-    default:
-      break;
-  }
-  return {};
-}
-
-void Tokenizer::readAll() {
-  if (_initialized) return;
-  for (std::string tp; std::getline(_rdr, tp);)
-    _lines_buffer.emplace_back(std::move(tp + "\n"));
-  _initialized = true;
-  _ptr = std::make_pair<int64_t, int64_t>(0, 0);
-  return;
-}
-
-// Note: We allow this function to return a postion which is out of bound
-// according to the design like std::vector::end().
-std::pair<uint64_t, uint64_t> Tokenizer::nextPos() {
-  if (_ptr.first >= _lines_buffer.size()) DieAndPrint("advance after EOF");
-  if (_ptr.second == _lines_buffer[_ptr.first].size() - 1)
-    return std::make_pair(_ptr.first + 1, 0);
-  else
-    return std::make_pair(_ptr.first, _ptr.second + 1);
-}
-
-std::pair<uint64_t, uint64_t> Tokenizer::currentPos() { return _ptr; }
-
-std::pair<uint64_t, uint64_t> Tokenizer::previousPos() {
-  if (_ptr.first == 0 && _ptr.second == 0)
-    DieAndPrint("previous position from beginning");
-  if (_ptr.second == 0)
-    return std::make_pair(_ptr.first - 1,
-                          _lines_buffer[_ptr.first - 1].size() - 1);
-  else
-    return std::make_pair(_ptr.first, _ptr.second - 1);
-}
-
-std::optional<char> Tokenizer::nextChar() {
-  if (isEOF()) return {};  // EOF
-  auto result = _lines_buffer[_ptr.first][_ptr.second];
-  _ptr = nextPos();
-  return result;
-}
-
-bool Tokenizer::isEOF() { return _ptr.first >= _lines_buffer.size(); }
-
-// Note: Is it evil to unread a buffer?
-void Tokenizer::unreadLast() { _ptr = previousPos(); }
-}  // namespace miniplc0
+#include "tokenizer/tokenizer.h"
+
+#include "tokenizer/keywords.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <string>
+#include <system_error>
+
+namespace miniplc0 {
+
+std::pair<std::optional<Token>, std::optional<CompilationError>>
+Tokenizer::NextToken() {
+  if (!_initialized) readAll();
+  if (_buffer.Bad())
+    return std::make_pair(
+        std::optional<Token>(),
+        std::make_optional<CompilationError>(0, 0, ErrorCode::ErrStreamError));
+  if (isEOF())
+    return std::make_pair(
+        std::optional<Token>(),
+        std::make_optional<CompilationError>(0, 0, ErrorCode::ErrEOF));
+  auto p = nextToken();
+  if (p.second.has_value()) return p;
+  p.second = checkToken(p.first.value());
+  return p;
+}
+
+std::pair<std::vector<Token>, std::optional<CompilationError>>
+Tokenizer::AllTokens() {
+  std::vector<Token> result;
+  while (true) {
+    auto p = NextToken();
+    if (p.second.has_value()) {
+      if (p.second.value().GetCode() == ErrorCode::ErrEOF)
+        return std::make_pair(result, std::optional<CompilationError>());
+      else
+        return std::make_pair(std::vector<Token>(), p.second);
+    }
+    result.emplace_back(p.first.value());
+  }
+}
+
+// 注意：这里的返回值中 Token 和 CompilationError 只能返回一个，不能同时返回。
+//
+// this function is rearranged by Rynco.
+//
+std::pair<std::optional<Token>, std::optional<CompilationError>>
+Tokenizer::nextToken() {
+  // Not inside a token yet, so a refill only has to keep the last char.
+  _token_start = NoTokenStart;
+
+  // skip_spaces
+  if (!skipRun(_scanner->SkipSpaces))
+    // 已经读到了文件尾
+    // 返回一个空的token，和编译错误ErrEOF：遇到了文件尾
+    return {std::optional<Token>(),
+            std::make_optional<CompilationError>(0, 0, ErrEOF)};
+
+  std::pair<int64_t, int64_t> pos;
+
+  // check which category this character is in.
+  _token_start = _ptr;
+  auto cur = nextChar().value();
+  auto cls = ClassOf(cur);
+  if (cls & ALPHA_CHAR) {
+    // lex_ident
+    pos = previousPos();
+
+    // while isalnum(cur)
+    // The scanner stops right before the first char that is not alnum, so
+    // there is nothing to unread.
+    skipRun(_scanner->SkipIdentifier);
+
+    // The identifier is still in the buffer, even in streaming mode, so it
+    // goes straight into the interner without being copied out first.
+    auto s = std::string_view(_buffer.Data() + (_token_start - _buffer.Begin()),
+                              _ptr - _token_start);
+    auto typ = ClassifyWord(s);
+
+    return {std::make_optional<Token>(typ, s, pos, currentPos()),
+            std::optional<CompilationError>()};
+
+  } else if (cls & DIGIT_CHAR) {
+    // lex_uint
+    pos = previousPos();
+
+    bool more = skipRun(_scanner->SkipDigits);
+
+    //* This is for dealing with numbers directly having letters trailling them.
+    //* Might need to move it into another function
+    if (more &&
+        (ClassOf(_buffer.Data()[_ptr - _buffer.Begin()]) & ALPHA_CHAR)) {
+      // It **should** be an invalid identifier and be sent to CheckToken().
+      // However we can skip that and send a invalid identifier error from here.
+      //
+      // LAZY mio =x=                             - Rynco
+      return {std::optional<Token>(),
+              std::make_optional<CompilationError>(
+                  pos, ErrorCode::ErrInvalidIdentifier)};
+    }
+
+    // Parse straight out of the buffer. from_chars reports an out of range
+    // value instead of throwing, and leading zeros are fine just like stoi.
+    auto first = _buffer.Data() + (_token_start - _buffer.Begin());
+    auto last = first + (_ptr - _token_start);
+    int32_t val = 0;
+    auto res = std::from_chars(first, last, val);
+    if (res.ec == std::errc::result_out_of_range)
+      return {std::optional<Token>(), std::make_optional<CompilationError>(
+                                          pos, ErrorCode::ErrIntegerOverflow)};
+    if (res.ec != std::errc() || res.ptr != last)
+      return {std::optional<Token>(), std::make_optional<CompilationError>(
+                                          pos, ErrorCode::ErrInvalidInput)};
+    return {std::make_optional<Token>(TokenType::UNSIGNED_INTEGER, val, pos,
+                                      currentPos()),
+            std::optional<CompilationError>()};
+
+  } else {
+    pos = previousPos();
+    auto current_pos = currentPos();
+    // other chars
+    switch (cur) {
+      case '+':
+        return {std::make_optional<Token>(TokenType::PLUS_SIGN, '+', pos,
+                                          current_pos),
+                std::optional<CompilationError>()};
+      case '-':
+        return {std::make_optional<Token>(TokenType::MINUS_SIGN, '-', pos,
+                                          current_pos),
+                std::optional<CompilationError>()};
+      case '*':
+        return {std::make_optional<Token>(TokenType::MULTIPLICATION_SIGN, '*',
+                                          pos, current_pos),
+                std::optional<CompilationError>()};
+      case '/':
+        return {std::make_optional<Token>(TokenType::DIVISION_SIGN, '/', pos,
+                                          current_pos),
+                std::optional<CompilationError>()};
+      case '=':
+        return {std::make_optional<Token>(TokenType::EQUAL_SIGN, '=', pos,
+                                          current_pos),
+                std::optional<CompilationError>()};
+      case '(':
+        return {std::make_optional<Token>(TokenType::LEFT_BRACKET, '(', pos,
+                                          current_pos),
+                std::optional<CompilationError>()};
+      case ')':
+        return {std::make_optional<Token>(TokenType::RIGHT_BRACKET, ')', pos,
+                                          current_pos),
+                std::optional<CompilationError>()};
+      case ';':
+        return {std::make_optional<Token>(TokenType::SEMICOLON, ';', pos,
+                                          current_pos),
+                std::optional<CompilationError>()};
+      default:
+        return std::make_pair(std::optional<Token>(),
+                              std::make_optional<CompilationError>(
+                                  pos, ErrorCode::ErrInvalidInput));
+    }
+  }
+}
+
+std::optional<CompilationError> Tokenizer::checkToken(const Token& t) {
+  switch (t.GetType()) {
+    case IDENTIFIER: {
+      auto val = t.GetValueString();
+      if (miniplc0::isdigit(val[0]))
+        return std::make_optional<CompilationError>(
+            t.GetStartPos().first, t.GetStartPos().second,
+            ErrorCode::ErrInvalidIdentifier);
+      break;
+    }
+    default:
+      break;
+  }
+  return {};
+}
+
+void Tokenizer::readAll() {
+  if (_initialized) return;
+  _buffer = SourceBuffer::FromStream(*_rdr);
+  _initialized = true;
+  _ptr = 0;
+  return;
+}
+
+// Note: We allow this function to return a postion which is out of bound
+// according to the design like std::vector::end().
+std::pair<uint64_t, uint64_t> Tokenizer::currentPos() {
+  return _buffer.PosOf(_ptr);
+}
+
+std::pair<uint64_t, uint64_t> Tokenizer::previousPos() {
+  if (_ptr == 0) DieAndPrint("previous position from beginning");
+  return _buffer.PosOf(_ptr - 1);
+}
+
+std::optional<char> Tokenizer::nextChar() {
+  if (isEOF()) return {};  // EOF
+  return _buffer.Data()[_ptr++ - _buffer.Begin()];
+}
+
+// In streaming mode running off the window only means we have to read more.
+// The last character is kept so that it can still be unread.
+bool Tokenizer::isEOF() {
+  if (_ptr < _buffer.End()) return false;
+  auto keep_from = _ptr == 0 ? 0 : _ptr - 1;
+  return !_buffer.Refill(std::min(keep_from, _token_start));
+}
+
+bool Tokenizer::skipRun(Scanner::ScanFunction skip) {
+  while (true) {
+    auto begin = _buffer.Data() + (_ptr - _buffer.Begin());
+    _ptr += skip(begin, _buffer.Data() + _buffer.Size()) - begin;
+    if (_ptr < _buffer.End()) return true;
+    // Ran off the window, which in streaming mode may only mean the run goes
+    // on past what has been read so far.
+    if (isEOF()) return false;
+  }
+}
+}  // namespace miniplc0
@@ -1,94 +1,119 @@
-#pragma once
-
-#include "error/error.h"
-#include "tokenizer/token.h"
-#include "tokenizer/utils.hpp"
-
-#include <cstdint>
-#include <iostream>
-#include <memory>
-#include <optional>
-#include <string>
-#include <utility>
-#include <vector>
-
-namespace miniplc0 {
-
-class Tokenizer final {
-private:
-  using uint64_t = std::uint64_t;
-
-  // 状态机的所有状态
-  enum DFAState {
-    INITIAL_STATE,
-    UNSIGNED_INTEGER_STATE,
-    PLUS_SIGN_STATE,
-    MINUS_SIGN_STATE,
-    DIVISION_SIGN_STATE,
-    MULTIPLICATION_SIGN_STATE,
-    IDENTIFIER_STATE,
-    EQUAL_SIGN_STATE,
-    SEMICOLON_STATE,
-    LEFTBRACKET_STATE,
-    RIGHTBRACKET_STATE
-  };
-
-public:
-  Tokenizer(std::istream &ifs)
-      : _rdr(ifs), _initialized(false), _ptr(0, 0), _lines_buffer() {}
-  Tokenizer(Tokenizer &&tkz) = delete;
-  Tokenizer(const Tokenizer &) = delete;
-  Tokenizer &operator=(const Tokenizer &) = delete;
-
-  // 核心函数，返回下一个 token
-  std::pair<std::optional<Token>, std::optional<CompilationError>> NextToken();
-  // 一次返回所有 token
-  std::pair<std::vector<Token>, std::optional<CompilationError>> AllTokens();
-
-private:
-  // 检查 Token 的合法性
-  std::optional<CompilationError> checkToken(const Token &);
-  //
-  // ** 你需要完成这个函数 **
-  //
-  // 返回下一个 token，是 NextToken 实际实现部分
-  std::pair<std::optional<Token>, std::optional<CompilationError>> nextToken();
-
-  // 从这里开始其实是一个基于行号的缓冲区的实现
-  // 为了简单起见，我们没有单独拿出一个类实现
-  // 核心思想和 C 的文件输入输出类似，就是一个 buffer 加一个指针，有三个细节
-  // 1.缓冲区包括 \n
-  // 2.指针始终指向下一个要读取的 char
-  // 3.行号和列号从 0 开始
-
-  // 一次读入全部内容，并且替换所有换行为 \n
-  // 这样其实是不合理的，这里只是简单起见这么实现
-  void readAll();
-  // 一个简单的总结
-  // 偏移   | 0 | 1 | 2 | 3 | 4 | 4 | 5 | 6 | 7 | 8 | 9  |
-  //        | = | = | = | = | = | = | = | = | = | = | =  |
-  // 缓冲区 | h | a | 1 | 9 | 2 | 6 | 0 | 8 | 1 | 7 | \n |（第0行）
-  //        | 1 | 1 | 4 | 5 | 1 | 4 |                     （第1行）
-  // 这里假设指针指向第一行的 \n，那么有
-  // nextPos() = (1, 0)
-  // currentPos() = (0, 9)
-  // previousPos() = (0, 8)
-  // nextChar() = '\n' 并且指针移动到 (1, 0)
-  // unreadLast() 指针移动到 (0, 8)
-  std::pair<uint64_t, uint64_t> nextPos();
-  std::pair<uint64_t, uint64_t> currentPos();
-  std::pair<uint64_t, uint64_t> previousPos();
-  std::optional<char> nextChar();
-  bool isEOF();
-  void unreadLast();
-
-private:
-  std::istream &_rdr;
-  // 如果没有初始化，那么就 readAll
-  bool _initialized;
-  // 指向下一个要读取的字符
-  std::pair<uint64_t, uint64_t> _ptr;
-  // 以行为基础的缓冲区
-  std::vector<std::string> _lines_buffer;
-};
+#pragma once
+
+#include "error/error.h"
+#include "tokenizer/scanner.h"
+#include "tokenizer/source.h"
+#include "tokenizer/token.h"
+#include "tokenizer/utils.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+class Tokenizer final {
+private:
+  using uint64_t = std::uint64_t;
+
+  // 当前不在任何 token 之中
+  static constexpr uint64_t NoTokenStart = UINT64_MAX;
+
+  // 状态机的所有状态
+  enum DFAState {
+    INITIAL_STATE,
+    UNSIGNED_INTEGER_STATE,
+    PLUS_SIGN_STATE,
+    MINUS_SIGN_STATE,
+    DIVISION_SIGN_STATE,
+    MULTIPLICATION_SIGN_STATE,
+    IDENTIFIER_STATE,
+    EQUAL_SIGN_STATE,
+    SEMICOLON_STATE,
+    LEFTBRACKET_STATE,
+    RIGHTBRACKET_STATE
+  };
+
+public:
+  Tokenizer(std::istream &ifs)
+      : _rdr(&ifs),
+        _initialized(false),
+        _ptr(0),
+        _token_start(NoTokenStart),
+        _buffer(),
+        _scanner(&Scanner::Default()) {}
+  // 直接在一个已经准备好的缓冲区上分析，比如 mmap 进来的文件，
+  // 或者是 SourceBuffer::Streaming 得到的流式窗口
+  Tokenizer(SourceBuffer buffer)
+      : _rdr(nullptr),
+        _initialized(true),
+        _ptr(0),
+        _token_start(NoTokenStart),
+        _buffer(std::move(buffer)),
+        _scanner(&Scanner::Default()) {}
+  Tokenizer(Tokenizer &&tkz) = delete;
+  Tokenizer(const Tokenizer &) = delete;
+  Tokenizer &operator=(const Tokenizer &) = delete;
+
+  // 核心函数，返回下一个 token
+  std::pair<std::optional<Token>, std::optional<CompilationError>> NextToken();
+  // 一次返回所有 token
+  std::pair<std::vector<Token>, std::optional<CompilationError>> AllTokens();
+  // 换一组扫描函数，得到的 token 不会有任何区别
+  void UseScanEngine(ScanEngine engine) { _scanner = &Scanner::Get(engine); }
+
+private:
+  // 检查 Token 的合法性
+  std::optional<CompilationError> checkToken(const Token &);
+  //
+  // ** 你需要完成这个函数 **
+  //
+  // 返回下一个 token，是 NextToken 实际实现部分
+  std::pair<std::optional<Token>, std::optional<CompilationError>> nextToken();
+
+  // 从这里开始是缓冲区的操作
+  // 缓冲区就是 SourceBuffer 里的一整块连续内存，加上一个偏移，有四个细节
+  // 1.缓冲区包括 \n，但最后一行不一定以 \n 结尾
+  // 2.指针始终指向下一个要读取的 char
+  // 3.行号和列号从 0 开始，只在需要的时候由 SourceBuffer 根据偏移算出来
+  // 4.流式模式下内存里只有一个窗口，指针是整个输入中的偏移，
+  //   isEOF() 在窗口读完时负责 Refill()，并且保留上一个字符，
+  //   正在分析的 token 也会完整地保留在窗口里
+  // 成段的空白、标识符和数字不再一个一个字符地读，而是交给 _scanner 一次跳过
+
+  // 如果是从流构造的，第一次读取时把流里的内容一次读进缓冲区
+  void readAll();
+  // 一个简单的总结
+  // 偏移   | 0 | 1 | 2 | 3 | 4 | 4 | 5 | 6 | 7 | 8 | 9  |
+  //        | = | = | = | = | = | = | = | = | = | = | =  |
+  // 缓冲区 | h | a | 1 | 9 | 2 | 6 | 0 | 8 | 1 | 7 | \n |（第0行）
+  //        | 1 | 1 | 4 | 5 | 1 | 4 |                     （第1行）
+  // 这里假设指针指向第一行的 \n，那么有
+  // currentPos() = (0, 9)
+  // previousPos() = (0, 8)
+  // nextChar() = '\n' 并且指针移动到 (1, 0)
+  std::pair<uint64_t, uint64_t> currentPos();
+  std::pair<uint64_t, uint64_t> previousPos();
+  std::optional<char> nextChar();
+  bool isEOF();
+  // 用 skip 从指针处跳过一段字符，窗口读完时会继续 Refill()
+  // 停在某个字符前时返回 true，一直跳到了 EOF 时返回 false
+  bool skipRun(Scanner::ScanFunction skip);
+
+private:
+  // 从缓冲区构造时为空
+  std::istream *_rdr;
+  // 如果没有初始化，那么就 readAll
+  bool _initialized;
+  // 下一个要读取的字符在缓冲区中的偏移
+  uint64_t _ptr;
+  // 正在分析的 token 的第一个字符的偏移
+  uint64_t _token_start;
+  SourceBuffer _buffer;
+  const Scanner* _scanner;
+};
 } // namespace miniplc0
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "vm/vm.h"
+
+#include <cstdint>
+#include <limits>
+
+namespace miniplc0 {
+
+namespace detail {
+// 虚拟机执行运算时用的带溢出检查的算术
+// 都用 64 位计算，结果写进 out，返回结果能不能放进 32 位
+inline bool Fits(std::int64_t r) {
+  return r >= std::numeric_limits<std::int32_t>::min() &&
+         r <= std::numeric_limits<std::int32_t>::max();
+}
+
+inline bool Add(std::int32_t lhs, std::int32_t rhs, std::int32_t& out) {
+  std::int64_t r = static_cast<std::int64_t>(lhs) + rhs;
+  out = static_cast<std::int32_t>(r);
+  return Fits(r);
+}
+
+inline bool Sub(std::int32_t lhs, std::int32_t rhs, std::int32_t& out) {
+  std::int64_t r = static_cast<std::int64_t>(lhs) - rhs;
+  out = static_cast<std::int32_t>(r);
+  return Fits(r);
+}
+
+inline bool Mul(std::int32_t lhs, std::int32_t rhs, std::int32_t& out) {
+  std::int64_t r = static_cast<std::int64_t>(lhs) * rhs;
+  out = static_cast<std::int32_t>(r);
+  return Fits(r);
+}
+
+// 除法有两种出错的方式，出错时 err 是其中的一种
+inline bool Div(std::int32_t lhs, std::int32_t rhs, std::int32_t& out,
+                RuntimeErrorCode& err) {
+  if (rhs == 0) {
+    err = ErrDivideByZero;
+    return false;
+  }
+  if (rhs == -1 && lhs == std::numeric_limits<std::int32_t>::min()) {
+    err = ErrDivOverflow;
+    return false;
+  }
+  out = lhs / rhs;
+  return true;
+}
+}  // namespace detail
+}  // namespace miniplc0
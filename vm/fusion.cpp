@@ -0,0 +1,167 @@
+#include "vm/fusion.h"
+
+#include <cstdint>
+
+namespace miniplc0 {
+
+namespace {
+using int32_t = std::int32_t;
+
+bool isArithmetic(Operation op) {
+  return op == Operation::ADD || op == Operation::SUB ||
+         op == Operation::MUL || op == Operation::DIV;
+}
+
+// Whether x names a stack slot.
+bool usesSlot(Operation op) {
+  switch (op) {
+    case Operation::LOD:
+    case Operation::STO:
+    case Operation::LODADD:
+    case Operation::LODSUB:
+    case Operation::LODMUL:
+    case Operation::LODDIV:
+    case Operation::ADDSTO:
+    case Operation::SUBSTO:
+    case Operation::MULSTO:
+    case Operation::DIVSTO:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// ADD, SUB, MUL and DIV are consecutive, and so is every fused family.
+Operation withImmediate(Operation op) {
+  return static_cast<Operation>(Operation::ADDI + (op - Operation::ADD));
+}
+Operation withLoad(Operation op) {
+  return static_cast<Operation>(Operation::LODADD + (op - Operation::ADD));
+}
+Operation withStore(Operation op) {
+  return static_cast<Operation>(Operation::ADDSTO + (op - Operation::ADD));
+}
+
+class Fuser final {
+ public:
+  explicit Fuser(std::size_t size) : _out(), _origins(), _writers() {
+    _out.reserve(size);
+    _origins.reserve(size);
+  }
+
+  // Returns false, without emitting anything, if the instruction would
+  // misuse the stack.
+  bool Fuse(const Instruction& ins, std::size_t origin) {
+    auto op = ins.GetOperation();
+    auto x = ins.GetX();
+    int32_t depth = static_cast<int32_t>(_writers.size());
+    switch (op) {
+      case Operation::LIT:
+        emit(ins, origin);
+        _writers.push_back(_out.size() - 1);
+        return true;
+      case Operation::LOD:
+        if (x < 0 || x >= depth) return false;
+        emit(ins, origin);
+        _writers.push_back(_out.size() - 1);
+        return true;
+      case Operation::STO:
+        if (x < 0 || x >= depth) return false;
+        if (isArithmetic(_out.back().GetOperation())) {
+          // The last instruction computed the value being stored. It can
+          // trap, so it stays the origin.
+          _out.back() = Instruction(withStore(_out.back().GetOperation()), x);
+        } else {
+          emit(ins, origin);
+        }
+        _writers.pop_back();
+        // x no longer holds whatever pushed it.
+        if (x < depth - 1) _writers[x] = _out.size() - 1;
+        return true;
+      case Operation::ADD:
+      case Operation::SUB:
+      case Operation::MUL:
+      case Operation::DIV:
+        if (depth < 2) return false;
+        fuseArithmetic(op, origin);
+        return true;
+      case Operation::WRT:
+        if (depth < 1) return false;
+        emit(ins, origin);
+        _writers.pop_back();
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Copies the rest of the program as it is.
+  void Copy(const Instruction& ins, std::size_t origin) { emit(ins, origin); }
+
+  std::pair<std::vector<Instruction>, std::vector<std::size_t>> Take() {
+    return std::make_pair(std::move(_out), std::move(_origins));
+  }
+
+ private:
+  void emit(const Instruction& ins, std::size_t origin) {
+    _out.push_back(ins);
+    _origins.push_back(origin);
+  }
+
+  void fuseArithmetic(Operation op, std::size_t origin) {
+    auto& last = _out.back();
+    // The last instruction pushed the right operand whenever it is a LIT or
+    // a LOD, since nothing that pushes can come between them.
+    if (last.GetOperation() == Operation::LIT) {
+      last = Instruction(withImmediate(op), last.GetX());
+    } else if (last.GetOperation() == Operation::LOD) {
+      last = Instruction(withLoad(op), last.GetX());
+    } else if (op == Operation::SUB && negates()) {
+      emit(Instruction(Operation::NEG, 0), origin);
+    } else {
+      emit(Instruction(op, 0), origin);
+    }
+    _origins.back() = origin;
+    _writers.pop_back();
+    _writers.back() = _out.size() - 1;
+  }
+
+  // If the left operand of a SUB is still the LIT 0 that pushed it, removes
+  // that LIT 0 so that the SUB can become a NEG.
+  bool negates() {
+    std::size_t slot = _writers.size() - 2;
+    std::size_t lit = _writers[slot];
+    if (_out[lit].GetOperation() != Operation::LIT || _out[lit].GetX() != 0)
+      return false;
+    // Everything pushed after it moves down by one slot, which only matters
+    // to instructions that name those slots.
+    for (std::size_t i = lit + 1; i < _out.size(); i++)
+      if (usesSlot(_out[i].GetOperation()) &&
+          _out[i].GetX() >= static_cast<int32_t>(slot))
+        return false;
+    _out.erase(_out.begin() + lit);
+    _origins.erase(_origins.begin() + lit);
+    for (auto& writer : _writers)
+      if (writer > lit) writer--;
+    return true;
+  }
+
+ private:
+  std::vector<Instruction> _out;
+  std::vector<std::size_t> _origins;
+  // _writers[i] is the instruction in _out that last wrote stack slot i, so
+  // its size is the stack depth.
+  std::vector<std::size_t> _writers;
+};
+}  // namespace
+
+std::pair<std::vector<Instruction>, std::vector<std::size_t>> FuseInstructions(
+    const std::vector<Instruction>& v) {
+  Fuser fuser(v.size());
+  std::size_t i = 0;
+  for (; i < v.size() && fuser.Fuse(v[i], i); i++)
+    ;
+  for (; i < v.size(); i++) fuser.Copy(v[i], i);
+  return fuser.Take();
+}
+}  // namespace miniplc0
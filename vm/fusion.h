@@ -0,0 +1,25 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 把分析器生成的指令里常见的序列合并成超级指令，减少虚拟机分发的次数
+//
+// 合并的序列：
+// LIT c; ADD          ADDI c         (SUB MUL DIV 同理)
+// LOD x; ADD          LODADD x       (SUB MUL DIV 同理)
+// LIT 0; <factor>; SUB    <factor>; NEG
+// ADD; STO x          ADDSTO x       (SUB MUL DIV 同理)
+//
+// 合并后的程序输出和出错的方式都和原来一样。
+// 第二项是每条合并后的指令对应的原始指令的下标，可能出错的超级指令对应
+// 其中的那条运算指令，用来把运行时错误的位置换算回原来的程序。
+// 栈的使用不合法时，从那条指令开始的剩余部分原样保留。
+std::pair<std::vector<Instruction>, std::vector<std::size_t>> FuseInstructions(
+    const std::vector<Instruction>& v);
+}  // namespace miniplc0
@@ -0,0 +1,274 @@
+#include "vm/jit.h"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define MINIPLC0_JIT 1
+#include <sys/mman.h>
+#endif
+
+namespace miniplc0 {
+
+namespace {
+using int32_t = std::int32_t;
+using uint8_t = std::uint8_t;
+
+// Just enough of an x86-64 assembler for what the JIT emits. The generated
+// function gets the registers in rdi and the output buffer in rsi, and only
+// touches eax, ecx and edx besides (cdq and idiv write edx), all of which
+// are caller-saved, so it needs no prologue.
+class Assembler final {
+ public:
+  std::vector<uint8_t>& Code() { return _bytes; }
+
+  void Byte(uint8_t b) { _bytes.push_back(b); }
+  void Bytes(std::initializer_list<uint8_t> bs) {
+    _bytes.insert(_bytes.end(), bs);
+  }
+  void Int32(int32_t v) {
+    auto u = static_cast<std::uint32_t>(v);
+    for (int i = 0; i < 4; i++) Byte(static_cast<uint8_t>(u >> (8 * i)));
+  }
+  // opcode bytes, then a [base + disp] operand, where modrm has mod = 10
+  // (disp32). Small displacements use the one byte form instead.
+  void Memory(std::initializer_list<uint8_t> opcode, uint8_t modrm,
+              int32_t disp) {
+    Bytes(opcode);
+    if (disp >= -128 && disp < 128) {
+      Byte(static_cast<uint8_t>(modrm - 0x40));
+      Byte(static_cast<uint8_t>(disp));
+    } else {
+      Byte(modrm);
+      Int32(disp);
+    }
+  }
+  // A rel32 jump whose target is filled in later by Patch.
+  std::size_t Jump(std::initializer_list<uint8_t> opcode) {
+    Bytes(opcode);
+    Int32(0);
+    return _bytes.size() - 4;
+  }
+  void Patch(std::size_t at, std::size_t target) {
+    auto rel = static_cast<int32_t>(static_cast<std::int64_t>(target) -
+                                    static_cast<std::int64_t>(at + 4));
+    auto u = static_cast<std::uint32_t>(rel);
+    for (int i = 0; i < 4; i++)
+      _bytes[at + i] = static_cast<uint8_t>(u >> (8 * i));
+  }
+
+ private:
+  std::vector<uint8_t> _bytes;
+};
+
+// ModR/M bytes for [rdi + disp32] and [rsi + disp32] with eax or ecx.
+constexpr uint8_t EAX_RDI = 0x87;
+constexpr uint8_t ECX_RDI = 0x8f;
+constexpr uint8_t EAX_RSI = 0x86;
+
+// rdi points this many registers into the array, so that the first 64 are
+// all within a one byte displacement.
+constexpr int32_t BIAS = 32;
+inline int32_t slot(int32_t reg) { return (reg - BIAS) * 4; }
+}  // namespace
+
+JitProgram::JitProgram(const std::vector<Instruction>& v)
+    : _code(nullptr),
+      _size(0),
+      _traps(),
+      _registers(),
+      _outputs(0),
+      _invalid(),
+      _fallback() {
+  auto program = LowerToRegisters(v);
+  if (program.invalid.has_value()) {
+    _invalid = program.invalid;
+    return;
+  }
+  compile(program);
+  if (_code == nullptr)
+    _fallback = std::make_unique<RegisterMachine>(std::move(program));
+}
+
+JitProgram::~JitProgram() {
+#ifdef MINIPLC0_JIT
+  if (_code != nullptr) munmap(_code, _size);
+#endif
+}
+
+bool JitProgram::IsSupported() {
+#ifdef MINIPLC0_JIT
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::pair<std::vector<std::int32_t>, std::optional<RuntimeError>>
+JitProgram::Run() {
+  std::vector<int32_t> out;
+  if (_invalid.has_value()) return std::make_pair(out, _invalid);
+  if (_fallback) return _fallback->Run();
+  out.resize(_outputs);
+  auto entry = reinterpret_cast<Entry>(_code);
+  auto trap = entry(_registers.data() + BIAS, out.data());
+  if (trap == 0) return std::make_pair(std::move(out), std::nullopt);
+  auto& t = _traps[trap - 1];
+  out.resize(t.outputs);
+  return std::make_pair(std::move(out), std::make_optional(t.err));
+}
+
+void JitProgram::compile(const RegisterProgram& program) {
+#ifdef MINIPLC0_JIT
+  std::size_t outputs = 0;
+  for (auto& code : program.code)
+    if (code.op == RegisterOperation::WRT) outputs++;
+  // Every register and output is addressed with a 32-bit displacement.
+  constexpr std::size_t limit = std::numeric_limits<int32_t>::max() / 4;
+  if (static_cast<std::size_t>(program.stack) > limit || outputs > limit)
+    return;
+
+  Assembler as;
+  // Roughly what an arithmetic instruction takes.
+  as.Code().reserve(program.code.size() * 16 + 16);
+  std::vector<std::pair<std::size_t, std::size_t>> jumps;
+  auto isConstant = [&](int32_t reg) { return reg >= program.stack; };
+  auto constant = [&](int32_t reg) {
+    return program.constants[reg - program.stack];
+  };
+  auto trap = [&](std::size_t i, RuntimeErrorCode code,
+                  std::initializer_list<uint8_t> jump) {
+    _traps.push_back(Trap{RuntimeError(program.origins[i], code), _outputs});
+    jumps.emplace_back(as.Jump(jump), _traps.size());
+  };
+  auto loadEax = [&](int32_t reg) {
+    if (isConstant(reg)) {
+      as.Byte(0xb8);
+      as.Int32(constant(reg));
+    } else {
+      as.Memory({0x8b}, EAX_RDI, slot(reg));
+    }
+  };
+  // op eax, reg, with the forms for a memory and an immediate operand.
+  auto operate = [&](uint8_t memory, uint8_t immediate, int32_t reg) {
+    if (isConstant(reg)) {
+      as.Byte(immediate);
+      as.Int32(constant(reg));
+    } else {
+      as.Memory({memory}, EAX_RDI, slot(reg));
+    }
+  };
+  const std::initializer_list<uint8_t> JO = {0x0f, 0x80};
+  const std::initializer_list<uint8_t> JE = {0x0f, 0x84};
+  const std::initializer_list<uint8_t> JMP = {0xe9};
+
+  for (std::size_t i = 0; i < program.code.size(); i++) {
+    auto& c = program.code[i];
+    switch (c.op) {
+      case RegisterOperation::MOV:
+        if (isConstant(c.a)) {
+          as.Memory({0xc7}, EAX_RDI, slot(c.dst));
+          as.Int32(constant(c.a));
+          continue;
+        }
+        loadEax(c.a);
+        break;
+      case RegisterOperation::ADD:
+        loadEax(c.a);
+        operate(0x03, 0x05, c.b);
+        trap(i, ErrAddOverflow, JO);
+        break;
+      case RegisterOperation::SUB:
+        loadEax(c.a);
+        operate(0x2b, 0x2d, c.b);
+        trap(i, ErrSubOverflow, JO);
+        break;
+      case RegisterOperation::MUL:
+        loadEax(c.a);
+        if (isConstant(c.b)) {
+          // imul eax, eax, imm32
+          as.Bytes({0x69, 0xc0});
+          as.Int32(constant(c.b));
+        } else {
+          as.Memory({0x0f, 0xaf}, EAX_RDI, slot(c.b));
+        }
+        trap(i, ErrMulOverflow, JO);
+        break;
+      case RegisterOperation::DIV:
+        loadEax(c.a);
+        if (isConstant(c.b)) {
+          // The divisor is known, and so is which check it needs.
+          auto d = constant(c.b);
+          if (d == 0) {
+            trap(i, ErrDivideByZero, JMP);
+            continue;
+          }
+          if (d == -1) {
+            as.Byte(0x3d);  // cmp eax, INT_MIN
+            as.Int32(std::numeric_limits<int32_t>::min());
+            trap(i, ErrDivOverflow, JE);
+            as.Bytes({0xf7, 0xd8});  // neg eax
+            break;
+          }
+          as.Byte(0xb9);  // mov ecx, imm32
+          as.Int32(d);
+        } else {
+          as.Memory({0x8b}, ECX_RDI, slot(c.b));
+          as.Bytes({0x85, 0xc9});  // test ecx, ecx
+          trap(i, ErrDivideByZero, JE);
+          as.Bytes({0x83, 0xf9, 0xff});  // cmp ecx, -1
+          as.Bytes({0x75, 0x0b});        // jne over the next two
+          as.Byte(0x3d);                 // cmp eax, INT_MIN
+          as.Int32(std::numeric_limits<int32_t>::min());
+          trap(i, ErrDivOverflow, JE);
+        }
+        as.Bytes({0x99, 0xf7, 0xf9});  // cdq; idiv ecx
+        break;
+      case RegisterOperation::WRT:
+        if (isConstant(c.a)) {
+          as.Memory({0xc7}, EAX_RSI, static_cast<int32_t>(_outputs * 4));
+          as.Int32(constant(c.a));
+        } else {
+          loadEax(c.a);
+          as.Memory({0x89}, EAX_RSI, static_cast<int32_t>(_outputs * 4));
+        }
+        _outputs++;
+        continue;
+      default:
+        trap(i, ErrIllegalInstruction, JMP);
+        continue;
+    }
+    // Every case that breaks leaves the result in eax.
+    as.Memory({0x89}, EAX_RDI, slot(c.dst));
+  }
+  as.Bytes({0x31, 0xc0, 0xc3});  // xor eax, eax; ret
+
+  // One stub per trap, returning its number.
+  std::vector<std::size_t> stubs;
+  for (std::size_t t = 1; t <= _traps.size(); t++) {
+    stubs.push_back(as.Code().size());
+    as.Byte(0xb8);
+    as.Int32(static_cast<int32_t>(t));
+    as.Byte(0xc3);
+  }
+  for (auto& jump : jumps) as.Patch(jump.first, stubs[jump.second - 1]);
+
+  auto& bytes = as.Code();
+  void* code = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) return;
+  std::memcpy(code, bytes.data(), bytes.size());
+  if (mprotect(code, bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+    munmap(code, bytes.size());
+    return;
+  }
+  _code = code;
+  _size = bytes.size();
+  _registers.assign(std::max<std::size_t>(program.stack, BIAS), 0);
+#else
+  (void)program;
+#endif
+}
+}  // namespace miniplc0
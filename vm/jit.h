@@ -0,0 +1,69 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "vm/register_vm.h"
+#include "vm/vm.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 把程序编译成 x86-64 机器码执行
+//
+// 先用 LowerToRegisters 翻译成寄存器指令：寄存器是内存里的一个数组，
+// 常量直接编码成立即数。每条寄存器指令变成几条机器指令，溢出和除法的检查
+// 失败时跳到代码末尾对应的出错处理，返回是哪一处出的错。
+// 机器码放在 mmap 出来的页里，写完之后改成只读可执行。
+//
+// Run 的结果和 VirtualMachine 执行原来的指令完全一样。
+// 不是 Linux x86-64，或者申请不到可执行的内存时，用 RegisterMachine 解释执行。
+class JitProgram final {
+ private:
+  using int32_t = std::int32_t;
+
+ public:
+  explicit JitProgram(const std::vector<Instruction>& v);
+  JitProgram(const JitProgram&) = delete;
+  JitProgram& operator=(JitProgram) = delete;
+  ~JitProgram();
+
+  // 当前平台能不能生成机器码
+  static bool IsSupported();
+
+  // 是否真的生成了机器码
+  bool IsCompiled() const { return _code != nullptr; }
+  // 机器码的字节数
+  std::size_t CodeSize() const { return _size; }
+
+  // 执行整个程序，返回输出的所有值
+  // 出错时第一项是出错之前已经输出的值
+  // 可以执行多次，每次都从头开始
+  std::pair<std::vector<int32_t>, std::optional<RuntimeError>> Run();
+
+ private:
+  // 生成的函数，成功时返回 0，出错时返回 _traps 的下标加一
+  using Entry = std::uint32_t (*)(int32_t* registers, int32_t* out);
+
+  struct Trap {
+    RuntimeError err;
+    // 出错之前输出了几个值
+    std::size_t outputs;
+  };
+
+  void compile(const RegisterProgram& program);
+
+ private:
+  void* _code;
+  std::size_t _size;
+  std::vector<Trap> _traps;
+  std::vector<int32_t> _registers;
+  std::size_t _outputs;
+  std::optional<RuntimeError> _invalid;
+  std::unique_ptr<RegisterMachine> _fallback;
+};
+}  // namespace miniplc0
@@ -0,0 +1,329 @@
+#include "vm/register_vm.h"
+
+#include "vm/arithmetic.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MINIPLC0_THREADED_DISPATCH 1
+#endif
+
+namespace miniplc0 {
+
+namespace {
+using int32_t = std::int32_t;
+using int64_t = std::int64_t;
+using detail::Add;
+using detail::Div;
+using detail::Mul;
+using detail::Sub;
+
+RegisterOperation arithmetic(Operation op) {
+  switch (op) {
+    case Operation::ADD:
+    case Operation::ADDI:
+    case Operation::LODADD:
+    case Operation::ADDSTO:
+      return RegisterOperation::ADD;
+    case Operation::SUB:
+    case Operation::SUBI:
+    case Operation::LODSUB:
+    case Operation::SUBSTO:
+    case Operation::NEG:
+      return RegisterOperation::SUB;
+    case Operation::MUL:
+    case Operation::MULI:
+    case Operation::LODMUL:
+    case Operation::MULSTO:
+      return RegisterOperation::MUL;
+    default:
+      return RegisterOperation::DIV;
+  }
+}
+}  // namespace
+
+RegisterProgram LowerToRegisters(const std::vector<Instruction>& v) {
+  RegisterProgram p{{}, 0, {}, {}, {}};
+  p.code.reserve(v.size());
+  p.origins.reserve(v.size());
+  // The register holding the value at each stack position. Constants are
+  // numbered -1, -2... until the size of the stack is known.
+  std::vector<int32_t> at;
+  std::unordered_map<int32_t, int32_t> constants;
+  // Stack positions that were loaded from each register, some of which may
+  // have been popped since.
+  std::vector<std::vector<int32_t>> readers;
+  std::size_t i = 0;
+
+  auto constant = [&](int32_t value) {
+    auto it = constants.emplace(
+        value, -static_cast<int32_t>(p.constants.size()) - 1);
+    if (it.second) p.constants.push_back(value);
+    return it.first->second;
+  };
+  auto emit = [&](RegisterOperation op, int32_t dst, int32_t a, int32_t b) {
+    p.code.push_back(RegisterInstruction{op, dst, a, b});
+    p.origins.push_back(i);
+  };
+  auto push = [&](int32_t reg) {
+    auto pos = static_cast<int32_t>(at.size());
+    if (reg >= 0 && reg != pos) readers[reg].push_back(pos);
+    at.push_back(reg);
+    readers.resize(std::max(readers.size(), at.size()));
+    p.stack = std::max(p.stack, static_cast<int32_t>(at.size()));
+  };
+  auto pop = [&]() {
+    auto reg = at.back();
+    at.pop_back();
+    return reg;
+  };
+  // Whatever still reads slot x gets a copy of its own before x changes.
+  auto detach = [&](int32_t x) {
+    for (auto pos : readers[x]) {
+      if (pos < static_cast<int32_t>(at.size()) && pos != x && at[pos] == x) {
+        emit(RegisterOperation::MOV, pos, x, 0);
+        at[pos] = pos;
+      }
+    }
+    readers[x].clear();
+  };
+  auto compute = [&](Operation op, int32_t lhs, int32_t rhs) {
+    auto dst = static_cast<int32_t>(at.size());
+    emit(arithmetic(op), dst, lhs, rhs);
+    push(dst);
+  };
+
+  // Stack depth checks are the ones VirtualMachine makes, so that the same
+  // programs are rejected at the same instruction.
+  for (; i < v.size(); i++) {
+    auto op = v[i].GetOperation();
+    auto x = v[i].GetX();
+    auto depth = static_cast<int64_t>(at.size());
+    bool ok = true;
+    switch (op) {
+      case Operation::LIT:
+        push(constant(x));
+        break;
+      case Operation::LOD:
+        ok = x >= 0 && x < depth;
+        if (ok) push(at[x]);
+        break;
+      case Operation::STO: {
+        ok = x >= 0 && x < depth;
+        if (!ok) break;
+        auto value = pop();
+        // Storing into the popped position itself, or a value into its own
+        // register, changes nothing anyone can read.
+        if (x == depth - 1 || value == x) break;
+        auto before = p.code.size();
+        detach(x);
+        if (before > 0 && p.code.size() == before && value == depth - 1 &&
+            p.code.back().dst == value &&
+            p.code.back().op != RegisterOperation::WRT)
+          // The result was just computed into a temporary; compute it into
+          // the slot instead.
+          p.code.back().dst = x;
+        else
+          emit(RegisterOperation::MOV, x, value, 0);
+        at[x] = x;
+        break;
+      }
+      case Operation::ADD:
+      case Operation::SUB:
+      case Operation::MUL:
+      case Operation::DIV: {
+        ok = depth >= 2;
+        if (!ok) break;
+        auto rhs = pop();
+        auto lhs = pop();
+        compute(op, lhs, rhs);
+        break;
+      }
+      case Operation::WRT:
+        ok = depth >= 1;
+        if (ok) emit(RegisterOperation::WRT, 0, pop(), 0);
+        break;
+      case Operation::ADDI:
+      case Operation::SUBI:
+      case Operation::MULI:
+      case Operation::DIVI:
+        ok = depth >= 1;
+        if (ok) compute(op, pop(), constant(x));
+        break;
+      case Operation::LODADD:
+      case Operation::LODSUB:
+      case Operation::LODMUL:
+      case Operation::LODDIV:
+        ok = depth >= 1 && x >= 0 && x < depth;
+        if (ok) {
+          auto rhs = at[x];
+          compute(op, pop(), rhs);
+        }
+        break;
+      case Operation::NEG:
+        ok = depth >= 1;
+        if (ok) compute(op, constant(0), pop());
+        break;
+      case Operation::ADDSTO:
+      case Operation::SUBSTO:
+      case Operation::MULSTO:
+      case Operation::DIVSTO: {
+        ok = depth >= 2 && x >= 0 && x < depth - 1;
+        if (!ok) break;
+        auto rhs = pop();
+        auto lhs = pop();
+        detach(x);
+        emit(arithmetic(op), x, lhs, rhs);
+        // x may be where lhs was, just past what is left of the stack.
+        if (x < static_cast<int32_t>(at.size())) at[x] = x;
+        break;
+      }
+      default:
+        // Traps when it is reached, and nothing after it ever runs.
+        emit(RegisterOperation::ILL, 0, 0, 0);
+        i = v.size();
+        break;
+    }
+    if (!ok) {
+      p.invalid = RuntimeError(i, ErrInvalidProgram);
+      p.code.clear();
+      p.origins.clear();
+      return p;
+    }
+  }
+
+  // Constants go right after the stack.
+  auto fix = [&](int32_t& reg) {
+    if (reg < 0) reg = p.stack - reg - 1;
+  };
+  for (auto& code : p.code) {
+    fix(code.a);
+    fix(code.b);
+  }
+  return p;
+}
+
+RegisterMachine::RegisterMachine(RegisterProgram program)
+    : _program(std::move(program)), _codes(), _registers(), _outputs(0) {
+  if (_program.invalid.has_value()) return;
+  _codes.reserve(_program.code.size() + 1);
+  for (auto& code : _program.code) {
+    _codes.push_back(
+        Code{static_cast<int32_t>(code.op), code.dst, code.a, code.b});
+    if (code.op == RegisterOperation::WRT) _outputs++;
+  }
+  _codes.push_back(Code{HALT, 0, 0, 0});
+  _registers.assign(_program.stack, 0);
+  _registers.insert(_registers.end(), _program.constants.begin(),
+                    _program.constants.end());
+  run(nullptr);
+}
+
+std::pair<std::vector<std::int32_t>, std::optional<RuntimeError>>
+RegisterMachine::Run() {
+  std::vector<int32_t> out;
+  if (_program.invalid.has_value())
+    return std::make_pair(out, _program.invalid);
+  out.reserve(_outputs);
+  auto err = run(&out);
+  return std::make_pair(std::move(out), err);
+}
+
+// Lowering only refers to registers that exist, and every stack register is
+// written before it is read, so nothing is checked here either.
+std::optional<RuntimeError> RegisterMachine::run(std::vector<int32_t>* out) {
+  auto r = _registers.data();
+  RuntimeErrorCode e;
+
+#define TRAP(code) \
+  return RuntimeError(_program.origins[pc - _codes.data()], code)
+
+#ifdef MINIPLC0_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define OFFSET(label)                                \
+  static_cast<int32_t>(static_cast<char*>(&&label) - \
+                       static_cast<char*>(&&op_ill))
+  static const int32_t offsets[] = {
+      0,
+      OFFSET(op_mov),
+      OFFSET(op_add),
+      OFFSET(op_sub),
+      OFFSET(op_mul),
+      OFFSET(op_div),
+      OFFSET(op_wrt),
+      OFFSET(op_halt),
+  };
+#undef OFFSET
+  static_assert(sizeof(offsets) / sizeof(offsets[0]) == HALT + 1);
+  if (out == nullptr) {
+    for (auto& code : _codes) code.op = offsets[code.op];
+    return {};
+  }
+
+  auto pc = _codes.data();
+  auto base = static_cast<char*>(&&op_ill);
+
+#define NEXT() goto*(base + (++pc)->op)
+
+  goto*(base + pc->op);
+
+op_mov:
+  r[pc->dst] = r[pc->a];
+  NEXT();
+op_add:
+  if (!Add(r[pc->a], r[pc->b], r[pc->dst])) TRAP(ErrAddOverflow);
+  NEXT();
+op_sub:
+  if (!Sub(r[pc->a], r[pc->b], r[pc->dst])) TRAP(ErrSubOverflow);
+  NEXT();
+op_mul:
+  if (!Mul(r[pc->a], r[pc->b], r[pc->dst])) TRAP(ErrMulOverflow);
+  NEXT();
+op_div:
+  if (!Div(r[pc->a], r[pc->b], r[pc->dst], e)) TRAP(e);
+  NEXT();
+op_wrt:
+  out->push_back(r[pc->a]);
+  NEXT();
+op_ill:
+  TRAP(ErrIllegalInstruction);
+op_halt:
+  return {};
+
+#undef NEXT
+#pragma GCC diagnostic pop
+#else
+  if (out == nullptr) return {};
+  for (auto pc = _codes.data();; pc++) {
+    switch (static_cast<RegisterOperation>(pc->op)) {
+      case RegisterOperation::MOV:
+        r[pc->dst] = r[pc->a];
+        break;
+      case RegisterOperation::ADD:
+        if (!Add(r[pc->a], r[pc->b], r[pc->dst])) TRAP(ErrAddOverflow);
+        break;
+      case RegisterOperation::SUB:
+        if (!Sub(r[pc->a], r[pc->b], r[pc->dst])) TRAP(ErrSubOverflow);
+        break;
+      case RegisterOperation::MUL:
+        if (!Mul(r[pc->a], r[pc->b], r[pc->dst])) TRAP(ErrMulOverflow);
+        break;
+      case RegisterOperation::DIV:
+        if (!Div(r[pc->a], r[pc->b], r[pc->dst], e)) TRAP(e);
+        break;
+      case RegisterOperation::WRT:
+        out->push_back(r[pc->a]);
+        break;
+      case RegisterOperation::ILL:
+        TRAP(ErrIllegalInstruction);
+      default:
+        return {};
+    }
+  }
+#endif
+
+#undef TRAP
+}
+}  // namespace miniplc0
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "vm/vm.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 寄存器机的操作
+// 和 Operation 放在同一个命名空间里，所以要用 enum class
+enum class RegisterOperation : std::int32_t {
+  ILL = 0,
+  MOV,  // dst = a
+  ADD,  // dst = a + b
+  SUB,
+  MUL,
+  DIV,
+  WRT,  // 输出 a
+};
+
+// 三地址的寄存器指令，dst a b 都是寄存器的编号
+struct RegisterInstruction {
+  RegisterOperation op;
+  std::int32_t dst;
+  std::int32_t a;
+  std::int32_t b;
+
+  bool operator==(const RegisterInstruction& rhs) const {
+    return op == rhs.op && dst == rhs.dst && a == rhs.a && b == rhs.b;
+  }
+};
+
+// 寄存器机的程序
+//
+// 寄存器 0 到 stack - 1 对应栈机的栈上位置，之后依次是 constants 里的常量。
+// 常量寄存器在执行之前填好，不会被写。
+struct RegisterProgram {
+  std::vector<RegisterInstruction> code;
+  std::int32_t stack;
+  std::vector<std::int32_t> constants;
+  // 每条指令对应的栈机指令的下标，可能出错的指令对应那条运算指令
+  std::vector<std::size_t> origins;
+  // 栈的使用不合法时，VirtualMachine 会报告的错误
+  std::optional<RuntimeError> invalid;
+};
+
+// 把栈机的指令（包括 FuseInstructions 合并出来的超级指令）翻译成寄存器指令
+//
+// LIT 和 LOD 不生成指令，只记下栈上这个位置的值在哪个寄存器里，
+// 用到它的运算直接读那个寄存器；运算的结果写进它在栈上的位置对应的寄存器，
+// 紧接着的 STO 直接把结果写进要存的位置。
+// 运算的顺序和原来一样，所以输出和出错的方式也一样。
+RegisterProgram LowerToRegisters(const std::vector<Instruction>& v);
+
+// 执行 RegisterProgram 的虚拟机
+//
+// Run 的结果和 VirtualMachine 执行原来的栈机指令完全一样，
+// 出错的位置也是原来的栈机指令的下标。
+// 和 VirtualMachine 一样，GCC 和 Clang 下用 computed goto 分发。
+class RegisterMachine final {
+ private:
+  using int32_t = std::int32_t;
+
+ public:
+  explicit RegisterMachine(RegisterProgram program);
+  explicit RegisterMachine(const std::vector<Instruction>& v)
+      : RegisterMachine(LowerToRegisters(v)) {}
+  RegisterMachine(const RegisterMachine&) = delete;
+  RegisterMachine& operator=(RegisterMachine) = delete;
+
+  // 指令的条数，程序没有跳转，也就是执行一遍要分发的次数
+  std::size_t Size() const { return _program.code.size(); }
+
+  // 执行整个程序，返回输出的所有值
+  // 出错时第一项是出错之前已经输出的值
+  // 可以执行多次，每次都从头开始
+  std::pair<std::vector<int32_t>, std::optional<RuntimeError>> Run();
+
+ private:
+  // 译码之后的指令，THREADED 的时候 op 是处理代码的偏移
+  struct Code {
+    int32_t op;
+    int32_t dst;
+    int32_t a;
+    int32_t b;
+  };
+
+  static constexpr int32_t HALT =
+      static_cast<int32_t>(RegisterOperation::WRT) + 1;
+
+  // out 为空时不执行，只把指令流转换成 computed goto 用的形式
+  std::optional<RuntimeError> run(std::vector<int32_t>* out);
+
+ private:
+  RegisterProgram _program;
+  std::vector<Code> _codes;
+  std::vector<int32_t> _registers;
+  std::size_t _outputs;
+};
+}  // namespace miniplc0
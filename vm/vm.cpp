@@ -0,0 +1,365 @@
+#include "vm/vm.h"
+
+#include "vm/arithmetic.h"
+
+#include <algorithm>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MINIPLC0_THREADED_DISPATCH 1
+#endif
+
+namespace miniplc0 {
+
+namespace {
+using int32_t = std::int32_t;
+using int64_t = std::int64_t;
+using detail::Add;
+using detail::Div;
+using detail::Mul;
+using detail::Sub;
+}  // namespace
+
+VirtualMachine::VirtualMachine(const std::vector<Instruction>& v,
+                               Dispatch dispatch)
+    : _codes(),
+      _stack(),
+      _outputs(0),
+      _invalid(),
+      _dispatch(HasThreadedDispatch() ? dispatch : SWITCH) {
+  // Straight-line code, so the stack depth before each instruction is known
+  // here and every access the program will make can be checked once.
+  int64_t depth = 0, max_depth = 0;
+  _codes.reserve(v.size() + 1);
+  for (std::size_t i = 0; i < v.size(); i++) {
+    auto op = v[i].GetOperation();
+    auto x = v[i].GetX();
+    bool ok = true;
+    switch (op) {
+      case Operation::LIT:
+        depth++;
+        break;
+      case Operation::LOD:
+        ok = x >= 0 && x < depth;
+        depth++;
+        break;
+      case Operation::STO:
+        ok = x >= 0 && x < depth;
+        depth--;
+        break;
+      case Operation::ADD:
+      case Operation::SUB:
+      case Operation::MUL:
+      case Operation::DIV:
+        ok = depth >= 2;
+        depth--;
+        break;
+      case Operation::WRT:
+        ok = depth >= 1;
+        depth--;
+        _outputs++;
+        break;
+      case Operation::ADDI:
+      case Operation::SUBI:
+      case Operation::MULI:
+      case Operation::DIVI:
+      case Operation::NEG:
+        ok = depth >= 1;
+        break;
+      case Operation::LODADD:
+      case Operation::LODSUB:
+      case Operation::LODMUL:
+      case Operation::LODDIV:
+        ok = x >= 0 && x < depth;
+        break;
+      case Operation::ADDSTO:
+      case Operation::SUBSTO:
+      case Operation::MULSTO:
+      case Operation::DIVSTO:
+        // The result is stored right after the operands are popped.
+        ok = depth >= 2 && x >= 0 && x < depth - 1;
+        depth -= 2;
+        break;
+      default:
+        // Traps when it is reached, and nothing after it ever runs.
+        op = Operation::ILL;
+        i = v.size();
+        break;
+    }
+    if (!ok) {
+      _invalid = RuntimeError(i, ErrInvalidProgram);
+      _codes.clear();
+      return;
+    }
+    max_depth = std::max(max_depth, depth);
+    _codes.push_back(Code{op, x});
+  }
+  _codes.push_back(Code{HALT, 0});
+  _stack.assign(static_cast<std::size_t>(max_depth), 0);
+  if (_dispatch == THREADED) runThreaded(nullptr);
+}
+
+bool VirtualMachine::HasThreadedDispatch() {
+#ifdef MINIPLC0_THREADED_DISPATCH
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::pair<std::vector<std::int32_t>, std::optional<RuntimeError>>
+VirtualMachine::Run() {
+  std::vector<int32_t> out;
+  if (_invalid.has_value()) return std::make_pair(out, _invalid);
+  out.reserve(_outputs);
+  auto err = _dispatch == THREADED ? runThreaded(&out) : runSwitch(out);
+  return std::make_pair(std::move(out), err);
+}
+
+// Both loops keep the stack pointer in a local and rely on the checks done
+// by the constructor: no underflow, LOD/STO within the live stack, and a
+// HALT at the end so that the instruction pointer needs no bound either.
+
+std::optional<RuntimeError> VirtualMachine::runThreaded(
+    std::vector<int32_t>* out) {
+#ifdef MINIPLC0_THREADED_DISPATCH
+// Labels as values are a GNU extension, which -pedantic complains about.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+  // Handlers are addressed by their offset from op_ill, which keeps a
+  // decoded instruction at 8 bytes.
+#define OFFSET(label)                                \
+  static_cast<int32_t>(static_cast<char*>(&&label) - \
+                       static_cast<char*>(&&op_ill))
+  static const int32_t offsets[] = {
+      0,
+      OFFSET(op_lit),
+      OFFSET(op_lod),
+      OFFSET(op_sto),
+      OFFSET(op_add),
+      OFFSET(op_sub),
+      OFFSET(op_mul),
+      OFFSET(op_div),
+      OFFSET(op_wrt),
+      OFFSET(op_addi),
+      OFFSET(op_subi),
+      OFFSET(op_muli),
+      OFFSET(op_divi),
+      OFFSET(op_lodadd),
+      OFFSET(op_lodsub),
+      OFFSET(op_lodmul),
+      OFFSET(op_loddiv),
+      OFFSET(op_neg),
+      OFFSET(op_addsto),
+      OFFSET(op_substo),
+      OFFSET(op_mulsto),
+      OFFSET(op_divsto),
+      OFFSET(op_halt),
+  };
+#undef OFFSET
+  static_assert(sizeof(offsets) / sizeof(offsets[0]) == HALT + 1);
+  // Label addresses only exist inside this function, so this is also where
+  // the instruction stream gets threaded.
+  if (out == nullptr) {
+    for (auto& code : _codes) code.op = offsets[code.op];
+    return {};
+  }
+
+  auto stack = _stack.data();
+  auto sp = stack;
+  auto pc = _codes.data();
+  auto base = static_cast<char*>(&&op_ill);
+  int32_t r;
+  RuntimeErrorCode e;
+
+#define NEXT() goto*(base + (++pc)->op)
+#define TRAP(code) return RuntimeError(pc - _codes.data(), code)
+
+  goto*(base + pc->op);
+
+op_lit:
+  *sp++ = pc->x;
+  NEXT();
+op_lod:
+  *sp++ = stack[pc->x];
+  NEXT();
+op_sto:
+  stack[pc->x] = sp[-1];
+  sp--;
+  NEXT();
+op_add:
+  if (!Add(sp[-2], sp[-1], r)) TRAP(ErrAddOverflow);
+  *(--sp - 1) = r;
+  NEXT();
+op_sub:
+  if (!Sub(sp[-2], sp[-1], r)) TRAP(ErrSubOverflow);
+  *(--sp - 1) = r;
+  NEXT();
+op_mul:
+  if (!Mul(sp[-2], sp[-1], r)) TRAP(ErrMulOverflow);
+  *(--sp - 1) = r;
+  NEXT();
+op_div:
+  if (!Div(sp[-2], sp[-1], r, e)) TRAP(e);
+  *(--sp - 1) = r;
+  NEXT();
+op_wrt:
+  out->push_back(*--sp);
+  NEXT();
+op_addi:
+  if (!Add(sp[-1], pc->x, sp[-1])) TRAP(ErrAddOverflow);
+  NEXT();
+op_subi:
+  if (!Sub(sp[-1], pc->x, sp[-1])) TRAP(ErrSubOverflow);
+  NEXT();
+op_muli:
+  if (!Mul(sp[-1], pc->x, sp[-1])) TRAP(ErrMulOverflow);
+  NEXT();
+op_divi:
+  if (!Div(sp[-1], pc->x, sp[-1], e)) TRAP(e);
+  NEXT();
+op_lodadd:
+  if (!Add(sp[-1], stack[pc->x], sp[-1])) TRAP(ErrAddOverflow);
+  NEXT();
+op_lodsub:
+  if (!Sub(sp[-1], stack[pc->x], sp[-1])) TRAP(ErrSubOverflow);
+  NEXT();
+op_lodmul:
+  if (!Mul(sp[-1], stack[pc->x], sp[-1])) TRAP(ErrMulOverflow);
+  NEXT();
+op_loddiv:
+  if (!Div(sp[-1], stack[pc->x], sp[-1], e)) TRAP(e);
+  NEXT();
+op_neg:
+  if (!Sub(0, sp[-1], sp[-1])) TRAP(ErrSubOverflow);
+  NEXT();
+op_addsto:
+  if (!Add(sp[-2], sp[-1], r)) TRAP(ErrAddOverflow);
+  sp -= 2;
+  stack[pc->x] = r;
+  NEXT();
+op_substo:
+  if (!Sub(sp[-2], sp[-1], r)) TRAP(ErrSubOverflow);
+  sp -= 2;
+  stack[pc->x] = r;
+  NEXT();
+op_mulsto:
+  if (!Mul(sp[-2], sp[-1], r)) TRAP(ErrMulOverflow);
+  sp -= 2;
+  stack[pc->x] = r;
+  NEXT();
+op_divsto:
+  if (!Div(sp[-2], sp[-1], r, e)) TRAP(e);
+  sp -= 2;
+  stack[pc->x] = r;
+  NEXT();
+op_ill:
+  TRAP(ErrIllegalInstruction);
+op_halt:
+  return {};
+
+#undef NEXT
+#undef TRAP
+#pragma GCC diagnostic pop
+#else
+  if (out == nullptr) return {};
+  return runSwitch(*out);
+#endif
+}
+
+std::optional<RuntimeError> VirtualMachine::runSwitch(
+    std::vector<int32_t>& out) {
+  auto stack = _stack.data();
+  auto sp = stack;
+  int32_t r;
+  RuntimeErrorCode e;
+
+#define TRAP(code) return RuntimeError(pc - _codes.data(), code)
+
+  for (auto pc = _codes.data();; pc++) {
+    switch (pc->op) {
+      case Operation::LIT:
+        *sp++ = pc->x;
+        break;
+      case Operation::LOD:
+        *sp++ = stack[pc->x];
+        break;
+      case Operation::STO:
+        stack[pc->x] = sp[-1];
+        sp--;
+        break;
+      case Operation::ADD:
+        if (!Add(sp[-2], sp[-1], r)) TRAP(ErrAddOverflow);
+        *(--sp - 1) = r;
+        break;
+      case Operation::SUB:
+        if (!Sub(sp[-2], sp[-1], r)) TRAP(ErrSubOverflow);
+        *(--sp - 1) = r;
+        break;
+      case Operation::MUL:
+        if (!Mul(sp[-2], sp[-1], r)) TRAP(ErrMulOverflow);
+        *(--sp - 1) = r;
+        break;
+      case Operation::DIV:
+        if (!Div(sp[-2], sp[-1], r, e)) TRAP(e);
+        *(--sp - 1) = r;
+        break;
+      case Operation::WRT:
+        out.push_back(*--sp);
+        break;
+      case Operation::ADDI:
+        if (!Add(sp[-1], pc->x, sp[-1])) TRAP(ErrAddOverflow);
+        break;
+      case Operation::SUBI:
+        if (!Sub(sp[-1], pc->x, sp[-1])) TRAP(ErrSubOverflow);
+        break;
+      case Operation::MULI:
+        if (!Mul(sp[-1], pc->x, sp[-1])) TRAP(ErrMulOverflow);
+        break;
+      case Operation::DIVI:
+        if (!Div(sp[-1], pc->x, sp[-1], e)) TRAP(e);
+        break;
+      case Operation::LODADD:
+        if (!Add(sp[-1], stack[pc->x], sp[-1])) TRAP(ErrAddOverflow);
+        break;
+      case Operation::LODSUB:
+        if (!Sub(sp[-1], stack[pc->x], sp[-1])) TRAP(ErrSubOverflow);
+        break;
+      case Operation::LODMUL:
+        if (!Mul(sp[-1], stack[pc->x], sp[-1])) TRAP(ErrMulOverflow);
+        break;
+      case Operation::LODDIV:
+        if (!Div(sp[-1], stack[pc->x], sp[-1], e)) TRAP(e);
+        break;
+      case Operation::NEG:
+        if (!Sub(0, sp[-1], sp[-1])) TRAP(ErrSubOverflow);
+        break;
+      case Operation::ADDSTO:
+        if (!Add(sp[-2], sp[-1], r)) TRAP(ErrAddOverflow);
+        sp -= 2;
+        stack[pc->x] = r;
+        break;
+      case Operation::SUBSTO:
+        if (!Sub(sp[-2], sp[-1], r)) TRAP(ErrSubOverflow);
+        sp -= 2;
+        stack[pc->x] = r;
+        break;
+      case Operation::MULSTO:
+        if (!Mul(sp[-2], sp[-1], r)) TRAP(ErrMulOverflow);
+        sp -= 2;
+        stack[pc->x] = r;
+        break;
+      case Operation::DIVSTO:
+        if (!Div(sp[-2], sp[-1], r, e)) TRAP(e);
+        sp -= 2;
+        stack[pc->x] = r;
+        break;
+      case HALT:
+        return {};
+      default:
+        TRAP(ErrIllegalInstruction);
+    }
+  }
+
+#undef TRAP
+}
+}  // namespace miniplc0
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace miniplc0 {
+
+// 运行时错误的种类
+enum RuntimeErrorCode {
+  ErrIllegalInstruction,  // 执行到了 ILL
+  ErrAddOverflow,
+  ErrSubOverflow,
+  ErrMulOverflow,
+  ErrDivideByZero,
+  ErrDivOverflow,     // INT_MIN / -1
+  ErrInvalidProgram,  // 栈会下溢或者访问了栈外的位置，在运行之前就能发现
+};
+
+class RuntimeError final {
+ private:
+  using uint64_t = std::uint64_t;
+
+ public:
+  RuntimeError(uint64_t index, RuntimeErrorCode err)
+      : _index(index), _err(err) {}
+  bool operator==(const RuntimeError& rhs) const {
+    return _index == rhs._index && _err == rhs._err;
+  }
+
+  // 出错的指令的下标
+  uint64_t GetIndex() const { return _index; }
+  RuntimeErrorCode GetCode() const { return _err; }
+
+ private:
+  uint64_t _index;
+  RuntimeErrorCode _err;
+};
+
+// miniplc0 的虚拟机
+//
+// 构造时把指令检查一遍并预先译码：程序里没有跳转，每条指令执行前的栈深度
+// 都是确定的，所以栈的大小、下溢和 LOD/STO 的越界都可以提前算出来，
+// 执行的时候就不用再检查了，只剩下算术运算的溢出需要在运行时判断。
+//
+// 除了分析器生成的指令，也可以执行 FuseInstructions 合并出来的超级指令。
+//
+// 在 GCC 和 Clang 下用 computed goto 直接跳到下一条指令的处理代码，
+// 其他编译器，或者构造时要求的时候，用 switch 分发。
+class VirtualMachine final {
+ private:
+  using uint64_t = std::uint64_t;
+  using int32_t = std::int32_t;
+
+ public:
+  // 分发方式
+  enum Dispatch {
+    THREADED,
+    SWITCH,
+  };
+
+ public:
+  explicit VirtualMachine(const std::vector<Instruction>& v,
+                          Dispatch dispatch = THREADED);
+  VirtualMachine(const VirtualMachine&) = delete;
+  VirtualMachine& operator=(VirtualMachine) = delete;
+
+  // 当前编译器是否支持 THREADED
+  static bool HasThreadedDispatch();
+
+  // 实际使用的分发方式
+  Dispatch GetDispatch() const { return _dispatch; }
+
+  // 执行整个程序，返回输出的所有值
+  // 出错时第一项是出错之前已经输出的值
+  // 可以执行多次，每次都从头开始
+  std::pair<std::vector<int32_t>, std::optional<RuntimeError>> Run();
+
+ private:
+  // 译码之后的指令
+  struct Code {
+    // SWITCH 模式下是操作的编号
+    // THREADED 模式下是处理这条指令的代码相对于第一个处理代码的偏移
+    int32_t op;
+    int32_t x;
+  };
+
+  // 在 Operation 之后追加的内部操作，放在程序末尾
+  static constexpr int32_t HALT = Operation::DIVSTO + 1;
+
+  // out 为空时不执行，只把指令流转换成 THREADED 模式用的形式
+  std::optional<RuntimeError> runThreaded(std::vector<int32_t>* out);
+  std::optional<RuntimeError> runSwitch(std::vector<int32_t>& out);
+
+ private:
+  std::vector<Code> _codes;
+  std::vector<int32_t> _stack;
+  // 程序会输出多少个值
+  std::size_t _outputs;
+  // 检查时发现的错误
+  std::optional<RuntimeError> _invalid;
+  Dispatch _dispatch;
+};
+}  // namespace miniplc0